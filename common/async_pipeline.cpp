@@ -0,0 +1,103 @@
+#include "async_pipeline.h"
+#include <chrono>
+#include <cstdio>
+#include "thread_placement.h"
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static const int kPipelineSlots = 2;
+
+int run_pipelined(ModelSession& session, size_t num_frames, const PipelineCallbacks& callbacks,
+                  PipelineStats* stats) {
+    if (!callbacks.prepare || !callbacks.consume) {
+        LOGE("run_pipelined: prepare and consume callbacks are required.");
+        return -1;
+    }
+    if (session.config().input_slots < kPipelineSlots || session.config().output_ring < 2) {
+        LOGE("run_pipelined: the session needs input_slots >= %d and output_ring >= 2.", kPipelineSlots);
+        return -1;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    size_t consumed = 0;
+    size_t failed = 0;
+    OutputLease previous;
+    auto prepare = [&](size_t frame, int slot) {
+        StageScope stage(callbacks.prepare_stage.c_str());
+        return callbacks.prepare(frame, slot);
+    };
+    auto consume = [&](size_t frame, const nn_output* out) {
+        StageScope stage(callbacks.consume_stage.c_str());
+        callbacks.consume(frame, out);
+    };
+
+    int64_t pending_id = -1;
+    size_t pending_frame = 0;
+    bool ready = num_frames > 0 && prepare(0, 0) == 0;
+
+    for (size_t frame = 0; frame < num_frames; ++frame) {
+        int slot = frame % kPipelineSlots;
+
+        // 1. Collect frame N-1. Its outputs are leased so the invoke
+        //    submitted below writes to another output ring entry.
+        size_t previous_frame = pending_frame;
+        if (pending_id >= 0) {
+            if (session.wait(pending_id)) {
+                previous = session.lease_output();
+            } else {
+                LOGE("run_pipelined: no outputs for frame %zu.", previous_frame);
+                ++failed;
+            }
+            pending_id = -1;
+        }
+
+        // 2. Start frame N.
+        if (ready) {
+            int ret = callbacks.upload ? callbacks.upload(frame, slot) : session.bind_slot(slot);
+            if (ret == 0) {
+                pending_id = session.submit();
+                pending_frame = frame;
+                if (pending_id < 0) {
+                    LOGE("run_pipelined: submit failed for frame %zu.", frame);
+                    ++failed;
+                }
+            } else {
+                LOGE("run_pipelined: upload failed for frame %zu.", frame);
+                ++failed;
+            }
+        } else {
+            LOGE("run_pipelined: prepare failed for frame %zu.", frame);
+            ++failed;
+        }
+
+        // 3. CPU side while the NPU runs frame N.
+        if (previous) {
+            consume(previous_frame, previous.get());
+            previous.release();
+            ++consumed;
+        }
+        if (frame + 1 < num_frames) {
+            ready = prepare(frame + 1, (frame + 1) % kPipelineSlots) == 0;
+        }
+    }
+
+    if (pending_id >= 0) {
+        nn_output* out = session.wait(pending_id);
+        if (out) {
+            consume(pending_frame, out);
+            ++consumed;
+        } else {
+            LOGE("run_pipelined: no outputs for frame %zu.", pending_frame);
+            ++failed;
+        }
+    }
+
+    if (stats) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start_time;
+        stats->frames = consumed;
+        stats->failed = failed;
+        stats->total_ms = elapsed.count();
+        stats->fps = elapsed.count() > 0.0 ? consumed * 1000.0 / elapsed.count() : 0.0;
+    }
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _AMLNN_ASYNC_PIPELINE_H_
+#define _AMLNN_ASYNC_PIPELINE_H_
+
+#include <functional>
+#include <cstddef>
+#include <string>
+#include "model_session.h"
+
+struct PipelineCallbacks {
+    // CPU work that fills input slot `slot` for `frame`. Runs while the NPU
+    // is busy with the previous frame. Non-zero return skips the frame.
+    std::function<int(size_t frame, int slot)> prepare;
+    // Optional. Runs with the NPU idle, right before `frame` is submitted.
+    // Defaults to ModelSession::bind_slot(slot); override it for inputs fed
+    // through ModelSession::set_input.
+    std::function<int(size_t frame, int slot)> upload;
+    // Consumes the outputs of `frame`. Runs while the NPU is busy with the
+    // next frame, and always before the slot of `frame` is prepared again.
+    std::function<void(size_t frame, const nn_output* out)> consume;
+    // ThreadPlacement stages prepare and consume run in: pinned to the
+    // stage's CPUs when it has a set, and timed either way.
+    std::string prepare_stage = "pre";
+    std::string consume_stage = "post";
+};
+
+struct PipelineStats {
+    size_t frames = 0;   // consumed
+    size_t failed = 0;   // not prepared, uploaded, submitted or collected
+    double total_ms = 0.0;
+    double fps = 0.0;
+};
+
+// Double-buffered driver over ModelSession::submit / wait: frame N+1 is
+// prepared and frame N-1 is consumed while the NPU runs frame N.
+// The session must be created with input_slots >= 2 and output_ring >= 2;
+// frame N-1's outputs are consumed from a leased ring entry, not a copy.
+// Returns -1 when the session or callbacks do not allow that; frames that
+// fail on the way are skipped and counted in PipelineStats::failed.
+int run_pipelined(ModelSession& session, size_t num_frames, const PipelineCallbacks& callbacks,
+                  PipelineStats* stats = nullptr);
+
+#endif
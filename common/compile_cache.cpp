@@ -0,0 +1,148 @@
+#include "compile_cache.h"
+#include "model_blob.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static bool ends_with(const std::string& text, const char* suffix) {
+    size_t len = strlen(suffix);
+    return text.size() >= len && text.compare(text.size() - len, len, suffix) == 0;
+}
+
+aml_model_type_t portable_model_type(const char* path) {
+    std::string p(path ? path : "");
+    if (ends_with(p, ".tflite")) return AML_MODEL_TYPE_TENSORFLOW_LITE;
+    if (ends_with(p, ".pb")) return AML_MODEL_TYPE_TENSORFLOW;
+    return AML_MODEL_TYPE_ADLA_LOADABLE;
+}
+
+// FNV-1a, 64 bit
+static uint64_t hash_bytes(uint64_t h, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::string compile_cache_key(const void* data, size_t size, const std::string& hw_version,
+                              const std::string& sdk_version, const CompileOptions& options) {
+    uint64_t h = hash_bytes(0xcbf29ce484222325ull, data, size);
+    char settings[256];
+    int n = snprintf(settings, sizeof(settings), "|%s|%s|%d|%d|%d", hw_version.c_str(), sdk_version.c_str(),
+                     options.axi_sram_size, options.batch_multiplier, (int)options.optimization_mode);
+    h = hash_bytes(h, settings, n > 0 ? std::min<size_t>(n, sizeof(settings) - 1) : 0);
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)h);
+    return key;
+}
+
+static bool file_ready(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+}
+
+static int make_dirs(const std::string& dir) {
+    for (size_t pos = 1; pos <= dir.size(); ++pos) {
+        if (pos < dir.size() && dir[pos] != '/') continue;
+        std::string part = dir.substr(0, pos);
+        if (mkdir(part.c_str(), 0755) && errno != EEXIST) {
+            LOGE("cannot create compile cache directory %s: %s", part.c_str(), strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+std::string compiled_model_path(const char* model_path, const CompileOptions& options, bool* compiled) {
+    if (compiled) *compiled = false;
+    aml_model_type_t type = portable_model_type(model_path);
+    if (type == AML_MODEL_TYPE_ADLA_LOADABLE) {
+        if (ends_with(model_path, ".onnx")) {
+            LOGE("%s: aml_compiler_args_t takes TensorFlow / TFLite models only, compile ONNX offline.", model_path);
+            return std::string();
+        }
+        return model_path;
+    }
+
+    std::shared_ptr<ModelBlob> blob = ModelBlob::open(model_path);
+    if (!blob) {
+        return std::string();
+    }
+    aml_platform_info_t platform;
+    memset(&platform, 0, sizeof(aml_platform_info_t));
+    aml_read_chip_info(&platform);
+    std::string hw_version = !options.hw_version.empty() ? options.hw_version
+                                                         : (platform.hw_version ? platform.hw_version : "");
+    std::string sdk_version = platform.sdk_version ? platform.sdk_version : "";
+    std::string key = compile_cache_key(blob->data(), blob->size(), hw_version, sdk_version, options);
+    blob.reset();
+
+    std::string path(model_path);
+    size_t slash = path.find_last_of('/');
+    std::string dir = options.cache_dir;
+    if (dir.empty() && getenv("AMLNN_COMPILE_CACHE")) {
+        dir = getenv("AMLNN_COMPILE_CACHE");
+    }
+    if (dir.empty()) {
+        dir = (slash == std::string::npos ? std::string(".") : path.substr(0, slash)) + "/.adla_cache";
+    }
+    std::string stem = slash == std::string::npos ? path : path.substr(slash + 1);
+    stem = stem.substr(0, stem.find_last_of('.'));
+    std::string loadable = dir + "/" + stem + "." + key + ".adla";
+    if (file_ready(loadable)) {
+        return loadable;
+    }
+
+    // One compile at a time in the process; other processes race only to
+    // an atomic rename of complete files
+    static std::mutex compile_mutex;
+    std::lock_guard<std::mutex> lock(compile_mutex);
+    if (file_ready(loadable)) {
+        return loadable;
+    }
+    if (make_dirs(dir)) {
+        return std::string();
+    }
+    std::string tmp = loadable + ".tmp." + std::to_string(getpid());
+    unlink(tmp.c_str());
+
+    aml_config config;
+    memset(&config, 0, sizeof(aml_config));
+    config.typeSize = sizeof(aml_config);
+    config.modelType = type == AML_MODEL_TYPE_TENSORFLOW ? TENSORFLOW : TENSORFLOWLITE;
+    config.path = model_path;
+    config.on_path = tmp.c_str();
+    aml_compiler_args_t& args = config.compiler_args;
+    args.compiler_only = 1;
+    args.set_compiler_args_flag = 1;
+    args.input.model_type = type;
+    args.input.input_type = AML_MODEL_IN_OUT_TYPE_FILE;
+    args.input.model_path = model_path;
+    args.config.hw_version = hw_version.empty() ? NULL : hw_version.c_str();
+    args.config.axi_sram_size = options.axi_sram_size;
+    args.config.batch_multiplier = options.batch_multiplier;
+    args.config.optimization_mode = options.optimization_mode;
+
+    // compiler_only writes the loadable to on_path; a context, if one is
+    // returned, is not needed
+    void* context = aml_module_create(&config);
+    if (context) {
+        aml_module_destroy(context);
+    }
+    if (!file_ready(tmp) || rename(tmp.c_str(), loadable.c_str())) {
+        LOGE("compiling %s to %s failed.", model_path, loadable.c_str());
+        unlink(tmp.c_str());
+        return std::string();
+    }
+    if (compiled) *compiled = true;
+    return loadable;
+}
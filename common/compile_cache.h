@@ -0,0 +1,40 @@
+#ifndef _AMLNN_COMPILE_CACHE_H_
+#define _AMLNN_COMPILE_CACHE_H_
+
+#include <cstddef>
+#include <string>
+#include "nn_sdk.h"
+
+// Compiler settings for models shipped in a portable format (TFLite,
+// TensorFlow) and compiled on the device through aml_compiler_args_t.
+struct CompileOptions {
+    // Directory of compiled loadables. Empty: AMLNN_COMPILE_CACHE if set,
+    // else ".adla_cache" next to the model.
+    std::string cache_dir;
+    // Target NPU; empty takes the hw_version aml_read_chip_info reports.
+    std::string hw_version;
+    int axi_sram_size = 0;
+    int batch_multiplier = 1;
+    aml_compiler_optimization_mode_t optimization_mode = AML_COMPILER_OPTIMIZATION_MODE_FAST;
+};
+
+// Compiler input type from the file extension: ".tflite" and ".pb";
+// AML_MODEL_TYPE_ADLA_LOADABLE for anything else.
+aml_model_type_t portable_model_type(const char* path);
+
+// 16 hex digits hashing the model bytes, the target hw_version, the SDK
+// version and the compiler settings. A loadable is reused only while all
+// of them match.
+std::string compile_cache_key(const void* data, size_t size, const std::string& hw_version,
+                              const std::string& sdk_version, const CompileOptions& options);
+
+// Path of an adla loadable for `model_path`. Loadables are returned as
+// they are. Portable models resolve to "<cache_dir>/<stem>.<key>.adla",
+// compiled with compiler_only on the first call for that key and moved
+// into place only once complete, so later runs and other processes load
+// it without compiling. Empty on failure. `compiled` is set when this
+// call ran the compiler.
+std::string compiled_model_path(const char* model_path, const CompileOptions& options = CompileOptions(),
+                                bool* compiled = nullptr);
+
+#endif
@@ -0,0 +1,135 @@
+#include "core_scheduler.h"
+#include <cstdio>
+#include <cstring>
+#include "nn_sdk.h"
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+// Weight of the newest sample in a context's smoothed inference time.
+static const double kEwmaAlpha = 0.2;
+
+CoreScheduler& CoreScheduler::instance() {
+    static CoreScheduler scheduler;
+    return scheduler;
+}
+
+CoreScheduler::CoreScheduler() : start_(std::chrono::steady_clock::now()) {
+    aml_platform_info_t info;
+    memset(&info, 0, sizeof(aml_platform_info_t));
+    if (aml_read_chip_info(&info) == 0 && info.npu_hw_info.core_num > 0) {
+        num_cores_ = info.npu_hw_info.core_num;
+    }
+    if (num_cores_ > AML_ID_BUTT) {
+        num_cores_ = AML_ID_BUTT;
+    }
+    cores_.resize(num_cores_);
+    for (int i = 0; i < num_cores_; ++i) {
+        cores_[i].core = i;
+    }
+}
+
+int CoreScheduler::pick(const CoreRequest& request) const {
+    if (request.policy == CORE_PINNED) {
+        if (request.core < 0 || request.core >= num_cores_) {
+            LOGE("core %d out of range (%d cores), using core 0.", request.core, num_cores_);
+            return 0;
+        }
+        return request.core;
+    }
+
+    // Ordinary contexts only go next to a priority one when every core has one.
+    bool free_core = false;
+    for (const CoreStats& c : cores_) {
+        if (c.priority_contexts == 0) free_core = true;
+    }
+    auto allowed = [&](const CoreStats& c) {
+        return request.priority > 0 || !free_core || c.priority_contexts == 0;
+    };
+
+    if (request.policy == CORE_ROUND_ROBIN) {
+        for (int i = 0; i < num_cores_; ++i) {
+            int core = (next_core_ + i) % num_cores_;
+            if (allowed(cores_[core])) return core;
+        }
+        return next_core_ % num_cores_;
+    }
+
+    // CORE_LEAST_LOADED; priority contexts first spread over distinct cores
+    int best = -1;
+    for (const CoreStats& c : cores_) {
+        if (!allowed(c)) continue;
+        if (best < 0) { best = c.core; continue; }
+        const CoreStats& b = cores_[best];
+        if (request.priority > 0 && c.priority_contexts != b.priority_contexts) {
+            if (c.priority_contexts < b.priority_contexts) best = c.core;
+            continue;
+        }
+        if (c.load_ms < b.load_ms || (c.load_ms == b.load_ms && c.contexts < b.contexts)) {
+            best = c.core;
+        }
+    }
+    return best < 0 ? 0 : best;
+}
+
+int CoreScheduler::assign(const CoreRequest& request, int* core) {
+    if (request.policy == CORE_DEFAULT) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    int chosen = pick(request);
+    if (request.policy == CORE_ROUND_ROBIN) {
+        next_core_ = (chosen + 1) % num_cores_;
+    }
+
+    Context ctx;
+    ctx.core = chosen;
+    ctx.priority = request.priority;
+    ctx.ewma_ms = 0;
+    int ticket = next_ticket_++;
+    contexts_[ticket] = ctx;
+
+    cores_[chosen].contexts++;
+    if (request.priority > 0) cores_[chosen].priority_contexts++;
+    if (core) *core = chosen;
+    return ticket;
+}
+
+void CoreScheduler::record(int ticket, double inference_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = contexts_.find(ticket);
+    if (it == contexts_.end()) {
+        return;
+    }
+    Context& ctx = it->second;
+    double previous = ctx.ewma_ms;
+    ctx.ewma_ms = previous == 0 ? inference_ms : previous + kEwmaAlpha * (inference_ms - previous);
+
+    CoreStats& c = cores_[ctx.core];
+    c.load_ms += ctx.ewma_ms - previous;
+    c.busy_ms += inference_ms;
+    c.invokes++;
+}
+
+void CoreScheduler::release(int ticket) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = contexts_.find(ticket);
+    if (it == contexts_.end()) {
+        return;
+    }
+    CoreStats& c = cores_[it->second.core];
+    c.contexts--;
+    if (it->second.priority > 0) c.priority_contexts--;
+    c.load_ms -= it->second.ewma_ms;
+    if (c.contexts == 0) c.load_ms = 0;
+    contexts_.erase(it);
+}
+
+std::vector<CoreStats> CoreScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<CoreStats> out(cores_);
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+    for (CoreStats& c : out) {
+        c.occupancy = elapsed_ms > 0 ? c.busy_ms / elapsed_ms : 0;
+    }
+    return out;
+}
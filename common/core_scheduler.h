@@ -0,0 +1,76 @@
+#ifndef _AMLNN_CORE_SCHEDULER_H_
+#define _AMLNN_CORE_SCHEDULER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+enum CorePolicy {
+    CORE_DEFAULT = 0,      // leave enCoreId unset (SDK default core)
+    CORE_PINNED,           // CoreRequest::core
+    CORE_ROUND_ROBIN,
+    CORE_LEAST_LOADED,     // lowest measured load, see CoreScheduler
+};
+
+struct CoreRequest {
+    CorePolicy policy = CORE_DEFAULT;
+    int core = 0;          // CORE_PINNED only
+    // > 0 marks a latency-critical model: it is placed on the core with the
+    // fewest other priority contexts, and ordinary contexts avoid cores that
+    // host one while another core is available.
+    int priority = 0;
+};
+
+struct CoreStats {
+    int core = 0;
+    int contexts = 0;
+    int priority_contexts = 0;
+    uint64_t invokes = 0;
+    double busy_ms = 0;        // summed inference time
+    double load_ms = 0;        // sum of the contexts' smoothed per-invoke time
+    double occupancy = 0;      // busy_ms / time since the scheduler started
+};
+
+// Process-wide placement of contexts on NPU cores through
+// aml_forward_ctrl_t::enCoreId, which is fixed at aml_module_create.
+// Sessions report each invoke's inference time; CORE_LEAST_LOADED places a
+// new context on the core whose contexts have the lowest summed
+// exponentially smoothed inference time.
+class CoreScheduler {
+public:
+    static CoreScheduler& instance();
+
+    // Cores reported by aml_read_chip_info (at least 1).
+    int num_cores() const { return num_cores_; }
+
+    // Picks a core for a new context and registers it there. Returns a
+    // ticket for record() / release(), or -1 for CORE_DEFAULT; `core`
+    // receives the chosen core.
+    int assign(const CoreRequest& request, int* core);
+    void record(int ticket, double inference_ms);
+    void release(int ticket);
+
+    std::vector<CoreStats> stats() const;
+
+private:
+    struct Context {
+        int core;
+        int priority;
+        double ewma_ms;
+    };
+
+    CoreScheduler();
+    int pick(const CoreRequest& request) const;
+
+    int num_cores_ = 1;
+    mutable std::mutex mutex_;
+    std::map<int, Context> contexts_;
+    std::vector<CoreStats> cores_;
+    int next_ticket_ = 0;
+    int next_core_ = 0;
+    std::chrono::steady_clock::time_point start_;
+};
+
+#endif
@@ -0,0 +1,241 @@
+#include "hot_swap.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <future>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool same_file(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+           a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+std::unique_ptr<HotSwapSession> HotSwapSession::create(const char* model_path, const SwapConfig& config) {
+    std::unique_ptr<HotSwapSession> swap(new HotSwapSession(model_path, config));
+    double load_ms = 0, warmup_ms = 0;
+    std::shared_ptr<ModelSession> session = swap->load(model_path, &load_ms, &warmup_ms);
+    if (!session) {
+        return nullptr;
+    }
+    std::atomic_store(&swap->current_, session);
+    swap->stats_.last_load_ms = load_ms;
+    swap->stats_.last_warmup_ms = warmup_ms;
+    swap->thread_ = std::thread(&HotSwapSession::background_loop, swap.get());
+    return swap;
+}
+
+HotSwapSession::HotSwapSession(const std::string& model_path, const SwapConfig& config) : config_(config) {
+    config_.session.warmup_runs = 0;
+    stats_.model_path = model_path;
+    memset(&watched_, 0, sizeof(watched_));
+    memset(&changed_, 0, sizeof(changed_));
+    stat(model_path.c_str(), &watched_);
+}
+
+HotSwapSession::~HotSwapSession() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+std::shared_ptr<ModelSession> HotSwapSession::current() const {
+    return std::atomic_load(&current_);
+}
+
+uint64_t HotSwapSession::generation() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_.generation;
+}
+
+SwapStats HotSwapSession::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    SwapStats stats = stats_;
+    stats.draining = (int)retired_.size();
+    return stats;
+}
+
+bool HotSwapSession::swap_async(const std::string& model_path, std::function<void(int)> done) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_ || stopping_) {
+            return false;
+        }
+        pending_ = true;
+        pending_path_ = model_path.empty() ? stats_.model_path : model_path;
+        pending_done_ = std::move(done);
+    }
+    cv_.notify_all();
+    return true;
+}
+
+int HotSwapSession::swap(const std::string& model_path) {
+    std::promise<int> result;
+    std::future<int> status = result.get_future();
+    if (!swap_async(model_path, [&result](int ret) { result.set_value(ret); })) {
+        LOGE("HotSwapSession: a swap is already in progress.");
+        return -1;
+    }
+    return status.get();
+}
+
+std::shared_ptr<ModelSession> HotSwapSession::load(const std::string& model_path, double* load_ms,
+                                                   double* warmup_ms) {
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<ModelSession> session = ModelSession::create(model_path.c_str(), config_.session);
+    if (!session) {
+        return nullptr;
+    }
+    if (config_.prepare && config_.prepare(*session)) {
+        LOGE("HotSwapSession: prepare rejected %s", model_path.c_str());
+        return nullptr;
+    }
+    *load_ms = ms_since(start);
+    // Inputs prepare() allocated are warmed with their zero point
+    start = std::chrono::steady_clock::now();
+    if (session->warmup(std::max(1, config_.warmup_runs))) {
+        LOGE("HotSwapSession: warm-up failed for %s", model_path.c_str());
+        return nullptr;
+    }
+    *warmup_ms = ms_since(start);
+    return session;
+}
+
+bool HotSwapSession::compatible(const ModelSession& next, const ModelSession& serving) const {
+    auto same = [](const std::vector<TensorDesc>& a, const std::vector<TensorDesc>& b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (a[i].dims != b[i].dims || a[i].format != b[i].format) return false;
+        }
+        return true;
+    };
+    return same(next.inputs(), serving.inputs()) && same(next.outputs(), serving.outputs());
+}
+
+bool HotSwapSession::file_changed() {
+    struct stat st;
+    if (stat(stats_.model_path.c_str(), &st) || same_file(st, watched_)) {
+        change_seen_ = false;
+        return false;
+    }
+    if (st.st_dev == watched_.st_dev && st.st_ino == watched_.st_ino) {
+        // Written in place. The serving context was created from a shared
+        // mapping of this inode, which has just changed under it; loading
+        // the file again would give no intact version to fall back on.
+        // Only a rename brings in a new version.
+        if (!overwrite_warned_) {
+            LOGE("HotSwapSession: %s was modified in place, not reloaded; replace it with a rename.",
+                 stats_.model_path.c_str());
+            overwrite_warned_ = true;
+        }
+        change_seen_ = false;
+        return false;
+    }
+    overwrite_warned_ = false;
+    // Loaded only once a copy in progress has stopped changing
+    bool stable = change_seen_ && same_file(st, changed_);
+    changed_ = st;
+    change_seen_ = true;
+    return stable;
+}
+
+// Old versions are destroyed here, never on a serving thread, once no
+// request holds them any more. A retired version cannot be handed out
+// again, so its use count only goes down.
+void HotSwapSession::drain() {
+    std::vector<std::shared_ptr<ModelSession>> drained;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < retired_.size();) {
+            if (retired_[i].session.use_count() > 1) {
+                ++i;
+                continue;
+            }
+            stats_.last_drain_ms = ms_since(retired_[i].since);
+            ++stats_.retired;
+            drained.push_back(std::move(retired_[i].session));
+            retired_.erase(retired_.begin() + i);
+        }
+    }
+    drained.clear();
+}
+
+void HotSwapSession::background_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (!pending_ && config_.watch_ms > 0 && file_changed()) {
+            pending_ = true;
+            pending_path_ = stats_.model_path;
+        }
+        if (pending_) {
+            std::string path = pending_path_;
+            std::function<void(int)> done = std::move(pending_done_);
+            lock.unlock();
+
+            double load_ms = 0, warmup_ms = 0;
+            struct stat st;
+            bool watched = stat(path.c_str(), &st) == 0;
+            std::shared_ptr<ModelSession> next = load(path, &load_ms, &warmup_ms);
+            std::shared_ptr<ModelSession> serving = current();
+            if (next && config_.same_io && !compatible(*next, *serving)) {
+                LOGE("HotSwapSession: %s has different inputs / outputs, not switched in.", path.c_str());
+                next.reset();
+            }
+            if (next) {
+                std::atomic_store(&current_, next);
+            }
+
+            lock.lock();
+            if (next) {
+                retired_.push_back({std::move(serving), std::chrono::steady_clock::now()});
+                stats_.model_path = path;
+                ++stats_.generation;
+                stats_.last_load_ms = load_ms;
+                stats_.last_warmup_ms = warmup_ms;
+            } else {
+                serving.reset();
+                ++stats_.failed;
+            }
+            // A rejected file is not retried until it changes again
+            if (watched && path == stats_.model_path) {
+                watched_ = st;
+            }
+            change_seen_ = false;
+            pending_ = false;
+            lock.unlock();
+            if (done) {
+                done(next ? 0 : -1);
+            }
+            drain();
+            lock.lock();
+            continue;
+        }
+        lock.unlock();
+        drain();
+        lock.lock();
+        if (pending_) {
+            continue;
+        }
+        if (stopping_ && retired_.empty()) {
+            return;
+        }
+        // Requests return old versions without notifying; poll while any
+        // are draining
+        if (!retired_.empty()) {
+            cv_.wait_for(lock, std::chrono::milliseconds(1));
+        } else if (config_.watch_ms > 0) {
+            cv_.wait_for(lock, std::chrono::milliseconds(config_.watch_ms));
+        } else {
+            cv_.wait(lock);
+        }
+    }
+}
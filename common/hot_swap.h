@@ -0,0 +1,116 @@
+#ifndef _AMLNN_HOT_SWAP_H_
+#define _AMLNN_HOT_SWAP_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "model_session.h"
+
+struct SwapConfig {
+    // Settings of every version. Its warmup_runs is replaced by the one
+    // below, which runs after `prepare`.
+    SessionConfig session;
+    // Dummy invokes on a new version before it is switched in, so the
+    // serving path never takes its cold invokes. At least 1.
+    int warmup_runs = 2;
+    // Called on every new version before warm-up, from the loading
+    // thread: allocate DMA input buffers, check tensors, ... Non-zero
+    // rejects the version.
+    std::function<int(ModelSession&)> prepare;
+    // Reject versions whose inputs or outputs differ from the serving one
+    // in count, shape or data type. Quantization may change; read it from
+    // the session's TensorDesc.
+    bool same_io = true;
+    // Checks the model file every watch_ms and loads it again once it has
+    // been replaced by a rename (a new inode) and stayed the same for one
+    // more check. A file written in place is not reloaded: the serving
+    // version's context uses a shared mapping of it (ModelBlob). 0:
+    // versions change only through swap().
+    int watch_ms = 0;
+};
+
+struct SwapStats {
+    std::string model_path;             // of the serving version
+    uint64_t generation = 0;            // versions switched in after the first
+    uint64_t failed = 0;                // versions that failed to load or were rejected
+    uint64_t retired = 0;               // old versions destroyed
+    int draining = 0;                   // old versions still held by requests
+    double last_load_ms = 0;            // create + prepare
+    double last_warmup_ms = 0;
+    double last_drain_ms = 0;           // switch to destruction of the old version
+};
+
+// A ModelSession whose model can be replaced while requests are being
+// served. New versions are created, prepared and warmed up on a
+// background thread and then published with one atomic pointer store,
+// between requests. Requests keep the version they started on; an old
+// version is destroyed on the background thread once its last request
+// has returned it. As with ModelSession, one thread at a time uses a
+// version.
+class HotSwapSession {
+public:
+    static std::unique_ptr<HotSwapSession> create(const char* model_path, const SwapConfig& config = SwapConfig());
+    // Finishes a load in progress and waits for old versions to drain.
+    ~HotSwapSession();
+
+    HotSwapSession(const HotSwapSession&) = delete;
+    HotSwapSession& operator=(const HotSwapSession&) = delete;
+
+    // The serving version. Take it once per request and keep it until
+    // the request's outputs have been read:
+    //   std::shared_ptr<ModelSession> s = swap->current();
+    std::shared_ptr<ModelSession> current() const;
+    // Bumped on every switch, to rebuild per-version state (quantizers,
+    // cached TensorViews) when it differs from the one last seen.
+    uint64_t generation() const;
+
+    // Loads `model_path` (empty: the serving path again) in the
+    // background and switches to it once warmed up. `done` gets 0, or -1
+    // when the version was rejected, on the loading thread. Returns false
+    // while another load is queued.
+    bool swap_async(const std::string& model_path = std::string(), std::function<void(int)> done = nullptr);
+    // swap_async() and wait for the result.
+    int swap(const std::string& model_path = std::string());
+
+    SwapStats stats() const;
+
+private:
+    struct Retired {
+        std::shared_ptr<ModelSession> session;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    HotSwapSession(const std::string& model_path, const SwapConfig& config);
+    std::shared_ptr<ModelSession> load(const std::string& model_path, double* load_ms, double* warmup_ms);
+    bool compatible(const ModelSession& next, const ModelSession& serving) const;
+    void background_loop();
+    void drain();
+    bool file_changed();
+
+    SwapConfig config_;
+    std::shared_ptr<ModelSession> current_;   // std::atomic_load / atomic_store only
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+    bool stopping_ = false;
+    bool pending_ = false;
+    std::string pending_path_;
+    std::function<void(int)> pending_done_;
+    std::vector<Retired> retired_;
+    SwapStats stats_;
+
+    struct stat watched_;                   // file state of the serving version
+    struct stat changed_;                   // last changed state seen, not yet stable
+    bool change_seen_ = false;
+    bool overwrite_warned_ = false;         // in-place write of the watched inode logged
+};
+
+#endif
@@ -0,0 +1,578 @@
+#include "layer_profile.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <sys/stat.h>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static const struct {
+    const char* name;
+    aml_operator_t op;
+} kOperators[] = {
+    {"Add", AML_Add}, {"AveragePool2d", AML_AveragePool2d}, {"Concatenation", AML_Concatenation},
+    {"Conv2d", AML_Conv2d}, {"DepthwiseConv2d", AML_DepthwiseConv2d}, {"DepthToSpace", AML_DepthToSpace},
+    {"Dequantize", AML_Dequantize}, {"EmbeddingLookup", AML_EmbeddingLookup}, {"Floor", AML_Floor},
+    {"FullyConnected", AML_FullyConnected}, {"HashtableLookup", AML_HashtableLookup},
+    {"L2Normalization", AML_L2Normalization}, {"L2Pool2d", AML_L2Pool2d},
+    {"LocalResponseNormalization", AML_LocalResponseNormalization}, {"Logistic", AML_Logistic},
+    {"LshProjection", AML_LshProjection}, {"Lstm", AML_Lstm}, {"MaxPool2d", AML_MaxPool2d}, {"Mul", AML_Mul},
+    {"Relu", AML_Relu}, {"ReluN1To1", AML_ReluN1To1}, {"Relu6", AML_Relu6}, {"Reshape", AML_Reshape},
+    {"ResizeBilinear", AML_ResizeBilinear}, {"Rnn", AML_Rnn}, {"Softmax", AML_Softmax},
+    {"SpaceToDepth", AML_SpaceToDepth}, {"Svdf", AML_Svdf}, {"Tanh", AML_Tanh},
+    {"ConcatEmbeddings", AML_ConcatEmbeddings}, {"SkipGram", AML_SkipGram}, {"Call", AML_Call},
+    {"Custom", AML_Custom}, {"EmbeddingLookupSparse", AML_EmbeddingLookupSparse}, {"Pad", AML_Pad},
+    {"UnidirectionalSequenceRnn", AML_UnidirectionalSequenceRnn}, {"Gather", AML_Gather},
+    {"BatchToSpaceNd", AML_BatchToSpaceNd}, {"SpaceToBatchNd", AML_SpaceToBatchNd}, {"Transpose", AML_Transpose},
+    {"Mean", AML_Mean}, {"Sub", AML_Sub}, {"Div", AML_Div}, {"Squeeze", AML_Squeeze},
+    {"UnidirectionalSequenceLstm", AML_UnidirectionalSequenceLstm}, {"StridedSlice", AML_StridedSlice},
+    {"BidirectionalSequenceRnn", AML_BidirectionalSequenceRnn}, {"Exp", AML_Exp}, {"TopkV2", AML_TopkV2},
+    {"Split", AML_Split}, {"LogSoftmax", AML_LogSoftmax}, {"Delegate", AML_Delegate},
+    {"BidirectionalSequenceLstm", AML_BidirectionalSequenceLstm}, {"Cast", AML_Cast}, {"Prelu", AML_Prelu},
+    {"Maximum", AML_Maximum}, {"ArgMax", AML_ArgMax}, {"Minimum", AML_Minimum}, {"Less", AML_Less}, {"Neg", AML_Neg},
+    {"PadV2", AML_PadV2}, {"Greater", AML_Greater}, {"GreaterEqual", AML_GreaterEqual}, {"LessEqual", AML_LessEqual},
+    {"Select", AML_Select}, {"Slice", AML_Slice}, {"Sin", AML_Sin}, {"TransposeConv", AML_TransposeConv},
+    {"SparseToDense", AML_SparseToDense}, {"Tile", AML_Tile}, {"ExpandDims", AML_ExpandDims}, {"Equal", AML_Equal},
+    {"NotEqual", AML_NotEqual}, {"Log", AML_Log}, {"Sum", AML_Sum}, {"Sqrt", AML_Sqrt}, {"Rsqrt", AML_Rsqrt},
+    {"Shape", AML_Shape}, {"Pow", AML_Pow}, {"ArgMin", AML_ArgMin}, {"FakeQuant", AML_FakeQuant},
+    {"ReduceProd", AML_ReduceProd}, {"ReduceMax", AML_ReduceMax}, {"Pack", AML_Pack}, {"LogicalOr", AML_LogicalOr},
+    {"OneHot", AML_OneHot}, {"LogicalAnd", AML_LogicalAnd}, {"LogicalNot", AML_LogicalNot}, {"Unpack", AML_Unpack},
+    {"ReduceMin", AML_ReduceMin}, {"FloorDiv", AML_FloorDiv}, {"ReduceAny", AML_ReduceAny}, {"Square", AML_Square},
+    {"ZerosLike", AML_ZerosLike}, {"Fill", AML_Fill}, {"FloorMod", AML_FloorMod}, {"Range", AML_Range},
+    {"ResizeNearestNeighbor", AML_ResizeNearestNeighbor}, {"LeakyRelu", AML_LeakyRelu},
+    {"SquaredDifference", AML_SquaredDifference}, {"MirrorPad", AML_MirrorPad}, {"Abs", AML_Abs},
+    {"SplitV", AML_SplitV}, {"Unique", AML_Unique}, {"Ceil", AML_Ceil}, {"ReverseV2", AML_ReverseV2},
+    {"AddN", AML_AddN}, {"GatherNd", AML_GatherNd}, {"Cos", AML_Cos}, {"Where", AML_Where}, {"Rank", AML_Rank},
+    {"Elu", AML_Elu}, {"ReverseSequence", AML_ReverseSequence}, {"MatrixDiag", AML_MatrixDiag},
+    {"Quantize", AML_Quantize}, {"MatrixSetDiag", AML_MatrixSetDiag}, {"Round", AML_Round},
+    {"HardSwish", AML_HardSwish}, {"If", AML_If}, {"While", AML_While},
+    {"NonMaxSuppressionV4", AML_NonMaxSuppressionV4}, {"NonMaxSuppressionV5", AML_NonMaxSuppressionV5},
+    {"ScatterNd", AML_ScatterNd}, {"SelectV2", AML_SelectV2}, {"Densify", AML_Densify},
+    {"SegmentSum", AML_SegmentSum}, {"BatchMatmul", AML_BatchMatmul},
+    {"PlaceholderForGreaterOpCodes", AML_PlaceholderForGreaterOpCodes}, {"Cumsum", AML_Cumsum},
+    {"CallOnce", AML_CallOnce}, {"BroadcastTo", AML_BroadcastTo}, {"Rfft2d", AML_Rfft2d}, {"Conv3d", AML_Conv3d},
+    {"Imag", AML_Imag}, {"Real", AML_Real}, {"ComplexAbs", AML_ComplexAbs}, {"Hashtable", AML_Hashtable},
+    {"HashtableFind", AML_HashtableFind}, {"HashtableImport", AML_HashtableImport},
+    {"HashtableSize", AML_HashtableSize}, {"ReduceAll", AML_ReduceAll}, {"Conv3dTranspose", AML_Conv3dTranspose},
+    {"VarHandle", AML_VarHandle}, {"ReadVariable", AML_ReadVariable}, {"AssignVariable", AML_AssignVariable},
+    {"BroadcastArgs", AML_BroadcastArgs}, {"RandomStandardNormal", AML_RandomStandardNormal},
+    {"Bucketize", AML_Bucketize}, {"RandomUniform", AML_RandomUniform}, {"Multinomial", AML_Multinomial},
+    {"Gelu", AML_Gelu}, {"DynamicUpdateSlice", AML_DynamicUpdateSlice}, {"Relu0To1", AML_Relu0To1},
+    {"UnsortedSegmentProd", AML_UnsortedSegmentProd}, {"UnsortedSegmentMax", AML_UnsortedSegmentMax},
+    {"UnsortedSegmentSum", AML_UnsortedSegmentSum}, {"Atan2", AML_Atan2},
+    {"UnsortedSegmentMin", AML_UnsortedSegmentMin}, {"Sign", AML_Sign}, {"Bitcast", AML_Bitcast},
+    {"BitwiseXor", AML_BitwiseXor}, {"RightShift", AML_RightShift},
+    {"DetectionPostProcess", AML_DetectionPostProcess}, {"Erf", AML_Erf}
+
+};
+
+// Names dumps use for ops whose aml_operator_t name differs
+static const struct {
+    const char* name;
+    aml_operator_t op;
+} kOperatorAliases[] = {
+    {"conv", AML_Conv2d}, {"convolution", AML_Conv2d}, {"dwconv", AML_DepthwiseConv2d},
+    {"deconv", AML_TransposeConv}, {"deconvolution", AML_TransposeConv}, {"fc", AML_FullyConnected},
+    {"innerproduct", AML_FullyConnected}, {"linear", AML_FullyConnected}, {"matmul", AML_BatchMatmul},
+    {"sigmoid", AML_Logistic}, {"concat", AML_Concatenation}, {"maxpool", AML_MaxPool2d},
+    {"avgpool", AML_AveragePool2d}, {"averagepool", AML_AveragePool2d}, {"resize", AML_ResizeBilinear},
+    {"upsample", AML_ResizeNearestNeighbor}, {"permute", AML_Transpose}, {"eltwise", AML_Add},
+    {"reducemean", AML_Mean}, {"reducesum", AML_Sum}, {"argmax", AML_ArgMax}, {"hardswish", AML_HardSwish},
+};
+
+enum LayerColumn {
+    COL_IGNORED = 0,
+    COL_ID,
+    COL_NAME,
+    COL_OP,
+    COL_TARGET,
+    COL_TIME_US,
+    COL_TIME_MS,
+    COL_READ,
+    COL_WRITE,
+    COL_BYTES,
+};
+
+// Lower case, letters and digits only: "Op Type" and "op_type" are "optype"
+static std::string normalize(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (isalnum((unsigned char)c)) out += (char)tolower((unsigned char)c);
+    }
+    return out;
+}
+
+static bool ends_with(const std::string& text, const char* suffix) {
+    size_t len = strlen(suffix);
+    return text.size() >= len && text.compare(text.size() - len, len, suffix) == 0;
+}
+
+static bool contains(const std::string& text, const char* part) {
+    return text.find(part) != std::string::npos;
+}
+
+aml_operator_t operator_from_name(const std::string& name) {
+    std::string key = normalize(name);
+    for (const char* prefix : {"", "aml", "adla", "op", "nn", "softop", "cpu"}) {
+        if (key.compare(0, strlen(prefix), prefix) != 0) continue;
+        std::string rest = key.substr(strlen(prefix));
+        for (const auto& op : kOperators) {
+            if (normalize(op.name) == rest) return op.op;
+        }
+        for (const auto& alias : kOperatorAliases) {
+            if (rest == alias.name) return alias.op;
+        }
+    }
+    return AML_Unknown;
+}
+
+static const char* operator_name(aml_operator_t id) {
+    for (const auto& op : kOperators) {
+        if (op.op == id) return op.name;
+    }
+    return "?";
+}
+
+// Column of a header field; *scale converts its values to us or bytes.
+static LayerColumn column_of(const std::string& field, double* scale) {
+    std::string key = normalize(field);
+    *scale = 1;
+    if (key == "id" || key == "layerid" || key == "layerindex" || key == "index" || key == "idx" || key == "no") {
+        return COL_ID;
+    }
+    if (key == "name" || key == "layer" || key == "layername" || key == "node" || key == "nodename") return COL_NAME;
+    if (key == "op" || key == "optype" || key == "type" || key == "operator" || key == "layertype" ||
+        key == "opname" || key == "kind") {
+        return COL_OP;
+    }
+    if (key == "target" || key == "device" || key == "engine" || key == "unit" || key == "backend" ||
+        key == "core" || key == "executor" || key == "runon" || key == "hw") {
+        return COL_TARGET;
+    }
+    if (contains(key, "cycle")) return COL_IGNORED;
+    if (contains(key, "time") || contains(key, "latency") || contains(key, "elapsed") || contains(key, "duration") ||
+        key == "us" || key == "ms") {
+        return ends_with(key, "ms") ? COL_TIME_MS : COL_TIME_US;
+    }
+    if (ends_with(key, "kb")) *scale = 1024;
+    if (ends_with(key, "mb")) *scale = 1024 * 1024;
+    if (contains(key, "read") || key.compare(0, 2, "rd") == 0) return COL_READ;
+    if (contains(key, "write") || key.compare(0, 2, "wr") == 0) return COL_WRITE;
+    if (contains(key, "bytes") || contains(key, "bandwidth") || contains(key, "traffic") || key == "size") {
+        return COL_BYTES;
+    }
+    *scale = 1;
+    return COL_IGNORED;
+}
+
+static bool is_number(const std::string& text) {
+    if (text.empty()) return false;
+    char* end = NULL;
+    strtod(text.c_str(), &end);
+    return end && *end == '\0';
+}
+
+static bool is_cpu_target(const std::string& target, const std::string& op) {
+    std::string t = normalize(target);
+    if (t == "arm" || t == "sw" || t == "host" || t == "neon" || t == "openmp" || contains(t, "cpu") ||
+        contains(t, "soft")) {
+        return true;
+    }
+    return contains(normalize(op), "softop");
+}
+
+static std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return std::string();
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+// Separator of a header line: ',', tab, '|' or ';', 0 for whitespace.
+// Rows use their header's, since layer names may contain the others.
+static char pick_separator(const std::string& line) {
+    for (char c : {',', '\t', '|', ';'}) {
+        if (line.find(c) != std::string::npos) return c;
+    }
+    return 0;
+}
+
+static std::vector<std::string> split_fields(const std::string& line, char sep) {
+    std::vector<std::string> fields;
+    if (sep == 0) {
+        size_t pos = 0;
+        while ((pos = line.find_first_not_of(" \t", pos)) != std::string::npos) {
+            size_t end = line.find_first_of(" \t", pos);
+            if (end == std::string::npos) end = line.size();
+            fields.push_back(line.substr(pos, end - pos));
+            pos = end;
+        }
+        return fields;
+    }
+    // Fields may be double-quoted, with "" for a quote, as
+    // save_layer_profile_csv writes them
+    std::string field;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted) {
+            if (c != '"') {
+                field += c;
+            } else if (i + 1 < line.size() && line[i + 1] == '"') {
+                field += '"';
+                ++i;
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"' && trim(field).empty()) {
+            field.clear();
+            quoted = true;
+        } else if (c == sep) {
+            fields.push_back(trim(field));
+            field.clear();
+        } else {
+            field += c;
+        }
+    }
+    fields.push_back(trim(field));
+    // "| a | b |" tables
+    if (sep == '|') {
+        if (!fields.empty() && fields.front().empty()) fields.erase(fields.begin());
+        if (!fields.empty() && fields.back().empty()) fields.pop_back();
+    }
+    return fields;
+}
+
+struct Row {
+    int id = -1;
+    std::string name, op, target;
+    bool has_time = false;
+    double time_us = 0;
+    bool has_bytes = false;
+    double read = 0, write = 0, other = 0;
+};
+
+// Adds a value of column `column` to `row`; false when it is not a number
+// where one is needed.
+static bool set_field(Row* row, LayerColumn column, double scale, const std::string& value) {
+    switch (column) {
+    case COL_ID:
+        if (!is_number(value)) return false;
+        row->id = atoi(value.c_str());
+        break;
+    case COL_NAME: row->name = value; break;
+    case COL_OP: row->op = value; break;
+    case COL_TARGET: row->target = value; break;
+    case COL_TIME_US:
+    case COL_TIME_MS:
+        if (!is_number(value)) return false;
+        row->time_us = atof(value.c_str()) * (column == COL_TIME_MS ? 1000 : 1);
+        row->has_time = true;
+        break;
+    case COL_READ:
+    case COL_WRITE:
+    case COL_BYTES:
+        if (!is_number(value)) return false;
+        (column == COL_READ ? row->read : column == COL_WRITE ? row->write : row->other) += atof(value.c_str()) * scale;
+        row->has_bytes = true;
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+static int load_file(const std::string& path, LayerProfile* profile, int skip) {
+    std::ifstream file(path);
+    if (!file) {
+        LOGE("cannot read %s", path.c_str());
+        return -1;
+    }
+    std::map<std::string, size_t> index;
+    for (size_t i = 0; i < profile->layers.size(); ++i) {
+        index[std::to_string(profile->layers[i].id) + "/" + profile->layers[i].name] = i;
+    }
+    std::map<std::string, int> seen;      // rows per layer in this file, for `skip`
+    std::vector<std::pair<LayerColumn, double>> columns;
+    char sep = 0;                           // of the current header
+    uint64_t rows = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        // Rules under table headers: "|----|----|", "=====", "+---+"
+        if (line.find_first_not_of("-=+|: \t") == std::string::npos) continue;
+
+        Row row;
+        bool ok = true;
+        std::vector<std::string> fields = split_fields(line, pick_separator(line));
+        if (fields[0].find('=') != std::string::npos) {
+            // key=value fields
+            for (const auto& field : fields) {
+                size_t eq = field.find('=');
+                if (eq == std::string::npos) continue;
+                double scale;
+                LayerColumn column = column_of(field.substr(0, eq), &scale);
+                ok = set_field(&row, column, scale, trim(field.substr(eq + 1))) && ok;
+            }
+        } else {
+            std::vector<std::pair<LayerColumn, double>> header;
+            int known = 0;
+            bool numbers = false;
+            for (const auto& field : fields) {
+                double scale;
+                LayerColumn column = column_of(field, &scale);
+                header.push_back(std::make_pair(column, scale));
+                if (column != COL_IGNORED) ++known;
+                if (is_number(field)) numbers = true;
+            }
+            if (known >= 2 && !numbers) {
+                // "Layer | Name | ...": the layer column is the index
+                int names = 0;
+                for (const auto& column : header) names += column.first == COL_NAME;
+                for (size_t i = 0; i < header.size() && names > 1; ++i) {
+                    if (header[i].first == COL_NAME && normalize(fields[i]) == "layer") header[i].first = COL_ID;
+                }
+                columns = header;
+                sep = pick_separator(line);
+                continue;
+            }
+            fields = split_fields(line, sep);
+            if (columns.empty() || fields.size() < columns.size()) {
+                ++profile->skipped_rows;
+                continue;
+            }
+            for (size_t i = 0; i < columns.size(); ++i) {
+                ok = set_field(&row, columns[i].first, columns[i].second, fields[i]) && ok;
+            }
+        }
+        if (!ok || (row.id < 0 && row.name.empty()) || (!row.has_time && !row.has_bytes)) {
+            ++profile->skipped_rows;
+            continue;
+        }
+
+        std::string key = std::to_string(row.id) + "/" + row.name;
+        if (seen[key]++ < skip) continue;
+        auto it = index.find(key);
+        if (it == index.end()) {
+            LayerStats layer;
+            layer.id = row.id;
+            layer.name = row.name;
+            it = index.insert(std::make_pair(key, profile->layers.size())).first;
+            profile->layers.push_back(layer);
+        }
+        LayerStats& layer = profile->layers[it->second];
+        if (layer.op.empty() && !row.op.empty()) {
+            layer.op = row.op;
+            layer.op_id = operator_from_name(row.op);
+        }
+        if (layer.target.empty() && !row.target.empty()) layer.target = row.target;
+        layer.softop = layer.softop || is_cpu_target(row.target, row.op);
+        if (row.has_time) {
+            ++layer.time_samples;
+            layer.total_us += row.time_us;
+            layer.max_us = std::max(layer.max_us, row.time_us);
+        }
+        if (row.has_bytes) {
+            ++layer.byte_samples;
+            layer.read_bytes += (uint64_t)row.read;
+            layer.write_bytes += (uint64_t)row.write;
+            layer.other_bytes += (uint64_t)row.other;
+        }
+        ++rows;
+    }
+    profile->rows += rows;
+    ++profile->files;
+    return 0;
+}
+
+int load_layer_profile(const char* path, LayerProfile* profile, int skip) {
+    struct stat st;
+    if (NULL == path || stat(path, &st)) {
+        LOGE("no per-layer profile at %s", path ? path : "(null)");
+        return -1;
+    }
+    uint64_t rows = profile->rows;
+    if (!S_ISDIR(st.st_mode)) {
+        load_file(path, profile, skip);
+    } else {
+        std::vector<std::string> files;
+        DIR* dir = opendir(path);
+        if (NULL == dir) {
+            LOGE("cannot open %s", path);
+            return -1;
+        }
+        while (struct dirent* entry = readdir(dir)) {
+            std::string file = std::string(path) + "/" + entry->d_name;
+            if (entry->d_name[0] != '.' && stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+                files.push_back(file);
+            }
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) {
+            load_file(file, profile, skip);
+        }
+    }
+    if (profile->rows == rows) {
+        LOGE("no per-layer rows found in %s: no layer time or byte column recognized (%llu lines not understood)",
+             path, (unsigned long long)profile->skipped_rows);
+        return -1;
+    }
+    return 0;
+}
+
+static double mb(double bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+std::string layer_profile_report(const LayerProfile& profile, int top_n) {
+    std::string out;
+    char line[512];
+    double total_us = 0, softop_us = 0, total_bytes = 0;
+    uint64_t invokes = 0;
+    int softop_layers = 0;
+    for (const auto& l : profile.layers) {
+        total_us += l.mean_us();
+        total_bytes += l.mean_bytes();
+        invokes = std::max(invokes, std::max(l.time_samples, l.byte_samples));
+        if (l.softop) {
+            softop_us += l.mean_us();
+            ++softop_layers;
+        }
+    }
+    snprintf(line, sizeof(line), "per-layer profile: %zu layers from %d file(s), %llu invokes, %.2f ms and %.2f MB per invoke\n",
+             profile.layers.size(), profile.files, (unsigned long long)invokes, total_us / 1000, mb(total_bytes));
+    out += line;
+    snprintf(line, sizeof(line), "CPU softops: %d layers, %.2f ms per invoke (%.1f%% of layer time)\n", softop_layers,
+             softop_us / 1000, total_us > 0 ? 100 * softop_us / total_us : 0.0);
+    out += line;
+    if (profile.skipped_rows) {
+        snprintf(line, sizeof(line), "%llu lines not understood\n", (unsigned long long)profile.skipped_rows);
+        out += line;
+    }
+
+    // Layers with no rows of a kind stay out of that list
+    std::vector<const LayerStats*> order;
+    size_t n = 0;
+
+    if (total_us > 0) {
+        order.clear();
+        for (const auto& l : profile.layers) {
+            if (l.time_samples) order.push_back(&l);
+        }
+        n = std::min(order.size(), (size_t)std::max(0, top_n));
+        std::stable_sort(order.begin(), order.end(),
+                         [](const LayerStats* a, const LayerStats* b) { return a->mean_us() > b->mean_us(); });
+        snprintf(line, sizeof(line), "\ntop %zu layers by time\n  %4s %5s  %-24s %-16s %-8s %9s %9s %7s\n", n, "rank",
+                 "id", "layer", "op", "target", "mean ms", "max ms", "share");
+        out += line;
+        for (size_t i = 0; i < n; ++i) {
+            const LayerStats& l = *order[i];
+            snprintf(line, sizeof(line), "  %4zu %5d  %-24.24s %-16.16s %-8.8s %9.3f %9.3f %6.1f%%%s\n", i + 1, l.id,
+                     l.name.c_str(), l.op.c_str(), l.target.c_str(), l.mean_us() / 1000, l.max_us / 1000,
+                     100 * l.mean_us() / total_us, l.softop ? "  softop" : "");
+            out += line;
+        }
+    }
+
+    if (total_bytes > 0) {
+        order.clear();
+        for (const auto& l : profile.layers) {
+            if (l.byte_samples) order.push_back(&l);
+        }
+        n = std::min(order.size(), (size_t)std::max(0, top_n));
+        std::stable_sort(order.begin(), order.end(),
+                         [](const LayerStats* a, const LayerStats* b) { return a->mean_bytes() > b->mean_bytes(); });
+        snprintf(line, sizeof(line), "\ntop %zu layers by bandwidth\n  %4s %5s  %-24s %-16s %-8s %9s %9s %9s %7s\n", n,
+                 "rank", "id", "layer", "op", "target", "MB", "read MB", "write MB", "share");
+        out += line;
+        for (size_t i = 0; i < n; ++i) {
+            const LayerStats& l = *order[i];
+            double samples = l.byte_samples ? (double)l.byte_samples : 1;
+            snprintf(line, sizeof(line), "  %4zu %5d  %-24.24s %-16.16s %-8.8s %9.2f %9.2f %9.2f %6.1f%%%s\n", i + 1,
+                     l.id, l.name.c_str(), l.op.c_str(), l.target.c_str(), mb(l.mean_bytes()),
+                     mb(l.read_bytes / samples), mb(l.write_bytes / samples), 100 * l.mean_bytes() / total_bytes,
+                     l.softop ? "  softop" : "");
+            out += line;
+        }
+    }
+
+    // Softop time by op type: the ops worth an OpenMP / NEON override
+    std::map<std::string, std::pair<int, double>> by_op;
+    std::map<std::string, aml_operator_t> op_ids;
+    for (const auto& l : profile.layers) {
+        if (!l.softop) continue;
+        std::string op = l.op.empty() ? "?" : l.op;
+        by_op[op].first++;
+        by_op[op].second += l.mean_us();
+        op_ids[op] = l.op_id;
+    }
+    if (!by_op.empty()) {
+        std::vector<std::pair<std::string, std::pair<int, double>>> ops(by_op.begin(), by_op.end());
+        std::stable_sort(ops.begin(), ops.end(),
+                         [](const std::pair<std::string, std::pair<int, double>>& a,
+                            const std::pair<std::string, std::pair<int, double>>& b) {
+                             return a.second.second > b.second.second;
+                         });
+        snprintf(line, sizeof(line), "\nCPU softop layers by op type\n  %-16s %-22s %6s %9s %7s\n", "op",
+                 "aml_operator_t", "layers", "mean ms", "share");
+        out += line;
+        std::string ids;
+        for (const auto& op : ops) {
+            aml_operator_t id = op_ids[op.first];
+            char name[64];
+            if (id == AML_Unknown) {
+                snprintf(name, sizeof(name), "-");
+            } else {
+                snprintf(name, sizeof(name), "AML_%s (%d)", operator_name(id), (int)id);
+                if (!ids.empty()) ids += ",";
+                ids += std::to_string((int)id);
+            }
+            snprintf(line, sizeof(line), "  %-16.16s %-22s %6d %9.3f %6.1f%%\n", op.first.c_str(), name, op.second.first,
+                     op.second.second / 1000, total_us > 0 ? 100 * op.second.second / total_us : 0.0);
+            out += line;
+        }
+        if (!ids.empty()) {
+            out += "tune them with: softop_tuner <model> -o " + ids + "\n";
+        }
+    }
+    return out;
+}
+
+// Quoted, with "" for a quote, when it holds a ',', '"' or line break
+static std::string csv_field(const std::string& text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) return text;
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    return out + "\"";
+}
+
+int save_layer_profile_csv(const char* path, const LayerProfile& profile) {
+    FILE* file = fopen(path, "w");
+    if (NULL == file) {
+        LOGE("cannot write %s", path);
+        return -1;
+    }
+    double total_us = 0;
+    for (const auto& l : profile.layers) total_us += l.mean_us();
+    fprintf(file, "id,name,op,op_id,target,softop,invokes,mean_us,max_us,share,read_bytes,write_bytes,bytes\n");
+    for (const auto& l : profile.layers) {
+        double samples = l.byte_samples ? (double)l.byte_samples : 1;
+        fprintf(file, "%d,%s,%s,%d,%s,%d,%llu,%.1f,%.1f,%.4f,%.0f,%.0f,%.0f\n", l.id, csv_field(l.name).c_str(),
+                csv_field(l.op).c_str(), l.op_id == AML_Unknown ? -1 : (int)l.op_id, csv_field(l.target).c_str(), l.softop ? 1 : 0,
+                (unsigned long long)std::max(l.time_samples, l.byte_samples), l.mean_us(), l.max_us,
+                total_us > 0 ? l.mean_us() / total_us : 0.0, l.read_bytes / samples, l.write_bytes / samples,
+                l.mean_bytes());
+    }
+    fclose(file);
+    return 0;
+}
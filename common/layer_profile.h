@@ -0,0 +1,64 @@
+#ifndef _AMLNN_LAYER_PROFILE_H_
+#define _AMLNN_LAYER_PROFILE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "nn_sdk.h"
+
+// One layer of a per-layer profile, over all invokes in the dumps.
+struct LayerStats {
+    int id = -1;                        // layer index in the dump, -1 when it has none
+    std::string name;
+    std::string op;                     // op type as the dump names it
+    std::string target;                 // execution unit as the dump names it ("NPU", "CPU", ...)
+    bool softop = false;                // ran on the CPU (fallback op)
+    aml_operator_t op_id = AML_Unknown; // `op` matched to aml_operator_t, for softop profiles
+    uint64_t time_samples = 0;          // invokes with a runtime row
+    double total_us = 0;
+    double max_us = 0;
+    uint64_t byte_samples = 0;          // invokes with a bandwidth row
+    uint64_t read_bytes = 0;            // summed over byte_samples
+    uint64_t write_bytes = 0;
+    uint64_t other_bytes = 0;           // totals dumped without a read / write split
+
+    double mean_us() const { return time_samples ? total_us / time_samples : 0; }
+    double mean_bytes() const {
+        return byte_samples ? (double)(read_bytes + write_bytes + other_bytes) / byte_samples : 0;
+    }
+};
+
+// Layers of the dumps aml_util_setProfile(AML_PERLAYER_RUNTIME /
+// AML_PERLAYER_BANDWIDTH, dir) writes, merged by layer id and name.
+struct LayerProfile {
+    std::vector<LayerStats> layers;     // in dump order
+    int files = 0;
+    uint64_t rows = 0;
+    uint64_t skipped_rows = 0;          // not understood
+};
+
+// Reads a dump file, or every file of a dump directory, into `profile`
+// (merging with what it holds, e.g. a runtime and a bandwidth run). The
+// dump is text: CSV, tab, '|' or space separated columns under a header
+// line naming them, or key=value fields per line. Columns are matched by
+// name: layer id / name, op type, target (device, engine), time_us or
+// time_ms, read_bytes / write_bytes, bytes / bandwidth. The SDK does not
+// document the layout, so this mapping is heuristic; it is checked against
+// the nnsdk_stub dumps only. Lines starting with '#' are comments. The first `skip` rows of every layer and file are
+// dropped, for warm-up invokes. -1 when nothing could be read.
+int load_layer_profile(const char* path, LayerProfile* profile, int skip = 0);
+
+// Top `top_n` layers by mean time and by mean bytes moved per invoke, the
+// CPU softop layers grouped by op type with their aml_operator_t ids (for
+// softop_tuner -o and op.<id>.* lines in "<model>.softop"), and totals.
+std::string layer_profile_report(const LayerProfile& profile, int top_n = 10);
+
+// One CSV row per layer: id,name,op,op_id,target,softop,invokes,mean_us,
+// max_us,share,read_bytes,write_bytes,bytes per invoke.
+int save_layer_profile_csv(const char* path, const LayerProfile& profile);
+
+// aml_operator_t of an op type name ("Softmax", "SOFTMAX", "soft_max"),
+// AML_Unknown when it matches none.
+aml_operator_t operator_from_name(const std::string& name);
+
+#endif
@@ -0,0 +1,270 @@
+#include "memory_report.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "text_escape.h"
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+void read_npu_memory(const aml_profile_config_t& profile, NpuMemory* mem) {
+    const aml_ctx_info_t& ctx = profile.context_info.ctx_info;
+    const aml_dev_memory_info_t& dev = profile.context_info.dev_info;
+    const aml_profiling_ext_data_t& ext = profile.profiling_data.ext;
+    mem->model_bytes = ctx.memory_size;
+    mem->axi_sram_bytes = ctx.axi_sram_size;
+    mem->layers = ctx.num_layers;
+    mem->macc = ctx.macc_count;
+    mem->device_bytes = dev.memory_size;
+    mem->device_axi_sram_bytes = dev.axi_sram_size;
+    mem->tops = dev.tops;
+    mem->alloced_base = ext.mem_alloced_base;
+    mem->alloced_umd = ext.mem_alloced_umd;
+    mem->pool_size = ext.mem_pool_size;
+    mem->pool_used = ext.mem_pool_used;
+    mem->valid = ctx.memory_size > 0 || ext.mem_alloced_base > 0 || ext.mem_pool_used > 0;
+}
+
+int query_npu_memory(void* context, aml_profile_type_t active, NpuMemory* mem) {
+    aml_profile_config_t profile;
+    memset(&profile, 0, sizeof(aml_profile_config_t));
+    profile.profile_type = active == AML_PROFILE_NONE ? AML_PROFILE_MEMORY : active;
+    if (active == AML_PROFILE_NONE && aml_util_enableProfile(context, &profile)) {
+        LOGE("aml_util_enableProfile fail, no memory info.");
+        return -1;
+    }
+    int ret = aml_util_getProfileInfo(context, &profile);
+    if (ret) {
+        LOGE("aml_util_getProfileInfo fail, no memory info.");
+    } else {
+        read_npu_memory(profile, mem);
+    }
+    if (active == AML_PROFILE_NONE) {
+        aml_util_disableProfile(context, &profile);
+    }
+    return ret ? -1 : 0;
+}
+
+// Value of a "Key:   1234 kB" line, in bytes.
+static void read_kb_fields(const char* path, const char* const* keys, uint64_t** values, int count) {
+    FILE* fp = fopen(path, "r");
+    if (NULL == fp) {
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        for (int i = 0; i < count; ++i) {
+            size_t len = strlen(keys[i]);
+            unsigned long long kb = 0;
+            if (strncmp(line, keys[i], len) == 0 && line[len] == ':' && sscanf(line + len + 1, "%llu", &kb) == 1) {
+                *values[i] = (uint64_t)kb * 1024;
+            }
+        }
+    }
+    fclose(fp);
+}
+
+ProcessMemory process_memory() {
+    ProcessMemory mem;
+    const char* status_keys[] = {"VmRSS", "VmHWM"};
+    uint64_t* status_values[] = {&mem.rss_bytes, &mem.peak_rss_bytes};
+    read_kb_fields("/proc/self/status", status_keys, status_values, 2);
+    const char* meminfo_keys[] = {"MemTotal", "MemAvailable"};
+    uint64_t* meminfo_values[] = {&mem.total_bytes, &mem.available_bytes};
+    read_kb_fields("/proc/meminfo", meminfo_keys, meminfo_values, 2);
+    return mem;
+}
+
+HostMemory& HostMemory::instance() {
+    static HostMemory memory;
+    return memory;
+}
+
+void HostMemory::add(const std::string& stage, int64_t bytes, bool new_buffer) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostStageMemory& s = stages_[stage];
+    s.stage = stage;
+    if (new_buffer) {
+        ++s.buffers;
+    }
+    if (bytes < 0) {
+        s.current_bytes -= std::min<uint64_t>(s.current_bytes, (uint64_t)-bytes);
+        return;
+    }
+    s.current_bytes += bytes;
+    s.peak_bytes = std::max(s.peak_bytes, s.current_bytes);
+}
+
+std::vector<HostStageMemory> HostMemory::stages() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<HostStageMemory> out;
+    for (const auto& it : stages_) out.push_back(it.second);
+    return out;
+}
+
+uint64_t HostMemory::peak_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t sum = 0;
+    for (const auto& it : stages_) sum += it.second.peak_bytes;
+    return sum;
+}
+
+HostBytes::HostBytes(const char* stage, size_t bytes) : stage_(stage) {
+    set(bytes);
+}
+
+HostBytes::~HostBytes() {
+    set(0);
+}
+
+void HostBytes::set(size_t bytes) {
+    if (NULL == stage_ || '\0' == stage_[0] || bytes == bytes_) {
+        return;
+    }
+    // Counted once per buffer, not per resize
+    HostMemory::instance().add(stage_, (int64_t)bytes - (int64_t)bytes_, bytes_ == 0);
+    bytes_ = bytes;
+}
+
+void ModelMemory::update(const NpuMemory& mem) {
+    if (queries == 0) {
+        load = mem;
+    }
+    current = mem;
+    peak_pool_used = std::max(peak_pool_used, mem.pool_used);
+    ++queries;
+}
+
+uint64_t ModelMemory::npu_bytes() const {
+    uint64_t bytes = std::max<uint64_t>(current.model_bytes > 0 ? current.model_bytes : 0, peak_pool_used);
+    return std::max(bytes, current.alloced_base + current.alloced_umd);
+}
+
+uint64_t ModelMemory::footprint_bytes() const {
+    return npu_bytes() + input_bytes + output_bytes + blob_bytes;
+}
+
+static double mb(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+std::string ModelMemory::to_text(uint64_t budget_bytes) const {
+    std::string out;
+    char line[256];
+    snprintf(line, sizeof(line), "memory [%s]\n", model.c_str());
+    out += line;
+    if (current.valid) {
+        snprintf(line, sizeof(line), "  npu context   %9.2f MB (load %.2f MB), axi sram %d KB, %d layers\n",
+                 mb(current.model_bytes), mb(load.model_bytes), current.axi_sram_bytes / 1024, current.layers);
+        out += line;
+        snprintf(line, sizeof(line), "  npu alloced   %9.2f MB base, %.2f MB umd\n",
+                 mb(current.alloced_base), mb(current.alloced_umd));
+        out += line;
+        if (current.pool_size < 0) {
+            snprintf(line, sizeof(line), "  npu pool      %9.2f MB used, peak %.2f MB, system limit\n",
+                     mb(current.pool_used), mb(peak_pool_used));
+        } else {
+            snprintf(line, sizeof(line), "  npu pool      %9.2f MB used, peak %.2f MB of %.2f MB\n",
+                     mb(current.pool_used), mb(peak_pool_used), mb(current.pool_size));
+        }
+        out += line;
+        if (current.device_bytes > 0) {
+            snprintf(line, sizeof(line), "  npu device    %9.2f MB, axi sram %d KB, %.1f TOPS\n",
+                     mb(current.device_bytes), current.device_axi_sram_bytes / 1024, current.tops);
+            out += line;
+        }
+    } else {
+        out += "  npu           no memory info from the driver\n";
+    }
+    snprintf(line, sizeof(line), "  dma buffers   %9.2f MB inputs, %.2f MB outputs\n", mb(input_bytes), mb(output_bytes));
+    out += line;
+    snprintf(line, sizeof(line), "  model mapping %9.2f MB\n", mb(blob_bytes));
+    out += line;
+    uint64_t host_peak = 0;
+    for (const auto& s : HostMemory::instance().stages()) {
+        snprintf(line, sizeof(line), "  host %-8s %9.2f MB peak, %.2f MB held, %llu buffers\n", s.stage.c_str(),
+                 mb(s.peak_bytes), mb(s.current_bytes), (unsigned long long)s.buffers);
+        out += line;
+        host_peak += s.peak_bytes;
+    }
+    snprintf(line, sizeof(line), "  process       %9.2f MB rss, peak %.2f MB\n", mb(process.rss_bytes), mb(process.peak_rss_bytes));
+    out += line;
+
+    uint64_t budget = budget_bytes ? budget_bytes : process.total_bytes;
+    uint64_t per_model = footprint_bytes() + host_peak;
+    snprintf(line, sizeof(line), "  footprint     %9.2f MB npu + dma + mapping, %.2f MB with host peaks\n",
+             mb(footprint_bytes()), mb(per_model));
+    out += line;
+    if (budget && per_model) {
+        snprintf(line, sizeof(line), "  fits          %9llu x in %.0f MB\n",
+                 (unsigned long long)(budget / per_model), mb(budget));
+        out += line;
+    }
+    return out;
+}
+
+std::string ModelMemory::to_json() const {
+    std::string out = "{\n  \"model\": \"" + json_escape(model) + "\",\n";
+    char line[512];
+    snprintf(line, sizeof(line),
+             "  \"queries\": %llu,\n"
+             "  \"npu\": {\"model_bytes\": %lld, \"load_model_bytes\": %lld, \"axi_sram_bytes\": %d, \"layers\": %d, "
+             "\"macc\": %lld, \"alloced_base\": %llu, \"alloced_umd\": %llu, \"pool_size\": %lld, \"pool_used\": %llu, "
+             "\"peak_pool_used\": %llu},\n",
+             (unsigned long long)queries, (long long)current.model_bytes, (long long)load.model_bytes,
+             current.axi_sram_bytes, current.layers, (long long)current.macc,
+             (unsigned long long)current.alloced_base, (unsigned long long)current.alloced_umd,
+             (long long)current.pool_size, (unsigned long long)current.pool_used, (unsigned long long)peak_pool_used);
+    out += line;
+    snprintf(line, sizeof(line),
+             "  \"device\": {\"memory_bytes\": %lld, \"axi_sram_bytes\": %d, \"tops\": %.2f},\n"
+             "  \"dma\": {\"input_bytes\": %llu, \"output_bytes\": %llu},\n"
+             "  \"blob_bytes\": %llu,\n  \"footprint_bytes\": %llu,\n"
+             "  \"process\": {\"rss_bytes\": %llu, \"peak_rss_bytes\": %llu, \"total_bytes\": %llu, \"available_bytes\": %llu},\n"
+             "  \"host\": {",
+             (long long)current.device_bytes, current.device_axi_sram_bytes, current.tops,
+             (unsigned long long)input_bytes, (unsigned long long)output_bytes,
+             (unsigned long long)blob_bytes, (unsigned long long)footprint_bytes(),
+             (unsigned long long)process.rss_bytes, (unsigned long long)process.peak_rss_bytes,
+             (unsigned long long)process.total_bytes, (unsigned long long)process.available_bytes);
+    out += line;
+    std::vector<HostStageMemory> stages = HostMemory::instance().stages();
+    for (size_t i = 0; i < stages.size(); ++i) {
+        out += std::string(i ? "," : "") + "\n    \"" + json_escape(stages[i].stage) + "\": ";
+        snprintf(line, sizeof(line), "{\"peak_bytes\": %llu, \"current_bytes\": %llu, \"buffers\": %llu}",
+                 (unsigned long long)stages[i].peak_bytes,
+                 (unsigned long long)stages[i].current_bytes, (unsigned long long)stages[i].buffers);
+        out += line;
+    }
+    out += stages.empty() ? "}\n}\n" : "\n  }\n}\n";
+    return out;
+}
+
+int ModelMemory::write(const char* path) const {
+    size_t len = strlen(path);
+    bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    std::string text = json ? to_json() : to_text();
+
+    FILE* fp = fopen(path, "w");
+    if (NULL == fp) {
+        LOGE("Failed to open memory report %s", path);
+        return -1;
+    }
+    size_t written = fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+    if (written != text.size()) {
+        LOGE("Failed to write memory report %s", path);
+        return -1;
+    }
+    return 0;
+}
+
+ModelMemory context_memory(void* context, const std::string& model) {
+    ModelMemory memory;
+    memory.model = model;
+    NpuMemory npu;
+    if (query_npu_memory(context, AML_PROFILE_NONE, &npu) == 0) {
+        memory.update(npu);
+    }
+    memory.process = process_memory();
+    return memory;
+}
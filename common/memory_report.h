@@ -0,0 +1,128 @@
+#ifndef _AMLNN_MEMORY_REPORT_H_
+#define _AMLNN_MEMORY_REPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "nn_sdk.h"
+
+// NPU-side memory of one context: aml_context_info_t and the memory
+// fields of aml_profiling_ext_data_t.
+struct NpuMemory {
+    bool valid = false;
+    int64_t model_bytes = 0;            // ctx_info.memory_size
+    int32_t axi_sram_bytes = 0;         // ctx_info.axi_sram_size
+    int32_t layers = 0;
+    int64_t macc = 0;
+    int64_t device_bytes = 0;           // dev_info.memory_size
+    int32_t device_axi_sram_bytes = 0;
+    float tops = 0;
+    uint64_t alloced_base = 0;          // ext.mem_alloced_base
+    uint64_t alloced_umd = 0;           // ext.mem_alloced_umd
+    int64_t pool_size = 0;              // ext.mem_pool_size, -1: system limit
+    uint64_t pool_used = 0;             // ext.mem_pool_used
+};
+
+// Queries `context` through aml_util_getProfileInfo. `active` is the
+// profile type the context already has enabled; with AML_PROFILE_NONE,
+// AML_PROFILE_MEMORY is enabled for the query and disabled again.
+int query_npu_memory(void* context, aml_profile_type_t active, NpuMemory* mem);
+// Copies the memory fields of a profile taken for another purpose.
+void read_npu_memory(const aml_profile_config_t& profile, NpuMemory* mem);
+
+// Resident set of the process (/proc/self/status) and of the board
+// (/proc/meminfo). Zero where the file is missing.
+struct ProcessMemory {
+    uint64_t rss_bytes = 0;             // VmRSS
+    uint64_t peak_rss_bytes = 0;        // VmHWM
+    uint64_t total_bytes = 0;           // MemTotal
+    uint64_t available_bytes = 0;       // MemAvailable
+};
+
+ProcessMemory process_memory();
+
+struct HostStageMemory {
+    std::string stage;
+    uint64_t current_bytes = 0;
+    uint64_t peak_bytes = 0;
+    uint64_t buffers = 0;               // HostBytes ever counted
+};
+
+// Process-wide ledger of the large host buffers each pipeline stage holds
+// ("pre", "post", ...), as declared by the code that owns them through
+// HostBytes. Tracks the current and peak sum per stage; allocations made
+// without a HostBytes are only visible in ProcessMemory.
+class HostMemory {
+public:
+    static HostMemory& instance();
+
+    // Negative `bytes` releases; `new_buffer` counts one more buffer.
+    void add(const std::string& stage, int64_t bytes, bool new_buffer = false);
+    std::vector<HostStageMemory> stages() const;
+    // Sum of the per-stage peaks, an upper bound of what they held at once.
+    uint64_t peak_bytes() const;
+
+private:
+    HostMemory() = default;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, HostStageMemory> stages_;
+};
+
+// Counts `bytes` to a stage of HostMemory while in scope, e.g. next to a
+// vector whose size is known: HostBytes held("pre", v.size() * sizeof(float)).
+class HostBytes {
+public:
+    explicit HostBytes(const char* stage, size_t bytes = 0);
+    ~HostBytes();
+
+    HostBytes(const HostBytes&) = delete;
+    HostBytes& operator=(const HostBytes&) = delete;
+
+    // Replaces the counted size, for buffers that grow.
+    void set(size_t bytes);
+
+private:
+    const char* stage_;
+    size_t bytes_ = 0;
+};
+
+// Memory report of one model: what the NPU driver holds for its context,
+// the DMA buffers allocated next to it and the model file mapping, with
+// the process and host stage figures at the time of the last query.
+struct ModelMemory {
+    std::string model;
+    NpuMemory load;                     // right after the context was created
+    NpuMemory current;                  // last query
+    uint64_t peak_pool_used = 0;
+    uint64_t queries = 0;
+    uint64_t blob_bytes = 0;            // mapped model file, shared per model
+    uint64_t input_bytes = 0;           // DMA input buffers
+    uint64_t output_bytes = 0;          // output ring buffers
+    ProcessMemory process;
+
+    void update(const NpuMemory& mem);
+
+    // Largest of the context size, the driver's allocations and the peak
+    // pool use.
+    uint64_t npu_bytes() const;
+    // npu_bytes() plus the DMA buffers and the model mapping. An upper
+    // bound where the driver takes the DMA buffers from its pool.
+    uint64_t footprint_bytes() const;
+
+    // Readable report. `budget_bytes` (0: MemTotal) sets the board size
+    // the "fits" line divides by the footprint and host peaks.
+    std::string to_text(uint64_t budget_bytes = 0) const;
+    std::string to_json() const;
+    // Writes JSON when `path` ends in ".json", text otherwise.
+    int write(const char* path) const;
+};
+
+// One-shot report of a bare context, for code that does not use
+// ModelSession.
+ModelMemory context_memory(void* context, const std::string& model);
+
+#endif
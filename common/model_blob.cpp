@@ -0,0 +1,76 @@
+#include "model_blob.h"
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static std::mutex g_blobs_mutex;
+static std::map<std::string, std::weak_ptr<ModelBlob>> g_blobs;
+
+std::shared_ptr<ModelBlob> ModelBlob::open(const char* path) {
+    auto start = std::chrono::steady_clock::now();
+
+    char resolved[PATH_MAX];
+    std::string key = realpath(path, resolved) ? resolved : path;
+
+    // Declared before the lock so a stale blob is released after it: when
+    // this is the last reference, ~ModelBlob takes g_blobs_mutex itself
+    std::shared_ptr<ModelBlob> cached;
+    std::lock_guard<std::mutex> lock(g_blobs_mutex);
+    int fd = ::open(key.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("ModelBlob: cannot open %s", path);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size <= 0) {
+        LOGE("ModelBlob: cannot stat %s", path);
+        close(fd);
+        return nullptr;
+    }
+    cached = g_blobs[key].lock();
+    if (cached && cached->st_.st_dev == st.st_dev && cached->st_.st_ino == st.st_ino && cached->st_.st_size == st.st_size &&
+        cached->st_.st_mtim.tv_sec == st.st_mtim.tv_sec && cached->st_.st_mtim.tv_nsec == st.st_mtim.tv_nsec) {
+        close(fd);
+        return cached;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LOGE("ModelBlob: mmap fail for %s", path);
+        return nullptr;
+    }
+    // aml_module_create reads the whole model; start the readahead now
+    madvise(data, st.st_size, MADV_WILLNEED);
+
+    std::shared_ptr<ModelBlob> blob(new ModelBlob());
+    blob->path_ = key;
+    blob->st_ = st;
+    blob->data_ = data;
+    blob->size_ = st.st_size;
+    blob->map_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    g_blobs[key] = blob;
+    return blob;
+}
+
+ModelBlob::~ModelBlob() {
+    if (data_) {
+        munmap(data_, size_);
+    }
+    std::lock_guard<std::mutex> lock(g_blobs_mutex);
+    // The entry belongs to a newer version of the file when that one is
+    // still mapped
+    auto it = g_blobs.find(path_);
+    if (it != g_blobs.end() && it->second.expired()) {
+        g_blobs.erase(it);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef _AMLNN_MODEL_BLOB_H_
+#define _AMLNN_MODEL_BLOB_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+
+// Read-only mmap of a .adla file. open() returns the existing mapping when
+// the same file is already open in the process, so every context of a model
+// (pool members, hot-swapped versions, encoder / decoder pairs) is created
+// from one copy in the page cache instead of each aml_module_create reading
+// the file again. A file replaced since it was mapped (another inode, size
+// or mtime) is mapped anew, while contexts of the old version keep the old
+// mapping. The mapping is released with the last reference.
+// Replace a mapped model with a rename only. The mapping is MAP_SHARED and
+// contexts created from it (NN_ADLA_MEMORY) need it unchanged for their
+// lifetime; writing into the file in place (cp over it) changes the data
+// under them, and truncating it makes their reads fault (SIGBUS).
+class ModelBlob {
+public:
+    static std::shared_ptr<ModelBlob> open(const char* path);
+    ~ModelBlob();
+
+    ModelBlob(const ModelBlob&) = delete;
+    ModelBlob& operator=(const ModelBlob&) = delete;
+
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+    // Time spent opening and mapping the file.
+    double map_ms() const { return map_ms_; }
+
+private:
+    ModelBlob() = default;
+
+    std::string path_;
+    struct stat st_;                    // identity of the mapped file
+    void* data_ = nullptr;
+    size_t size_ = 0;
+    double map_ms_ = 0;
+};
+
+#endif
@@ -0,0 +1,121 @@
+// -------------------------------------------------------------------------
+// Exposed Functions
+// -------------------------------------------------------------------------
+
+#include "model_context.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+int set_perlayer_profile(aml_profile_type_t type, const char* save_path) {
+    if (NULL == save_path || '\0' == save_path[0]) {
+        LOGE("set_perlayer_profile: no save path.");
+        return -1;
+    }
+    if (mkdir(save_path, 0755) && errno != EEXIST) {
+        LOGE("set_perlayer_profile: cannot create %s: %s", save_path, strerror(errno));
+        return -1;
+    }
+    if (aml_util_setProfile(type, save_path)) {
+        LOGE("aml_util_setProfile(%d, %s) fail.", (int)type, save_path);
+        return -1;
+    }
+    return 0;
+}
+
+void perlayer_profile_from_env() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        const char* env = getenv("AMLNN_PERLAYER");
+        if (NULL == env || '\0' == env[0]) {
+            return;
+        }
+        std::string mode(env);
+        std::string dir = "./perlayer_profile";
+        size_t colon = mode.find(':');
+        if (colon != std::string::npos) {
+            dir = mode.substr(colon + 1);
+            mode = mode.substr(0, colon);
+        }
+        aml_profile_type_t type;
+        if (mode == "runtime") {
+            type = AML_PERLAYER_RUNTIME;
+        } else if (mode == "bandwidth") {
+            type = AML_PERLAYER_BANDWIDTH;
+        } else {
+            LOGE("AMLNN_PERLAYER: expected runtime or bandwidth, got %s", mode.c_str());
+            return;
+        }
+        if (set_perlayer_profile(type, dir.c_str()) == 0) {
+            LOGE("per-layer %s profile of every context written to %s", mode.c_str(), dir.c_str());
+        }
+    });
+}
+
+static void* create_context(aml_config& config, const char* label, int core, const SoftopProfile* softop,
+                            int timeout_ms) {
+    void* qcontext = NULL;
+    perlayer_profile_from_env();
+    config.modelType = ADLA_LOADABLE;
+    config.typeSize = sizeof(aml_config);
+    if (core >= 0) {
+        config.forward_ctrl.enCoreId = (aml_encore_id)core;
+    }
+    if (timeout_ms > 0) {
+        config.timeout_ms = timeout_ms;
+        config.forward_ctrl.timeout_ms = timeout_ms;
+    }
+
+    /* CPU fallback ops: OpenMP / NEON settings from the model's softop
+       profile, or 2 OpenMP threads and NEON for all ops by default */
+    SoftopOptions softop_opts(softop ? *softop : SoftopProfile());
+    softop_opts.apply(&config.forward_ctrl.softop_info);
+
+    qcontext = aml_module_create(&config);
+    if (NULL == qcontext) {
+        LOGE("aml_module_create fail for %s", label);
+        return NULL;
+    }
+    return qcontext;
+}
+
+void* init_network(const char* model_path, int core, const SoftopProfile* softop, int timeout_ms) {
+    SoftopProfile profile;
+    if (NULL == softop && load_softop_profile(softop_profile_path(model_path).c_str(), &profile) == 0) {
+        softop = &profile;
+    }
+
+    aml_config config;
+    memset(&config, 0, sizeof(aml_config));
+    config.nbgType = NN_ADLA_FILE;
+    config.path = model_path;
+    return create_context(config, model_path, core, softop, timeout_ms);
+}
+
+void* init_network_memory(const void* data, size_t size, int core, const SoftopProfile* softop, int timeout_ms) {
+    if (NULL == data || size == 0 || size > 0x7fffffff) {
+        LOGE("init_network_memory: invalid model buffer (%zu bytes).", size);
+        return NULL;
+    }
+    aml_config config;
+    memset(&config, 0, sizeof(aml_config));
+    config.nbgType = NN_ADLA_MEMORY;
+    config.pdata = (const char*)data;
+    config.length = (int)size;
+    return create_context(config, "in-memory model", core, softop, timeout_ms);
+}
+
+int uninit_network(void* qcontext) {
+    int ret = aml_module_destroy(qcontext);
+    if (ret) {
+        LOGE("aml_module_destroy fail.");
+        return -1;
+    }   
+    return ret;
+}
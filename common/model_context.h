@@ -0,0 +1,33 @@
+#ifndef _AMLNN_MODEL_CONTEXT_H_
+#define _AMLNN_MODEL_CONTEXT_H_
+
+#include <cstddef>
+#include "nn_sdk.h"
+#include "softop_profile.h"
+
+// Context creation is kept free of OpenCV so that the audio / hybrid
+// examples (whisper, clip) can share it with the vision models.
+// `core` >= 0 selects the NPU core (forward_ctrl.enCoreId) the context runs
+// on; -1 leaves the SDK default. `softop` overrides the CPU fallback
+// settings; when NULL, "<model_path>.softop" is used if present.
+// `timeout_ms` > 0 bounds every invoke of the context (aml_config.timeout_ms
+// and forward_ctrl.timeout_ms); 0 leaves the SDK default.
+void* init_network(const char* model_path, int core = -1, const SoftopProfile* softop = NULL, int timeout_ms = 0);
+// Creates the context from a model already in memory (NN_ADLA_MEMORY), e.g.
+// a ModelBlob mapping. `data` must stay valid for the context's lifetime.
+// NULL `softop` means the default settings.
+void* init_network_memory(const void* data, size_t size, int core = -1, const SoftopProfile* softop = NULL,
+                          int timeout_ms = 0);
+int uninit_network(void* qcontext);
+
+// Per-layer profiling of the contexts created afterwards, through
+// aml_util_setProfile: AML_PERLAYER_RUNTIME or AML_PERLAYER_BANDWIDTH. The
+// SDK writes its dumps under `save_path` (created if missing), which
+// tools/layer_profiler reads.
+int set_perlayer_profile(aml_profile_type_t type, const char* save_path);
+// AMLNN_PERLAYER=runtime|bandwidth[:<dir>] (default dir ./perlayer_profile)
+// applies set_perlayer_profile once per process. init_network and
+// init_network_memory call it before creating a context.
+void perlayer_profile_from_env();
+
+#endif
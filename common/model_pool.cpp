@@ -0,0 +1,412 @@
+#include "model_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static constexpr size_t kLatencyWindow = 1024;
+
+struct ModelPool::Request {
+    PoolRequest request;
+    std::chrono::steady_clock::time_point submitted;
+    std::chrono::steady_clock::time_point deadline;
+    bool has_deadline = false;
+    std::chrono::steady_clock::time_point hedge_at;
+    std::atomic<bool> finished{false};
+    std::atomic<int> attempts{0};       // queued so far
+    std::atomic<int> outstanding{0};    // queued and not yet returned
+
+    bool expired() const { return has_deadline && std::chrono::steady_clock::now() >= deadline; }
+    // Number of the next attempt, or -1 once `max` have been queued. The
+    // retry path and the hedger claim attempts concurrently.
+    int claim_attempt(int max) {
+        int n = attempts.load();
+        while (n < max) {
+            if (attempts.compare_exchange_weak(n, n + 1)) {
+                return n;
+            }
+        }
+        return -1;
+    }
+};
+
+std::unique_ptr<ModelPool> ModelPool::create(const char* model_path, const PoolConfig& config) {
+    if (config.num_contexts < 1 || config.queue_capacity < 1) {
+        LOGE("ModelPool needs at least one context and a non-empty queue.");
+        return nullptr;
+    }
+
+    std::vector<std::unique_ptr<ModelSession>> sessions;
+    for (int i = 0; i < config.num_contexts; ++i) {
+        std::unique_ptr<ModelSession> session = ModelSession::create(model_path, config.session);
+        if (!session) {
+            LOGE("ModelPool: failed to create context %d of %d for %s", i, config.num_contexts, model_path);
+            return nullptr;
+        }
+        sessions.push_back(std::move(session));
+    }
+    return std::unique_ptr<ModelPool>(new ModelPool(std::move(sessions), model_path, config));
+}
+
+ModelPool::ModelPool(std::vector<std::unique_ptr<ModelSession>> sessions, const std::string& model_path,
+                     const PoolConfig& config)
+    : sessions_(std::move(sessions)), model_path_(model_path), config_(config), queue_(config.queue_capacity),
+      cpu_stage_(config.cpu_stage), created_ns_(now_ns()) {
+    size_t n = sessions_.size();
+    free_next_.reset(new std::atomic<uint32_t>[n]);
+    busy_ns_.reset(new std::atomic<uint64_t>[n]);
+    jobs_.reset(new std::atomic<uint64_t>[n]);
+    for (size_t i = 0; i < n; ++i) {
+        free_next_[i].store(0);
+        busy_ns_[i].store(0);
+        jobs_[i].store(0);
+        release((int)i);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        workers_.emplace_back(&ModelPool::worker_loop, this);
+    }
+    if (config_.recreate_on_timeout) {
+        recreator_ = std::thread(&ModelPool::recreate_loop, this);
+    }
+    if (config_.hedge_after_ms > 0) {
+        hedger_ = std::thread(&ModelPool::hedge_loop, this);
+    }
+}
+
+ModelPool::~ModelPool() {
+    stopping_.store(true);
+    // No hedges once draining: every queued attempt still runs, so each
+    // request's `done` is called
+    hedge_cv_.notify_all();
+    if (hedger_.joinable()) {
+        hedger_.join();
+    }
+    wake_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    // Kept until the workers are done: they may wait for a context that
+    // is being recreated
+    {
+        std::lock_guard<std::mutex> lock(recreate_mutex_);
+        recreate_stop_ = true;
+    }
+    recreate_cv_.notify_all();
+    if (recreator_.joinable()) {
+        recreator_.join();
+    }
+}
+
+int ModelPool::acquire() {
+    uint64_t head = free_head_.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t slot = (uint32_t)head;
+        if (slot == 0) {
+            return -1;
+        }
+        uint32_t next = free_next_[slot - 1].load(std::memory_order_relaxed);
+        uint64_t desired = ((head >> 32) + 1) << 32 | next;
+        if (free_head_.compare_exchange_weak(head, desired, std::memory_order_acq_rel, std::memory_order_acquire)) {
+            return (int)slot - 1;
+        }
+    }
+}
+
+void ModelPool::release(int context_index) {
+    uint64_t head = free_head_.load(std::memory_order_relaxed);
+    for (;;) {
+        free_next_[context_index].store((uint32_t)head, std::memory_order_relaxed);
+        uint64_t desired = ((head >> 32) + 1) << 32 | (uint32_t)(context_index + 1);
+        if (free_head_.compare_exchange_weak(head, desired, std::memory_order_release, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    // Taking the mutex orders the push before a worker's check in
+    // wait_for_context(), so the notify is not lost
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+    }
+    free_cv_.notify_one();
+}
+
+int ModelPool::wait_for_context() {
+    int context_index = acquire();
+    if (context_index < 0) {
+        std::unique_lock<std::mutex> lock(free_mutex_);
+        free_cv_.wait(lock, [&] { return (context_index = acquire()) >= 0; });
+    }
+    return context_index;
+}
+
+bool ModelPool::try_submit(PoolJob job) {
+    if (!queue_.try_push(std::move(job))) {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    wake_cv_.notify_one();
+    return true;
+}
+
+void ModelPool::submit(PoolJob job) {
+    while (!queue_.try_push(std::move(job))) {
+        std::this_thread::yield();
+    }
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    wake_cv_.notify_one();
+}
+
+bool ModelPool::submit_request(PoolRequest request) {
+    std::shared_ptr<Request> r = std::make_shared<Request>();
+    r->submitted = std::chrono::steady_clock::now();
+    int deadline_ms = request.deadline_ms < 0 ? config_.deadline_ms : request.deadline_ms;
+    if (deadline_ms > 0) {
+        r->has_deadline = true;
+        r->deadline = r->submitted + std::chrono::milliseconds(deadline_ms);
+    }
+    r->hedge_at = r->submitted + std::chrono::milliseconds(config_.hedge_after_ms);
+    r->request = std::move(request);
+    r->attempts.store(1);
+    r->outstanding.store(1);
+    if (!try_submit(attempt_job(r, 0))) {
+        return false;
+    }
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    if (config_.hedge_after_ms > 0 && config_.max_attempts > 1) {
+        std::lock_guard<std::mutex> lock(hedge_mutex_);
+        hedge_waiting_.push_back(r);
+        hedge_cv_.notify_one();
+    }
+    return true;
+}
+
+PoolJob ModelPool::attempt_job(const std::shared_ptr<Request>& request, int attempt) {
+    return [this, request, attempt](ModelSession& session, int context_index) {
+        run_attempt(request, attempt, session, context_index);
+    };
+}
+
+void ModelPool::run_attempt(const std::shared_ptr<Request>& request, int attempt, ModelSession& session,
+                            int context_index) {
+    Request& r = *request;
+    // A request already answered, or out of time while queued, does not
+    // take the NPU
+    if (!r.finished.load() && !r.expired()) {
+        if (r.has_deadline) {
+            session.set_deadline(r.deadline);
+        }
+        int status = r.request.run(session, context_index, attempt);
+        session.clear_deadline();
+        if (status == 0) {
+            finish(r, 0, attempt);
+        } else if (session.timed_out() && !r.finished.load() && !r.expired()) {
+            // Retried on whichever context is free next; this one goes to
+            // recreation when recreate_on_timeout is set
+            int retry = r.claim_attempt(config_.max_attempts);
+            if (retry >= 0) {
+                r.outstanding.fetch_add(1);
+                if (queue_.try_push(attempt_job(request, retry))) {
+                    retried_.fetch_add(1, std::memory_order_relaxed);
+                    submitted_.fetch_add(1, std::memory_order_relaxed);
+                    wake_cv_.notify_one();
+                } else {
+                    r.outstanding.fetch_sub(1);
+                }
+            }
+        }
+    }
+    if (r.outstanding.fetch_sub(1) == 1) {
+        finish(r, -1, attempt);
+    }
+}
+
+void ModelPool::finish(Request& r, int status, int attempt) {
+    if (r.finished.exchange(true)) {
+        return;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r.submitted).count();
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex_);
+        if (latency_ms_.size() < kLatencyWindow) {
+            latency_ms_.push_back(ms);
+        } else {
+            latency_ms_[latency_next_] = ms;
+        }
+        latency_next_ = (latency_next_ + 1) % kLatencyWindow;
+    }
+    if (status == 0) {
+        if (attempt > 0) rescued_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        if (r.expired()) deadline_missed_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (r.request.done) {
+        r.request.done(status, attempt);
+    }
+}
+
+void ModelPool::hedge_loop() {
+    std::unique_lock<std::mutex> lock(hedge_mutex_);
+    std::vector<std::shared_ptr<Request>> unqueued;
+    while (!stopping_.load()) {
+        auto now = std::chrono::steady_clock::now();
+        auto next = now + std::chrono::milliseconds(config_.hedge_after_ms);
+        for (size_t i = 0; i < hedge_waiting_.size();) {
+            std::shared_ptr<Request>& r = hedge_waiting_[i];
+            if (!r->finished.load() && r->hedge_at > now) {
+                next = std::min(next, r->hedge_at);
+                ++i;
+                continue;
+            }
+            // Due, or answered already: hedged at most once, and only while
+            // the first attempt is still out
+            int hedge = -1;
+            if (!r->finished.load() && !r->expired() && (hedge = r->claim_attempt(config_.max_attempts)) >= 0) {
+                r->outstanding.fetch_add(1);
+                if (queue_.try_push(attempt_job(r, hedge))) {
+                    hedged_.fetch_add(1, std::memory_order_relaxed);
+                    submitted_.fetch_add(1, std::memory_order_relaxed);
+                    wake_cv_.notify_one();
+                } else if (r->outstanding.fetch_sub(1) == 1) {
+                    unqueued.push_back(r);
+                }
+            }
+            r = hedge_waiting_.back();
+            hedge_waiting_.pop_back();
+        }
+        if (!unqueued.empty()) {
+            // `done` may submit again, which takes hedge_mutex_
+            lock.unlock();
+            for (auto& r : unqueued) finish(*r, -1, 0);
+            unqueued.clear();
+            lock.lock();
+            continue;
+        }
+        hedge_cv_.wait_until(lock, next);
+    }
+}
+
+void ModelPool::recreate(int context_index) {
+    {
+        std::lock_guard<std::mutex> lock(recreate_mutex_);
+        recreate_pending_.push_back(context_index);
+    }
+    recreate_cv_.notify_one();
+}
+
+void ModelPool::recreate_loop() {
+    std::unique_lock<std::mutex> lock(recreate_mutex_);
+    for (;;) {
+        recreate_cv_.wait(lock, [this] { return recreate_stop_ || !recreate_pending_.empty(); });
+        if (recreate_pending_.empty()) {
+            return;
+        }
+        int c = recreate_pending_.back();
+        recreate_pending_.pop_back();
+        lock.unlock();
+        // The replacement is created before the stuck context is destroyed,
+        // so a failed create leaves the pool at its size
+        std::unique_ptr<ModelSession> fresh = ModelSession::create(model_path_.c_str(), config_.session);
+        if (fresh) {
+            std::unique_ptr<ModelSession> stale;
+            {
+                std::lock_guard<std::mutex> sessions_lock(sessions_mutex_);
+                stale = std::move(sessions_[c]);
+                sessions_[c] = std::move(fresh);
+            }
+            stale.reset();
+            recreated_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            LOGE("ModelPool: recreating context %d of %s failed, keeping the old one.", c, model_path_.c_str());
+        }
+        release(c);
+        lock.lock();
+    }
+}
+
+bool ModelPool::run_job(PoolJob& job, int context_index) {
+    ModelSession& session = *sessions_[context_index];
+    uint64_t timeouts = session.timeouts();
+    uint64_t start = now_ns();
+    job(session, context_index);
+    busy_ns_[context_index].fetch_add(now_ns() - start, std::memory_order_relaxed);
+    jobs_[context_index].fetch_add(1, std::memory_order_relaxed);
+    if (session.timeouts() == timeouts) {
+        return true;
+    }
+    timeouts_.fetch_add(session.timeouts() - timeouts, std::memory_order_relaxed);
+    if (!config_.recreate_on_timeout) {
+        return true;
+    }
+    recreate(context_index);
+    return false;
+}
+
+void ModelPool::worker_loop() {
+    ThreadPlacement::instance().pin(cpu_stage_);
+    PoolJob job;
+    for (;;) {
+        if (!queue_.try_pop(job)) {
+            if (stopping_.load()) {
+                return;
+            }
+            // The lock only parks idle workers; the queue itself is lock-free.
+            // The timeout covers a notify racing with the wait.
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            wake_cv_.wait_for(lock, std::chrono::milliseconds(1));
+            continue;
+        }
+
+        int context_index = wait_for_context();
+        if (run_job(job, context_index)) {
+            release(context_index);
+        }
+        job = nullptr;
+        completed_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+PoolStats ModelPool::stats() const {
+    PoolStats stats;
+    stats.queue_depth = queue_.size();
+    stats.queue_capacity = queue_.capacity();
+    stats.submitted = submitted_.load(std::memory_order_relaxed);
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+    stats.retried = retried_.load(std::memory_order_relaxed);
+    stats.hedged = hedged_.load(std::memory_order_relaxed);
+    stats.rescued = rescued_.load(std::memory_order_relaxed);
+    stats.recreated = recreated_.load(std::memory_order_relaxed);
+    stats.failed = failed_.load(std::memory_order_relaxed);
+    stats.deadline_missed = deadline_missed_.load(std::memory_order_relaxed);
+    std::vector<double> latency;
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex_);
+        latency = latency_ms_;
+    }
+    if (!latency.empty()) {
+        std::sort(latency.begin(), latency.end());
+        auto at = [&](double q) { return latency[std::min(latency.size() - 1, (size_t)(q * latency.size()))]; };
+        stats.latency_p50_ms = at(0.5);
+        stats.latency_p99_ms = at(0.99);
+        stats.latency_p999_ms = at(0.999);
+    }
+
+    double elapsed = (double)(now_ns() - created_ns_);
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    for (size_t i = 0; i < sessions_.size(); ++i) {
+        stats.jobs.push_back(jobs_[i].load(std::memory_order_relaxed));
+        stats.utilization.push_back(elapsed > 0 ? busy_ns_[i].load(std::memory_order_relaxed) / elapsed : 0.0);
+        stats.cores.push_back(sessions_[i]->core());
+    }
+    return stats;
+}
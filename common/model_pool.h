@@ -0,0 +1,175 @@
+#ifndef _AMLNN_MODEL_POOL_H_
+#define _AMLNN_MODEL_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "model_session.h"
+#include "mpmc_queue.h"
+
+struct PoolConfig {
+    int num_contexts = 2;
+    size_t queue_capacity = 64;
+    SessionConfig session;
+    // ThreadPlacement stage the worker threads are pinned to; empty: none.
+    std::string cpu_stage;
+    // Default deadline of submit_request() requests in ms; 0: none. Set
+    // session.timeout_ms as well so a single stuck invoke cannot use it all.
+    int deadline_ms = 0;
+    // A request not finished this many ms after it was queued is issued a
+    // second time on another context (a hedged request) and the first
+    // result wins. 0: no hedging.
+    int hedge_after_ms = 0;
+    // Attempts per request, counting hedges and retries after a timeout.
+    int max_attempts = 2;
+    // A context whose invoke timed out is taken out of rotation and
+    // replaced by a new one created in the background.
+    bool recreate_on_timeout = true;
+};
+
+// Runs on whichever context is free. `context_index` identifies it in PoolStats.
+typedef std::function<void(ModelSession& session, int context_index)> PoolJob;
+
+// A request that may run more than once: `run` returns 0 on success and
+// is called again, on another context, after a timeout or as a hedge, so
+// it must not consume its input. `done` is called exactly once, with the
+// first successful attempt's status and number (0-based) or with -1 when
+// every attempt failed or the deadline passed. Attempts that lose the
+// race still run to completion, but their `run` can check `attempt` to
+// skip expensive postprocessing.
+struct PoolRequest {
+    std::function<int(ModelSession& session, int context_index, int attempt)> run;
+    std::function<void(int status, int attempt)> done;
+    // ms from submission; -1 takes PoolConfig::deadline_ms, 0: none.
+    int deadline_ms = -1;
+};
+
+struct PoolStats {
+    size_t queue_depth = 0;
+    size_t queue_capacity = 0;
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t rejected = 0;
+    std::vector<uint64_t> jobs;         // per context
+    std::vector<double> utilization;    // busy fraction per context since creation
+    std::vector<int> cores;             // NPU core per context, -1 for the SDK default
+    // submit_request() requests
+    uint64_t requests = 0;
+    uint64_t timeouts = 0;              // invokes that reached their timeout
+    uint64_t retried = 0;               // attempts queued after a timeout
+    uint64_t hedged = 0;                // attempts queued by hedge_after_ms
+    uint64_t rescued = 0;               // requests a hedge or retry finished
+    uint64_t recreated = 0;             // contexts replaced after a timeout
+    uint64_t failed = 0;                // requests done with -1, deadline included
+    uint64_t deadline_missed = 0;
+    // Latency of the last 1024 finished requests, submission to done
+    double latency_p50_ms = 0;
+    double latency_p99_ms = 0;
+    double latency_p999_ms = 0;
+};
+
+// N contexts of one model shared by many producer threads.
+// Contexts are handed out through a lock-free free-list; queued jobs are
+// taken from a bounded MPMC queue by one worker thread per context, so
+// aml_module_create is paid once per context and never per request.
+class ModelPool {
+public:
+    static std::unique_ptr<ModelPool> create(const char* model_path, const PoolConfig& config = PoolConfig());
+    // Runs every queued job, then joins the workers.
+    ~ModelPool();
+
+    ModelPool(const ModelPool&) = delete;
+    ModelPool& operator=(const ModelPool&) = delete;
+
+    // Queues `job`; returns false when the queue is full.
+    bool try_submit(PoolJob job);
+    // Queues `job`, yielding while the queue is full.
+    void submit(PoolJob job);
+    // Queues `request` with its deadline, timeout retries and hedging;
+    // returns false when the queue is full (`done` is not called then).
+    bool submit_request(PoolRequest request);
+
+    // Direct checkout for callers that drive a context themselves.
+    // Returns a context index, or -1 if every context is busy.
+    int acquire();
+    void release(int context_index);
+    // The context's session may be replaced after a timeout while it is
+    // not checked out; do not keep the reference across release().
+    ModelSession& session(int context_index) { return *sessions_[context_index]; }
+
+    int size() const { return (int)sessions_.size(); }
+    PoolStats stats() const;
+
+private:
+    struct Request;
+
+    ModelPool(std::vector<std::unique_ptr<ModelSession>> sessions, const std::string& model_path,
+              const PoolConfig& config);
+    void worker_loop();
+    // Blocks until a context is released, e.g. after recreation
+    int wait_for_context();
+    // False when the context was handed to recreate() instead of released
+    bool run_job(PoolJob& job, int context_index);
+    void recreate(int context_index);
+    PoolJob attempt_job(const std::shared_ptr<Request>& request, int attempt);
+    void run_attempt(const std::shared_ptr<Request>& request, int attempt, ModelSession& session, int context_index);
+    void finish(Request& request, int status, int attempt);
+    void hedge_loop();
+    void recreate_loop();
+
+    std::vector<std::unique_ptr<ModelSession>> sessions_;
+    mutable std::mutex sessions_mutex_;   // sessions_[i] swaps against stats()
+    std::string model_path_;
+    PoolConfig config_;
+
+    // Free-list: Treiber stack of context indices. The head packs an ABA
+    // tag in the upper 32 bits and index + 1 (0 = empty) in the lower 32.
+    std::atomic<uint64_t> free_head_{0};
+    std::unique_ptr<std::atomic<uint32_t>[]> free_next_;
+    std::mutex free_mutex_;   // parks workers while every context is out
+    std::condition_variable free_cv_;
+
+    MpmcQueue<PoolJob> queue_;
+    std::vector<std::thread> workers_;
+    std::string cpu_stage_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_cv_;
+    std::atomic<bool> stopping_{false};
+
+    std::thread recreator_;
+    std::mutex recreate_mutex_;
+    std::condition_variable recreate_cv_;
+    std::vector<int> recreate_pending_;
+    bool recreate_stop_ = false;
+    std::thread hedger_;
+    std::mutex hedge_mutex_;
+    std::condition_variable hedge_cv_;
+    std::vector<std::shared_ptr<Request>> hedge_waiting_;
+
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> completed_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::unique_ptr<std::atomic<uint64_t>[]> busy_ns_;
+    std::unique_ptr<std::atomic<uint64_t>[]> jobs_;
+    uint64_t created_ns_;
+
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> timeouts_{0};
+    std::atomic<uint64_t> retried_{0};
+    std::atomic<uint64_t> hedged_{0};
+    std::atomic<uint64_t> rescued_{0};
+    std::atomic<uint64_t> recreated_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> deadline_missed_{0};
+    mutable std::mutex latency_mutex_;
+    std::vector<double> latency_ms_;      // ring of the last 1024 requests
+    size_t latency_next_ = 0;
+};
+
+#endif
@@ -0,0 +1,208 @@
+#include "model_registry.h"
+#include <algorithm>
+#include <cstdio>
+#include <sys/stat.h>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static double mb(uint64_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+std::unique_ptr<ModelRegistry> ModelRegistry::create(const RegistryConfig& config) {
+    return std::unique_ptr<ModelRegistry>(new ModelRegistry(config));
+}
+
+int ModelRegistry::add(const std::string& name, const std::string& model_path, const SessionConfig* config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (entries_.count(name)) {
+        LOGE("ModelRegistry: %s is already registered.", name.c_str());
+        return -1;
+    }
+    Entry& e = entries_[name];
+    e.name = name;
+    e.path = model_path;
+    e.config = config ? *config : config_.session;
+    e.stats.name = name;
+    e.stats.path = model_path;
+    // Stand-in until the first load measures it; a loadable's size is
+    // close to its context size
+    struct stat st;
+    e.bytes = stat(model_path.c_str(), &st) == 0 ? (uint64_t)st.st_size : 0;
+    return 0;
+}
+
+uint64_t ModelRegistry::resident_bytes() const {
+    uint64_t bytes = 0;
+    for (const auto& it : entries_) {
+        if (it.second.session) bytes += it.second.bytes;
+    }
+    return bytes;
+}
+
+void ModelRegistry::evict_entry(Entry& e, std::vector<std::shared_ptr<ModelSession>>* destroyed) {
+    destroyed->push_back(std::move(e.session));
+    e.session.reset();
+    ++e.stats.evictions;
+    if (!config_.keep_mapping) {
+        e.blob.reset();
+    }
+}
+
+// Evicts idle models, least recently used first, until `bytes` more fit.
+// The sessions are handed back to be destroyed outside the lock.
+bool ModelRegistry::make_room(uint64_t bytes, const Entry* keep,
+                              std::vector<std::shared_ptr<ModelSession>>* destroyed) {
+    if (config_.budget_bytes == 0) {
+        return true;
+    }
+    // Nothing is evicted unless enough can be
+    uint64_t held = reserved_bytes_ + bytes;
+    for (const auto& it : entries_) {
+        const Entry& e = it.second;
+        if (e.session && (&e == keep || e.session.use_count() > 1)) held += e.bytes;
+    }
+    if (held > config_.budget_bytes) {
+        return false;
+    }
+    while (resident_bytes() + reserved_bytes_ + bytes > config_.budget_bytes) {
+        Entry* lru = nullptr;
+        for (auto& it : entries_) {
+            Entry& e = it.second;
+            // use_count 1: only the registry holds it, no request does
+            if (&e == keep || !e.session || e.session.use_count() > 1) continue;
+            if (!lru || e.last_used < lru->last_used) lru = &e;
+        }
+        if (!lru) {
+            return false;
+        }
+        evict_entry(*lru, destroyed);
+    }
+    return true;
+}
+
+std::shared_ptr<ModelSession> ModelRegistry::get(const std::string& name) {
+    std::vector<std::shared_ptr<ModelSession>> destroyed;
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = entries_.find(name);
+    if (it == entries_.end()) {
+        LOGE("ModelRegistry: unknown model %s", name.c_str());
+        return nullptr;
+    }
+    Entry& e = it->second;
+    // Another request is loading it: share that load
+    loaded_cv_.wait(lock, [&e] { return !e.loading; });
+    e.last_used = ++tick_;
+    if (e.session) {
+        ++e.stats.hits;
+        return e.session;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t need = e.bytes;
+    if (!make_room(need, &e, &destroyed)) {
+        ++rejected_;
+        LOGE("ModelRegistry: %s (%.2f MB) does not fit in the budget, %.2f MB held by models in use.", name.c_str(),
+             mb(need), mb(resident_bytes()));
+        return nullptr;
+    }
+    e.loading = true;
+    reserved_bytes_ += need;
+    std::string path = e.path;
+    SessionConfig config = e.config;
+    bool map = config.map_model && config_.keep_mapping && !e.blob;
+    lock.unlock();
+
+    // Contexts are destroyed before the new one is created, so the NPU
+    // never holds both
+    destroyed.clear();
+    std::shared_ptr<ModelBlob> blob;
+    if (map) {
+        std::string loadable = compiled_model_path(path.c_str(), config.compile);
+        if (!loadable.empty()) blob = ModelBlob::open(loadable.c_str());
+    }
+    std::shared_ptr<ModelSession> session = ModelSession::create(path.c_str(), config);
+    double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    lock.lock();
+    e.loading = false;
+    reserved_bytes_ -= need;
+    if (blob) {
+        e.blob = blob;
+    }
+    if (session) {
+        ModelMemory memory = session->memory();
+        uint64_t bytes = memory.footprint_bytes() - memory.blob_bytes;
+        if (bytes > 0) {
+            e.bytes = bytes;
+            e.measured = true;
+        }
+        e.session = session;
+        ++e.stats.misses;
+        e.stats.last_load_ms = load_ms;
+        e.total_load_ms += load_ms;
+        e.stats.mean_load_ms = e.total_load_ms / e.stats.misses;
+        e.stats.max_load_ms = std::max(e.stats.max_load_ms, load_ms);
+        // The measured size may exceed the estimate
+        if (!make_room(0, &e, &destroyed)) {
+            LOGE("ModelRegistry: over budget with %s loaded, %.2f of %.2f MB.", name.c_str(), mb(resident_bytes()),
+                 mb(config_.budget_bytes));
+        }
+        peak_bytes_ = std::max(peak_bytes_, resident_bytes());
+    }
+    lock.unlock();
+    loaded_cv_.notify_all();
+    return session;
+}
+
+int ModelRegistry::evict(const std::string& name) {
+    std::vector<std::shared_ptr<ModelSession>> destroyed;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(name);
+    if (it == entries_.end() || !it->second.session || it->second.session.use_count() > 1) {
+        return -1;
+    }
+    evict_entry(it->second, &destroyed);
+    return 0;
+}
+
+RegistryStats ModelRegistry::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    RegistryStats stats;
+    stats.budget_bytes = config_.budget_bytes;
+    stats.resident_bytes = resident_bytes();
+    stats.peak_resident_bytes = peak_bytes_;
+    stats.rejected = rejected_;
+    for (const auto& it : entries_) {
+        const Entry& e = it.second;
+        RegistryModelStats m = e.stats;
+        m.resident = e.session != nullptr;
+        m.in_use = e.session && e.session.use_count() > 1;
+        m.bytes = e.bytes;
+        stats.hits += m.hits;
+        stats.misses += m.misses;
+        stats.evictions += m.evictions;
+        stats.models.push_back(m);
+    }
+    return stats;
+}
+
+std::string ModelRegistry::report() const {
+    RegistryStats stats = this->stats();
+    std::string out;
+    char line[256];
+    for (const auto& m : stats.models) {
+        snprintf(line, sizeof(line), "%-24s %8.2f MB %-8s hits %6llu  misses %4llu  evictions %4llu  load %.1f ms (max %.1f)\n",
+                 m.name.c_str(), mb(m.bytes), m.resident ? (m.in_use ? "in use" : "resident") : "-",
+                 (unsigned long long)m.hits, (unsigned long long)m.misses, (unsigned long long)m.evictions,
+                 m.mean_load_ms, m.max_load_ms);
+        out += line;
+    }
+    uint64_t gets = stats.hits + stats.misses;
+    snprintf(line, sizeof(line), "resident %.2f MB (peak %.2f) of %.2f MB, hit rate %.1f%%, %llu evictions, %llu rejected\n",
+             mb(stats.resident_bytes), mb(stats.peak_resident_bytes), mb(stats.budget_bytes),
+             gets ? 100.0 * stats.hits / gets : 0.0, (unsigned long long)stats.evictions,
+             (unsigned long long)stats.rejected);
+    out += line;
+    return out;
+}
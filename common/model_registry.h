@@ -0,0 +1,112 @@
+#ifndef _AMLNN_MODEL_REGISTRY_H_
+#define _AMLNN_MODEL_REGISTRY_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "model_session.h"
+
+struct RegistryConfig {
+    // NPU-side bytes all resident models may take together: context
+    // memory (aml_context_info_t.ctx_info.memory_size, or the driver's
+    // allocations when larger) plus DMA input / output buffers. 0: no
+    // limit, models stay resident once loaded.
+    uint64_t budget_bytes = 0;
+    // Settings of models added without their own.
+    SessionConfig session;
+    // Keep the ModelBlob mapping of evicted models, so a reload creates
+    // the context from the page cache instead of reading the file. The
+    // mapping is host memory and not counted in the budget.
+    bool keep_mapping = true;
+};
+
+struct RegistryModelStats {
+    std::string name;
+    std::string path;
+    bool resident = false;
+    bool in_use = false;
+    uint64_t bytes = 0;                 // budget bytes, last measured
+    uint64_t hits = 0;                  // get() found it resident
+    uint64_t misses = 0;                // get() loaded it
+    uint64_t evictions = 0;
+    double last_load_ms = 0;            // miss to usable session
+    double mean_load_ms = 0;
+    double max_load_ms = 0;
+};
+
+struct RegistryStats {
+    uint64_t budget_bytes = 0;
+    uint64_t resident_bytes = 0;
+    uint64_t peak_resident_bytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t rejected = 0;              // get() that found no room
+    std::vector<RegistryModelStats> models;
+};
+
+// Many models of one process, loaded on demand within an NPU memory
+// budget. get() returns a resident model or loads it, first evicting the
+// least recently used models that no request holds until the new one
+// fits. A model's size is measured (ModelSession::memory()) the first
+// time it loads; before that, its file size stands in for it. As with
+// ModelSession, one thread at a time uses a model.
+class ModelRegistry {
+public:
+    static std::unique_ptr<ModelRegistry> create(const RegistryConfig& config = RegistryConfig());
+
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+    // Registers `name`; nothing is loaded until the first get(). NULL
+    // `config` takes RegistryConfig::session.
+    int add(const std::string& name, const std::string& model_path, const SessionConfig* config = nullptr);
+
+    // Resident session of `name`, loaded if needed. Hold it for one
+    // request: a model held by a request is never evicted. NULL for an
+    // unknown name, a failed load, or when the model does not fit even
+    // with every idle model evicted.
+    std::shared_ptr<ModelSession> get(const std::string& name);
+
+    // Evicts `name` now if it is idle.
+    int evict(const std::string& name);
+
+    RegistryStats stats() const;
+    // One line per model plus totals, for sizing the budget.
+    std::string report() const;
+
+private:
+    struct Entry {
+        std::string name;
+        std::string path;
+        SessionConfig config;
+        std::shared_ptr<ModelSession> session;
+        std::shared_ptr<ModelBlob> blob;   // kept across evictions with keep_mapping
+        bool loading = false;
+        uint64_t bytes = 0;
+        bool measured = false;
+        uint64_t last_used = 0;
+        RegistryModelStats stats;
+        double total_load_ms = 0;
+    };
+
+    explicit ModelRegistry(const RegistryConfig& config) : config_(config) {}
+    bool make_room(uint64_t bytes, const Entry* keep, std::vector<std::shared_ptr<ModelSession>>* destroyed);
+    void evict_entry(Entry& entry, std::vector<std::shared_ptr<ModelSession>>* destroyed);
+    uint64_t resident_bytes() const;
+
+    RegistryConfig config_;
+    mutable std::mutex mutex_;
+    std::condition_variable loaded_cv_;
+    std::map<std::string, Entry> entries_;
+    uint64_t tick_ = 0;
+    uint64_t reserved_bytes_ = 0;         // models being loaded
+    uint64_t peak_bytes_ = 0;
+    uint64_t rejected_ = 0;
+};
+
+#endif
@@ -0,0 +1,983 @@
+#include "model_session.h"
+#include "model_context.h"
+#include "tensor_dump.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static std::vector<TensorDesc> to_descs(const tensor_info* tinfo) {
+    std::vector<TensorDesc> descs;
+    if (NULL == tinfo || NULL == tinfo->info) {
+        return descs;
+    }
+    for (unsigned int i = 0; i < tinfo->num; ++i) {
+        const info_t& info = tinfo->info[i];
+        TensorDesc desc;
+        desc.index = i;
+        desc.name.assign(info.name, strnlen(info.name, MAX_NAME_LENGTH));
+        // info_t lists sizes innermost first (C, W, H, N for an NHWC tensor)
+        unsigned int dim_count = info.dim_count < MAX_TENSOR_NUM_DIMS ? info.dim_count : MAX_TENSOR_NUM_DIMS;
+        desc.elements = dim_count ? 1 : 0;
+        for (unsigned int d = dim_count; d > 0; --d) {
+            desc.dims.push_back(info.sizes_of_dim[d - 1]);
+            desc.elements *= info.sizes_of_dim[d - 1];
+        }
+        desc.format = (nn_buffer_format_e)info.data_format;
+        desc.quant_format = (nn_buffer_quantize_format_e)info.quantization_format;
+        desc.scale = info.TF_scale;
+        desc.zero_point = info.TF_zeropoint;
+        desc.fixed_point_pos = info.fixed_point_pos;
+        desc.bytes = desc.elements * tensor_format_size(desc.format);
+        descs.push_back(desc);
+    }
+    return descs;
+}
+
+OutputLease& OutputLease::operator=(OutputLease&& other) noexcept {
+    if (this != &other) {
+        release();
+        session_ = other.session_;
+        entry_ = other.entry_;
+        out_ = other.out_;
+        other.session_ = nullptr;
+        other.entry_ = -1;
+        other.out_ = nullptr;
+    }
+    return *this;
+}
+
+void OutputLease::release() {
+    if (session_) {
+        session_->release_entry(entry_);
+    }
+    session_ = nullptr;
+    entry_ = -1;
+    out_ = nullptr;
+}
+
+std::unique_ptr<ModelSession> ModelSession::create(const char* model_path, const SessionConfig& config) {
+    if (config.input_slots < 1) {
+        LOGE("input_slots must be at least 1.");
+        return nullptr;
+    }
+    if (config.output_ring > 0 && config.output_format == AML_OUTDATA_FLOAT32) {
+        LOGE("output_ring needs AML_OUTDATA_RAW outputs.");
+        return nullptr;
+    }
+    auto start = std::chrono::steady_clock::now();
+    // Portable models load from their compiled loadable; the softop
+    // profile and metrics keep the name the caller gave
+    std::string loadable = compiled_model_path(model_path, config.compile);
+    if (loadable.empty()) {
+        return nullptr;
+    }
+    std::shared_ptr<ModelBlob> blob;
+    if (config.map_model) {
+        blob = ModelBlob::open(loadable.c_str());
+    }
+    int core = -1;
+    int ticket = CoreScheduler::instance().assign(config.core, &core);
+    SoftopProfile softop;
+    if (config.softop) {
+        softop = *config.softop;
+    } else {
+        load_softop_profile(softop_profile_path(model_path).c_str(), &softop);
+    }
+    // More OpenMP threads than the stage has CPUs only adds contention
+    int stage_cpus = ThreadPlacement::instance().threads(config.cpu_stage, 0);
+    if (stage_cpus > 0) {
+        softop.openmp_threads = std::min(softop.openmp_threads, stage_cpus);
+        for (auto& op : softop.ops) op.openmp_threads = std::min(op.openmp_threads, stage_cpus);
+    }
+    void* context = blob ? init_network_memory(blob->data(), blob->size(), core, &softop, config.timeout_ms)
+                         : init_network(loadable.c_str(), core, &softop, config.timeout_ms);
+    if (NULL == context) {
+        CoreScheduler::instance().release(ticket);
+        return nullptr;
+    }
+    std::unique_ptr<ModelSession> session(new ModelSession(context, config));
+    session->blob_ = blob;
+    session->core_ = core;
+    session->core_ticket_ = ticket;
+    const char* name = strrchr(model_path, '/');
+    session->memory_.model = name ? name + 1 : model_path;
+    session->memory_.blob_bytes = blob ? blob->size() : 0;
+    if (session->alloc_output_ring()) {
+        return nullptr;
+    }
+    session->refresh_memory();
+    session->load_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    int warmup_runs = config.warmup_runs;
+    const char* env = getenv("AMLNN_WARMUP");
+    if (warmup_runs == 0 && env) {
+        warmup_runs = atoi(env);
+    }
+    if (warmup_runs > 0 && session->warmup(warmup_runs)) {
+        return nullptr;
+    }
+    // Started after warm-up so cold invokes stay out of the metrics and
+    // the recording
+    session->start_profile(model_path);
+    if (warmup_runs > 0) {
+        session->refresh_memory();
+    }
+    return session;
+}
+
+// AMLNN_METRICS / AMLNN_RECORD=path apply to every session in the
+// process; sessions after the first write to "<stem>.<n><ext>" so they do
+// not overwrite it.
+static std::string env_session_path(const char* name, std::atomic<int>& sessions) {
+    const char* env = getenv(name);
+    if (NULL == env || '\0' == env[0]) {
+        return std::string();
+    }
+    std::string path(env);
+    int n = sessions++;
+    if (n > 0) {
+        size_t slash = path.find_last_of('/');
+        size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+        path.insert(dot, "." + std::to_string(n));
+    }
+    return path;
+}
+
+static std::string env_metrics_path() {
+    static std::atomic<int> sessions(0);
+    return env_session_path("AMLNN_METRICS", sessions);
+}
+
+static std::string env_record_path() {
+    static std::atomic<int> sessions(0);
+    return env_session_path("AMLNN_RECORD", sessions);
+}
+
+static std::string env_memory_path() {
+    static std::atomic<int> sessions(0);
+    return env_session_path("AMLNN_MEMORY", sessions);
+}
+
+void ModelSession::start_profile(const char* model_path) {
+    if (config_.record_path.empty()) {
+        config_.record_path = env_record_path();
+    }
+    if (!config_.record_path.empty()) {
+        recorder_ = TensorRecorder::open(config_.record_path.c_str());
+    }
+    if (config_.memory_path.empty()) {
+        config_.memory_path = env_memory_path();
+        if (!config_.memory_path.empty() && config_.memory_poll == 0) {
+            config_.memory_poll = 64;
+        }
+    }
+
+    if (config_.profile == AML_PROFILE_NONE && config_.metrics_path.empty()) {
+        config_.metrics_path = env_metrics_path();
+        if (config_.metrics_path.empty()) {
+            return;
+        }
+        config_.profile = AML_PROFILE_PERFORMANCE;
+    } else if (config_.profile == AML_PROFILE_NONE) {
+        config_.profile = AML_PROFILE_PERFORMANCE;
+    }
+
+    aml_profile_config_t profile;
+    memset(&profile, 0, sizeof(aml_profile_config_t));
+    profile.profile_type = config_.profile;
+    if (aml_util_enableProfile(context_, &profile)) {
+        LOGE("aml_util_enableProfile fail, profiling disabled.");
+        config_.profile = AML_PROFILE_NONE;
+        return;
+    }
+
+    const char* name = strrchr(model_path, '/');
+    metrics_.reset(new NpuMetrics(name ? name + 1 : model_path));
+}
+
+void ModelSession::collect_profile() {
+    aml_profile_config_t profile;
+    memset(&profile, 0, sizeof(aml_profile_config_t));
+    profile.profile_type = config_.profile;
+    if (aml_util_getProfileInfo(context_, &profile)) {
+        LOGE("aml_util_getProfileInfo fail.");
+        return;
+    }
+    metrics_->record(profile.profiling_data);
+    last_inference_ms_ = profile.profiling_data.inference_time_us / 1000.0;
+
+    NpuMemory npu;
+    read_npu_memory(profile, &npu);
+    if (npu.valid) {
+        std::lock_guard<std::mutex> lock(memory_mutex_);
+        memory_.update(npu);
+    }
+}
+
+ModelMemory ModelSession::memory() const {
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    return memory_;
+}
+
+ModelMemory ModelSession::refresh_memory() {
+    invokes_since_memory_ = 0;
+    NpuMemory npu;
+    // A profile enabled for metrics serves the query as it is
+    int ret = query_npu_memory(context_, metrics_ ? config_.profile : AML_PROFILE_NONE, &npu);
+    ProcessMemory process = process_memory();
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    if (ret == 0) {
+        memory_.update(npu);
+    }
+    memory_.process = process;
+    return memory_;
+}
+
+void ModelSession::add_dma_bytes(uint64_t* counter, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(memory_mutex_);
+    *counter += bytes;
+}
+
+// Feeds the core scheduler; the profiler's inference time is preferred
+// over wall time, which includes queueing and output conversion.
+void ModelSession::report_invoke(double wall_ms) {
+    if (metrics_) {
+        collect_profile();
+    } else if (config_.memory_poll > 0 && ++invokes_since_memory_ >= config_.memory_poll) {
+        refresh_memory();
+    }
+    if (core_ticket_ >= 0) {
+        CoreScheduler::instance().record(core_ticket_, last_inference_ms_ >= 0 ? last_inference_ms_ : wall_ms);
+    }
+}
+
+// Appends the inputs of `slot` and the outputs of the invoke that read
+// them as one frame.
+void ModelSession::record(int slot, const nn_output* out) {
+    uint64_t frame = recorded_frames_++;
+    const std::vector<DmaBuffer>& buffers = slots_[slot];
+    for (const auto& host : host_inputs_) {
+        unsigned int index = host.first.index;
+        if (index < buffers.size() && buffers[index].config.mem_size) continue;
+        if (!host.second.empty()) {
+            recorder_->write(AMLT_INPUT, frame, host.first, host.second.data(), host.second.size());
+        }
+    }
+    for (const auto& buffer : buffers) {
+        if (buffer.config.mem_size == 0) continue;
+        TensorDesc desc;
+        if (buffer.config.index < input_descs_.size()) {
+            desc = input_descs_[buffer.config.index];
+        }
+        desc.index = buffer.config.index;
+        recorder_->write(AMLT_INPUT, frame, desc, buffer.data.viraddr, buffer.config.mem_size);
+    }
+    recorder_->write_outputs(frame, out, output_descs_, config_.output_format);
+}
+
+ModelSession::ModelSession(void* context, const SessionConfig& config)
+    : context_(context), config_(config), slots_(config.input_slots) {
+    load_tensor_info();
+}
+
+void ModelSession::load_tensor_info() {
+    if (query_tensor_descs(context_, &input_descs_, &output_descs_)) {
+        LOGE("aml_util_getTensorInfo fail, input sizes must be given explicitly.");
+    }
+
+    // A batch_multiplier shows as an outermost dimension above 1 shared by
+    // every input and output
+    unsigned int batch = input_descs_.empty() || input_descs_[0].dims.size() < 2 ? 1 : input_descs_[0].dims[0];
+    for (const auto* descs : {&input_descs_, &output_descs_}) {
+        for (const auto& desc : *descs) {
+            if (desc.dims.size() < 2 || desc.dims[0] != batch) batch = 1;
+        }
+    }
+    batch_ = batch > 1 ? batch : 1;
+}
+
+int query_tensor_descs(void* context, std::vector<TensorDesc>* inputs, std::vector<TensorDesc>* outputs) {
+    tensor_info* in_info = NULL;
+    tensor_info* out_info = NULL;
+    // The context already holds the parsed model, so no model data is passed.
+    int ret = aml_util_getTensorInfo(context, NULL, &in_info, &out_info);
+    if (inputs) *inputs = to_descs(ret ? NULL : in_info);
+    if (outputs) *outputs = to_descs(ret ? NULL : out_info);
+    if (in_info) aml_util_freeTensorInfo(in_info);
+    if (out_info) aml_util_freeTensorInfo(out_info);
+    return ret ? -1 : 0;
+}
+
+const TensorDesc* ModelSession::find_input(const char* name) const {
+    for (const auto& desc : input_descs_) {
+        if (desc.name == name) return &desc;
+    }
+    return NULL;
+}
+
+const TensorDesc* ModelSession::find_output(const char* name) const {
+    for (const auto& desc : output_descs_) {
+        if (desc.name == name) return &desc;
+    }
+    return NULL;
+}
+
+ModelSession::~ModelSession() {
+    if (!config_.memory_path.empty()) {
+        refresh_memory().write(config_.memory_path.c_str());
+    }
+    if (metrics_) {
+        if (!config_.metrics_path.empty()) {
+            metrics_->write(config_.metrics_path.c_str());
+        }
+        aml_profile_config_t profile;
+        memset(&profile, 0, sizeof(aml_profile_config_t));
+        profile.profile_type = config_.profile;
+        aml_util_disableProfile(context_, &profile);
+    }
+    for (auto& inputs : slots_) {
+        for (auto& buffer : inputs) {
+            if (buffer.config.mem_size == 0) continue;
+            if (aml_util_freeBuffer(context_, &buffer.config, &buffer.data)) {
+                LOGE("aml_util_freeBuffer fail for input %u.", buffer.config.index);
+            }
+        }
+    }
+    for (auto& entry : ring_) {
+        for (auto& buffer : entry.buffers) {
+            if (buffer.config.mem_size == 0) continue;
+            if (aml_util_freeBuffer(context_, &buffer.config, &buffer.data)) {
+                LOGE("aml_util_freeBuffer fail for output %u.", buffer.config.index);
+            }
+        }
+    }
+    uninit_network(context_);
+    CoreScheduler::instance().release(core_ticket_);
+}
+
+TensorView ModelSession::input(unsigned int index, size_t size, int slot) {
+    if (index >= INPUT_MAX_NUM || slot < 0 || slot >= (int)slots_.size()) {
+        LOGE("input index %u / slot %d out of range.", index, slot);
+        return TensorView();
+    }
+    std::vector<DmaBuffer>& inputs = slots_[slot];
+    if (index >= inputs.size()) {
+        DmaBuffer empty;
+        memset(&empty, 0, sizeof(DmaBuffer));
+        inputs.resize(index + 1, empty);
+    }
+
+    if (size == 0) {
+        if (index >= input_descs_.size() || input_descs_[index].bytes == 0) {
+            LOGE("input %u has no tensor info, pass its size explicitly.", index);
+            return TensorView();
+        }
+        size = input_descs_[index].bytes;
+    }
+
+    DmaBuffer& buffer = inputs[index];
+    if (buffer.config.mem_size == 0) {
+        init_dma_buffer(&buffer, false, index, size);
+
+        if (aml_util_mallocBuffer(context_, &buffer.config, &buffer.data) || NULL == buffer.data.viraddr) {
+            LOGE("aml_util_mallocBuffer fail for input %u (%zu bytes).", index, size);
+            memset(&buffer, 0, sizeof(DmaBuffer));
+            return TensorView();
+        }
+        if (slot == bound_slot_ && aml_util_swapExternalInputBuffer(context_, &buffer.config, &buffer.data)) {
+            LOGE("aml_util_swapExternalInputBuffer fail for input %u.", index);
+            aml_util_freeBuffer(context_, &buffer.config, &buffer.data);
+            memset(&buffer, 0, sizeof(DmaBuffer));
+            return TensorView();
+        }
+        add_dma_bytes(&memory_.input_bytes, size);
+    } else if (size > (size_t)buffer.config.mem_size) {
+        LOGE("input %u requested %zu bytes, buffer holds %lld.", index, size, (long long)buffer.config.mem_size);
+        return TensorView();
+    }
+
+    TensorView view;
+    view.data = static_cast<unsigned char*>(buffer.data.viraddr);
+    view.size = size;
+    return view;
+}
+
+int ModelSession::bind_slot(int slot) {
+    if (slot < 0 || slot >= (int)slots_.size()) {
+        LOGE("slot %d out of range.", slot);
+        return -1;
+    }
+    if (slot == bound_slot_) {
+        return 0;
+    }
+    for (auto& buffer : slots_[slot]) {
+        if (buffer.config.mem_size == 0) continue;
+        if (aml_util_swapExternalInputBuffer(context_, &buffer.config, &buffer.data)) {
+            LOGE("aml_util_swapExternalInputBuffer fail for input %u slot %d.", buffer.config.index, slot);
+            return -1;
+        }
+    }
+    bound_slot_ = slot;
+    return 0;
+}
+
+int ModelSession::set_input(unsigned int index, const void* data, size_t size, const input_info* info,
+                            amlnn_input_type type) {
+    nn_input inData;
+    memset(&inData, 0, sizeof(nn_input));
+    inData.typeSize = sizeof(nn_input);
+    inData.input_type = type;
+    inData.input = (unsigned char*)data;
+    inData.input_index = index;
+    inData.size = size;
+    if (info) {
+        inData.info = *info;
+    }
+
+    int ret = aml_module_input_set(context_, &inData);
+    if (ret) {
+        LOGE("aml_module_input_set fail for index %u. Ret=%d", index, ret);
+        return -1;
+    }
+    if (recorder_) {
+        if (index >= host_inputs_.size()) host_inputs_.resize(index + 1);
+        TensorDesc& desc = host_inputs_[index].first;
+        desc = index < input_descs_.size() ? input_descs_[index] : TensorDesc();
+        desc.index = index;
+        if (type == BINARY_RAW_DATA && info && info->input_data_type == AML_INPUT_FP32) {
+            // Stored as handed over, before the SDK quantizes it
+            desc.format = NN_BUFFER_FORMAT_FP32;
+            desc.quant_format = NN_BUFFER_QUANTIZE_NONE;
+            desc.bytes = size;
+        }
+        host_inputs_[index].second.assign((const unsigned char*)data, (const unsigned char*)data + size);
+    }
+    return 0;
+}
+
+nn_output* ModelSession::output_get(int invoke_type, int64_t invoke_id) {
+    StageScope stage(config_.cpu_stage.c_str());
+    aml_output_config_t outconfig;
+    memset(&outconfig, 0, sizeof(aml_output_config_t));
+    outconfig.typeSize = sizeof(aml_output_config_t);
+    outconfig.format = config_.output_format;
+    outconfig.invoke.typeSize = sizeof(aml_invoke_info_t);
+    outconfig.invoke.invoke_type = invoke_type;
+    outconfig.invoke.invoke_id = invoke_id;
+    invoke_timeout_ms_ = config_.timeout_ms;
+    deadline_expired_ = false;
+    if (has_deadline_) {
+        // Rounded up, so a deadline a fraction of a millisecond away is
+        // not a timeout of 0 (none)
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline_ - std::chrono::steady_clock::now()).count();
+        if (left <= 0) {
+            deadline_expired_ = true;
+            // An invoke already queued is still collected, bounded by
+            // timeout_ms only, see wait()
+            if (invoke_type != 2) {
+                return NULL;
+            }
+        } else if (invoke_timeout_ms_ <= 0 || left < invoke_timeout_ms_) {
+            invoke_timeout_ms_ = (int)left;
+        }
+    }
+    outconfig.invoke.timeout = invoke_timeout_ms_;
+    if (invoke_type != 2) {
+        flush_inputs();
+    }
+    return (nn_output*)aml_module_output_get(context_, outconfig);
+}
+
+void ModelSession::set_deadline(std::chrono::steady_clock::time_point deadline) {
+    deadline_ = deadline;
+    has_deadline_ = true;
+}
+
+// A failed invoke that took its whole timeout is taken as a timeout; the
+// SDK reports both as a NULL output.
+void ModelSession::check_timeout(std::chrono::steady_clock::time_point start) {
+    timed_out_ = deadline_expired_;
+    if (!deadline_expired_ && invoke_timeout_ms_ > 0 &&
+        std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(invoke_timeout_ms_)) {
+        timed_out_ = true;
+        ++timeouts_;
+    }
+}
+
+DmaPolicy ModelSession::dma_policy(bool output, unsigned int index) const {
+    DmaPolicy policy;
+    policy.output = output;
+    policy.index = index;
+    policy.cache_type = config_.cache_type;
+    for (const DmaPolicy& p : config_.dma) {
+        if (p.output == output && (p.index < 0 || (unsigned int)p.index == index)) {
+            policy.cache_type = p.cache_type;
+            policy.direction = p.direction;
+        }
+    }
+    return policy;
+}
+
+void ModelSession::init_dma_buffer(DmaBuffer* buffer, bool output, unsigned int index, size_t size) const {
+    DmaPolicy policy = dma_policy(output, index);
+    buffer->config.typeSize = sizeof(aml_memory_config_t);
+    buffer->config.index = index;
+    buffer->config.mem_size = size;
+    buffer->config.cache_type = policy.cache_type;
+    buffer->config.memory_type = AML_VIRTUAL_ADDR;
+    buffer->config.direction = policy.direction;
+    buffer->data.typeSize = sizeof(aml_memory_data_t);
+}
+
+// CPU writes to cached inputs may still sit in the cache when the NPU
+// reads the buffer; write-combined buffers are already in memory.
+void ModelSession::flush_inputs() {
+    if (!config_.flush_dma || slots_.empty()) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t flushes = 0;
+    for (DmaBuffer& buffer : slots_[bound_slot_]) {
+        if (buffer.config.mem_size == 0 || buffer.config.cache_type != AML_WITH_CACHE) continue;
+        if (aml_util_flushBuffer(context_, &buffer.config, &buffer.data)) {
+            LOGE("aml_util_flushBuffer fail for input %u.", buffer.config.index);
+        }
+        ++flushes;
+    }
+    if (flushes) {
+        flush_stats_.input_flushes += flushes;
+        flush_stats_.input_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+// Lines of cached outputs the CPU read before this invoke are stale once
+// the NPU has written the buffer.
+void ModelSession::flush_outputs(OutputEntry& entry) {
+    if (!config_.flush_dma) {
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t flushes = 0;
+    for (DmaBuffer& buffer : entry.buffers) {
+        if (buffer.config.cache_type != AML_WITH_CACHE) continue;
+        if (aml_util_flushBuffer(context_, &buffer.config, &buffer.data)) {
+            LOGE("aml_util_flushBuffer fail for output %u.", buffer.config.index);
+        }
+        ++flushes;
+    }
+    if (flushes) {
+        flush_stats_.output_flushes += flushes;
+        flush_stats_.output_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+int ModelSession::alloc_output_ring() {
+    if (config_.output_ring <= 0) {
+        return 0;
+    }
+    if (output_descs_.empty()) {
+        LOGE("output_ring needs output tensor info.");
+        return -1;
+    }
+    ring_.resize(config_.output_ring);
+    for (auto& entry : ring_) {
+        entry.params.resize(output_descs_.size());
+        memset(&entry.out, 0, sizeof(nn_output));
+        for (const auto& desc : output_descs_) {
+            DmaBuffer buffer;
+            memset(&buffer, 0, sizeof(DmaBuffer));
+            init_dma_buffer(&buffer, true, desc.index, desc.bytes);
+            if (aml_util_mallocBuffer(context_, &buffer.config, &buffer.data) || NULL == buffer.data.viraddr) {
+                LOGE("aml_util_mallocBuffer fail for output %u (%zu bytes).", desc.index, desc.bytes);
+                return -1;
+            }
+            entry.buffers.push_back(buffer);
+            add_dma_bytes(&memory_.output_bytes, desc.bytes);
+        }
+    }
+    return 0;
+}
+
+// Picks the ring entry the next invoke writes to: a free one, else the
+// unleased outputs of the previous invoke, and swaps its buffers in.
+int ModelSession::acquire_entry() {
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    int n = (int)ring_.size();
+    int entry = -1;
+    for (int i = 1; i <= n && entry < 0; ++i) {
+        int k = (bound_entry_ + i + n) % n;
+        if (ring_[k].state == ENTRY_FREE) entry = k;
+    }
+    if (entry < 0 && latest_entry_ >= 0) {
+        entry = latest_entry_;
+        latest_entry_ = -1;
+    }
+    if (entry < 0) {
+        LOGE("every output ring entry is leased or in flight.");
+        return -1;
+    }
+    if (entry != bound_entry_) {
+        for (auto& buffer : ring_[entry].buffers) {
+            if (aml_util_swapExternalOutputBuffer(context_, &buffer.config, &buffer.data)) {
+                LOGE("aml_util_swapExternalOutputBuffer fail for output %u.", buffer.config.index);
+                ring_[entry].state = ENTRY_FREE;
+                return -1;
+            }
+        }
+        bound_entry_ = entry;
+    }
+    ring_[entry].state = ENTRY_IN_FLIGHT;
+    return entry;
+}
+
+// Makes `entry` hold the outputs of the invoke that just finished and
+// returns its nn_output, whose buffers point into the entry.
+nn_output* ModelSession::complete_entry(int entry, nn_output* out) {
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    OutputEntry& e = ring_[entry];
+    if (NULL == out) {
+        e.state = ENTRY_FREE;
+        return NULL;
+    }
+    flush_outputs(e);
+    memcpy(&e.out, out, sizeof(nn_output));
+    for (unsigned int i = 0; i < out->num && i < e.buffers.size(); ++i) {
+        DmaBuffer& buffer = e.buffers[i];
+        unsigned char* data = (unsigned char*)buffer.data.viraddr;
+        if (out->out[i].buf != data) {
+            // Outputs that did not land in the swapped-in buffer are copied
+            // so the lease still holds them
+            size_t size = std::min<size_t>(out->out[i].size, buffer.config.mem_size);
+            memcpy(data, out->out[i].buf, size);
+            e.out.out[i].size = size;
+            e.out.out[i].buf = data;
+        }
+        if (out->out[i].param) {
+            e.params[i] = *out->out[i].param;
+            e.out.out[i].param = &e.params[i];
+        }
+    }
+    if (latest_entry_ >= 0 && latest_entry_ != entry && ring_[latest_entry_].state == ENTRY_LATEST) {
+        ring_[latest_entry_].state = ENTRY_FREE;
+    }
+    e.state = ENTRY_LATEST;
+    latest_entry_ = entry;
+    return &e.out;
+}
+
+void ModelSession::release_entry(int entry) {
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    if (entry >= 0 && entry < (int)ring_.size() && ring_[entry].state == ENTRY_LEASED) {
+        ring_[entry].state = ENTRY_FREE;
+    }
+}
+
+OutputLease ModelSession::lease_output() {
+    OutputLease lease;
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    if (latest_entry_ < 0) {
+        return lease;
+    }
+    ring_[latest_entry_].state = ENTRY_LEASED;
+    lease.session_ = this;
+    lease.entry_ = latest_entry_;
+    lease.out_ = &ring_[latest_entry_].out;
+    latest_entry_ = -1;
+    return lease;
+}
+
+// Byte that represents 0.0 in an 8-bit affine input; 0 otherwise.
+static int zero_byte(const TensorDesc& desc) {
+    if (tensor_format_size(desc.format) != 1 || desc.quant_format != NN_BUFFER_QUANTIZE_TF_ASYMM) {
+        return 0;
+    }
+    int lo = desc.format == NN_BUFFER_FORMAT_INT8 ? -128 : 0;
+    int zp = desc.zero_point < lo ? lo : (desc.zero_point > lo + 255 ? lo + 255 : desc.zero_point);
+    return zp & 0xff;
+}
+
+int ModelSession::warmup(int runs, const std::function<int(ModelSession&, int slot)>& fill) {
+    warmup_ = WarmupStats();
+    if (runs <= 0) {
+        return 0;
+    }
+    auto start = std::chrono::steady_clock::now();
+    int restore = bound_slot_;
+    std::vector<int> slots;
+    for (int slot = 0; slot < (int)slots_.size(); ++slot) {
+        bool allocated = false;
+        for (auto& buffer : slots_[slot]) {
+            if (buffer.config.mem_size == 0) continue;
+            allocated = true;
+            if (!fill) {
+                const TensorDesc* desc = buffer.config.index < input_descs_.size() ? &input_descs_[buffer.config.index] : NULL;
+                memset(buffer.data.viraddr, desc ? zero_byte(*desc) : 0, buffer.config.mem_size);
+            }
+        }
+        if (allocated) slots.push_back(slot);
+    }
+    if (slots.empty()) {
+        slots.push_back(bound_slot_);
+    }
+
+    if (fill) {
+        for (int slot : slots) {
+            if (bind_slot(slot) || fill(*this, slot)) {
+                LOGE("warm-up input fill fail for slot %d.", slot);
+                bind_slot(restore);
+                return -1;
+            }
+        }
+    } else {
+        // Inputs without a DMA buffer are fed through the SDK copy
+        const std::vector<DmaBuffer>& bound = slots_[slots[0]];
+        for (const auto& desc : input_descs_) {
+            if (desc.index < bound.size() && bound[desc.index].config.mem_size) continue;
+            input_info info;
+            memset(&info, 0, sizeof(input_info));
+            info.valid = 1;
+            int ret;
+            if (tensor_format_size(desc.format) == 1 && desc.quant_format != NN_BUFFER_QUANTIZE_NONE) {
+                std::vector<unsigned char> data(desc.bytes, (unsigned char)zero_byte(desc));
+                info.input_data_type = desc.format == NN_BUFFER_FORMAT_INT8 ? AML_INPUT_I8 : AML_INPUT_U8;
+                ret = set_input(desc.index, data.data(), data.size(), &info, QTENSOR_RAW_DATA);
+            } else {
+                std::vector<float> data(desc.elements, 0.0f);
+                info.input_data_type = AML_INPUT_FP32;
+                ret = set_input(desc.index, data.data(), data.size() * sizeof(float), &info);
+            }
+            if (ret) return -1;
+        }
+    }
+    warmup_.fill_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double warm_total = 0;
+    for (int i = 0; i < runs; ++i) {
+        if (bind_slot(slots[i % slots.size()])) {
+            bind_slot(restore);
+            return -1;
+        }
+        auto invoke_start = std::chrono::steady_clock::now();
+        if (NULL == output_get(0, 0)) {
+            LOGE("warm-up invoke %d fail.", i);
+            bind_slot(restore);
+            return -1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - invoke_start).count();
+        if (i == 0) {
+            warmup_.cold_ms = ms;
+        } else {
+            warm_total += ms;
+            warmup_.max_warm_ms = ms > warmup_.max_warm_ms ? ms : warmup_.max_warm_ms;
+        }
+    }
+    warmup_.runs = runs;
+    warmup_.warm_ms = runs > 1 ? warm_total / (runs - 1) : warmup_.cold_ms;
+    return bind_slot(restore);
+}
+
+nn_output* ModelSession::run() {
+    int entry = ring_.empty() ? -1 : acquire_entry();
+    if (!ring_.empty() && entry < 0) {
+        return NULL;
+    }
+    auto start = std::chrono::steady_clock::now();
+    nn_output* outdata = output_get(0, 0);
+    timed_out_ = false;
+    if (NULL == outdata) {
+        check_timeout(start);
+    }
+    // An invoke that timed out may still write into the entry's buffers, so
+    // the entry stays in flight until the context is recreated
+    if (entry >= 0 && !(timed_out_ && !deadline_expired_)) {
+        outdata = complete_entry(entry, outdata);
+    }
+    if (NULL == outdata) {
+        if (deadline_expired_) {
+            LOGE("invoke not started, deadline passed.");
+        } else if (timed_out_) {
+            LOGE("aml_module_output_get timed out after %d ms.", invoke_timeout_ms_);
+        } else {
+            LOGE("aml_module_output_get fail.");
+        }
+    } else {
+        report_invoke(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        if (recorder_) record(bound_slot_, outdata);
+    }
+    return outdata;
+}
+
+int ModelSession::upload_batch_input(const unsigned char* data, size_t bytes, const input_info* info,
+                                     amlnn_input_type type) {
+    const std::vector<DmaBuffer>& bound = slots_[bound_slot_];
+    if (bound.empty() || bound[0].config.mem_size == 0) {
+        return set_input(0, data, bytes, info, type);
+    }
+    const DmaBuffer& buffer = bound[0];
+    if (bytes > (size_t)buffer.config.mem_size) {
+        LOGE("batch of %zu bytes does not fit input 0 (%lld bytes).", bytes, (long long)buffer.config.mem_size);
+        return -1;
+    }
+    if (data != buffer.data.viraddr) {
+        memcpy(buffer.data.viraddr, data, bytes);
+    }
+    return 0;
+}
+
+int ModelSession::run_batch(const void* data, size_t item_bytes, size_t items, BatchOutputs* outputs,
+                            const input_info* info, amlnn_input_type type) {
+    outputs->items_.clear();
+    outputs->data_.clear();
+    outputs->params_.clear();
+    if (input_descs_.size() > 1) {
+        LOGE("run_batch takes single-input models, this one has %zu inputs.", input_descs_.size());
+        return -1;
+    }
+    const unsigned char* src = (const unsigned char*)data;
+    const std::vector<DmaBuffer>& bound = slots_[bound_slot_];
+    bool in_place = !bound.empty() && bound[0].config.mem_size && src == bound[0].data.viraddr;
+    if (in_place && items > batch_) {
+        LOGE("a batch written into the input buffer holds at most %zu items.", batch_);
+        return -1;
+    }
+
+    bool copy = items > batch_;
+    outputs->items_.resize(items);
+    size_t item_out_bytes = 0;
+    for (size_t first = 0; first < items; first += batch_) {
+        size_t count = std::min(batch_, items - first);
+        const unsigned char* chunk = src + first * item_bytes;
+        if (count < batch_ && !in_place) {
+            batch_staging_.assign(batch_ * item_bytes, 0);
+            memcpy(batch_staging_.data(), chunk, count * item_bytes);
+            chunk = batch_staging_.data();
+        }
+        if (upload_batch_input(chunk, batch_ * item_bytes, info, type)) {
+            return -1;
+        }
+        nn_output* out = run();
+        if (NULL == out) {
+            return -1;
+        }
+
+        if (copy && first == 0) {
+            for (unsigned int k = 0; k < out->num; ++k) item_out_bytes += out->out[k].size / batch_;
+            outputs->data_.resize(items * item_out_bytes);
+            outputs->params_.resize(items * out->num);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            nn_output& item = outputs->items_[first + i];
+            memcpy(&item, out, sizeof(nn_output));
+            size_t offset = (first + i) * item_out_bytes;
+            for (unsigned int k = 0; k < out->num; ++k) {
+                size_t slice = out->out[k].size / batch_;
+                unsigned char* buf = out->out[k].buf + i * slice;
+                item.out[k].size = slice;
+                item.out[k].buf = buf;
+                if (!copy) continue;
+                item.out[k].buf = outputs->data_.data() + offset;
+                memcpy(item.out[k].buf, buf, slice);
+                offset += slice;
+                if (out->out[k].param) {
+                    outputs->params_[(first + i) * out->num + k] = *out->out[k].param;
+                    item.out[k].param = &outputs->params_[(first + i) * out->num + k];
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int64_t ModelSession::submit() {
+    SubmittedInvoke* free_record = NULL;
+    for (auto& submitted : submitted_) {
+        if (submitted.id == 0) {
+            free_record = &submitted;
+            break;
+        }
+    }
+    if (NULL == free_record) {
+        LOGE("submit: %d invokes already outstanding, wait() for one first.", kMaxSubmitted);
+        return -1;
+    }
+    int entry = ring_.empty() ? -1 : acquire_entry();
+    if (!ring_.empty() && entry < 0) {
+        return -1;
+    }
+    int64_t invoke_id = ++next_invoke_id_;
+    auto start = std::chrono::steady_clock::now();
+    // invoke_no_wait only queues the job; outputs are collected by wait()
+    if (NULL == output_get(1, invoke_id)) {
+        if (entry >= 0) complete_entry(entry, NULL);
+        if (deadline_expired_) {
+            LOGE("invoke not submitted, deadline passed.");
+        } else {
+            LOGE("aml_module_output_get rejected invoke %lld.", (long long)invoke_id);
+        }
+        return -1;
+    }
+    free_record->id = invoke_id;
+    free_record->start = start;
+    free_record->slot = bound_slot_;
+    free_record->entry = entry;
+    return invoke_id;
+}
+
+nn_output* ModelSession::wait(int64_t invoke_id) {
+    SubmittedInvoke submitted;
+    for (auto& pending : submitted_) {
+        if (invoke_id > 0 && pending.id == invoke_id) {
+            submitted = pending;
+            pending = SubmittedInvoke();
+            break;
+        }
+    }
+    if (submitted.id == 0) {
+        LOGE("wait: invoke %lld is not outstanding.", (long long)invoke_id);
+        return NULL;
+    }
+    auto start = std::chrono::steady_clock::now();
+    // Past the deadline the queued invoke is still collected, so its entry
+    // is not reused while the NPU can write into it; the result is late and
+    // dropped
+    nn_output* outdata = output_get(2, invoke_id);
+    bool late = deadline_expired_;
+    bool outstanding = false;
+    timed_out_ = false;
+    if (NULL == outdata) {
+        check_timeout(start);
+        if (late) {
+            // Not collected either: the context may be stuck, count it so
+            // ModelPool recreates it
+            ++timeouts_;
+        }
+        outstanding = timed_out_;
+    }
+    int entry = submitted.entry;
+    if (entry >= 0 && !outstanding) {
+        outdata = complete_entry(entry, late ? NULL : outdata);
+    }
+    if (late) {
+        timed_out_ = true;
+        LOGE("invoke %lld %s after its deadline passed.", (long long)invoke_id,
+             outstanding ? "could not be collected" : "collected");
+        return NULL;
+    }
+    if (NULL == outdata) {
+        if (timed_out_) {
+            LOGE("invoke %lld timed out after %d ms.", (long long)invoke_id, invoke_timeout_ms_);
+        } else {
+            LOGE("aml_module_output_get fail waiting for invoke %lld.", (long long)invoke_id);
+        }
+    } else {
+        auto elapsed = std::chrono::steady_clock::now() - submitted.start;
+        report_invoke(std::chrono::duration<double, std::milli>(elapsed).count());
+        if (recorder_) record(submitted.slot, outdata);
+    }
+    return outdata;
+}
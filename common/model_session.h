@@ -0,0 +1,410 @@
+#ifndef _AMLNN_MODEL_SESSION_H_
+#define _AMLNN_MODEL_SESSION_H_
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "nn_sdk.h"
+#include "npu_metrics.h"
+#include "memory_report.h"
+#include "model_blob.h"
+#include "compile_cache.h"
+#include "core_scheduler.h"
+#include "softop_profile.h"
+#include "thread_placement.h"
+
+// Cache type and direction (aml_memory_config_t) of the DMA buffers of
+// the inputs (input()) or the outputs (output_ring) of a session.
+struct DmaPolicy {
+    bool output = false;
+    int index = -1;                     // tensor index, -1 for every tensor
+    aml_cache_type_t cache_type = AML_WITH_CACHE;
+    aml_mem_direction_t direction = AML_MEM_DIRECTION_READ_WRITE;
+};
+
+// Time spent keeping cached DMA buffers coherent with the NPU.
+struct DmaFlushStats {
+    uint64_t input_flushes = 0;
+    uint64_t output_flushes = 0;
+    double input_ms = 0;
+    double output_ms = 0;
+};
+
+struct SessionConfig {
+    // Cache type of every DMA buffer the session allocates, unless `dma`
+    // says otherwise. Cached buffers are flushed around each invoke (see
+    // flush_dma); AML_WITHOUT_CACHE (write-combined) buffers need no
+    // flush but make CPU reads, above all scattered ones, slow.
+    aml_cache_type_t cache_type = AML_WITH_CACHE;
+    // Per-side or per-tensor policies; a later entry overrides an earlier
+    // one. E.g. {false, -1, AML_WITHOUT_CACHE} for inputs the CPU only
+    // writes sequentially. amlnn_bench -C compares the choices.
+    std::vector<DmaPolicy> dma;
+    // Flush cached buffers with aml_util_flushBuffer: the bound inputs
+    // before every invoke, once the CPU has written them, and the ring
+    // outputs after it, before the CPU reads them. Off only for an SDK
+    // known to do it itself.
+    bool flush_dma = true;
+    // AML_OUTDATA_RAW skips the SDK's dequantization of every output
+    // element; read the outputs through visit_output() (output_view.h).
+    aml_output_format_t output_format = AML_OUTDATA_FLOAT32;
+    // Number of input buffer sets. Use 2 to prepare one frame while the
+    // NPU runs another (see run_pipelined).
+    int input_slots = 1;
+    // Output buffer sets allocated with aml_util_mallocBuffer that the
+    // invokes rotate through. lease_output() keeps one invoke's outputs
+    // valid until the lease is released, without copying them. 0 leaves
+    // outputs in SDK buffers that the next invoke overwrites. Needs
+    // AML_OUTDATA_RAW; float conversion always lands in SDK memory.
+    int output_ring = 0;
+    // Create the context from the process-wide ModelBlob mapping of the
+    // model (NN_ADLA_MEMORY) instead of letting the SDK read the file.
+    bool map_model = true;
+    // TFLite (.tflite) and TensorFlow (.pb) models are compiled on the
+    // device once per model hash / hw_version / settings and loaded from
+    // the cached loadable afterwards (compile_cache.h).
+    CompileOptions compile;
+    // NPU core placement through CoreScheduler.
+    CoreRequest core;
+    // CPU fallback settings; NULL loads "<model>.softop" when present.
+    std::shared_ptr<const SoftopProfile> softop;
+    // Dummy invokes run by create() on zero-point inputs (see warmup()),
+    // so lazy allocation, cache misses and clock ramp-up are paid before
+    // the first real frame. 0 takes the count from AMLNN_WARMUP, if set.
+    int warmup_runs = 0;
+    // ThreadPlacement stage the invokes run in (e.g. "infer"): invokes are
+    // pinned to its CPUs, so the SDK's softop OpenMP threads start there,
+    // softop thread counts are capped to its size, and the invoking
+    // thread's CPU time is reported under it. Empty: no placement.
+    std::string cpu_stage;
+    // Opt-in profiling: AML_PROFILE_PERFORMANCE or AML_PROFILE_BANDWIDTH
+    // collects aml_util_getProfileInfo counters after every invoke into
+    // metrics(). Setting the AMLNN_METRICS environment variable to a file
+    // path turns on AML_PROFILE_PERFORMANCE for sessions that leave this off.
+    aml_profile_type_t profile = AML_PROFILE_NONE;
+    // Metrics file written when the session is destroyed: JSON for a
+    // ".json" path, Prometheus text format otherwise.
+    std::string metrics_path;
+    // AMLT file (tensor_dump.h) every run() / wait() appends its inputs and
+    // outputs to, for replaying postprocessing without the NPU. The
+    // AMLNN_RECORD environment variable sets it for every session, numbered
+    // like AMLNN_METRICS. Warm-up invokes are not recorded.
+    std::string record_path;
+    // NPU memory (memory()) is queried when the context is created, after
+    // warm-up and then every `memory_poll` invokes; 0 polls only through
+    // refresh_memory(). Sessions that profile read the pool usage from
+    // every invoke's profile instead.
+    int memory_poll = 0;
+    // Memory report written when the session is destroyed: JSON for a
+    // ".json" path, text otherwise. The AMLNN_MEMORY environment variable
+    // sets it for every session, numbered like AMLNN_METRICS, and polls
+    // every 64 invokes unless memory_poll is set.
+    std::string memory_path;
+    // Upper bound of one invoke in ms, given to the context
+    // (aml_config.timeout_ms) and to every aml_module_output_get
+    // (aml_invoke_info_t.timeout). An invoke that reaches it fails with
+    // timed_out() set instead of blocking the caller forever. 0: none.
+    int timeout_ms = 0;
+};
+
+// Shape, type and quantization of one model input or output, read once
+// from aml_util_getTensorInfo when the session is created.
+struct TensorDesc {
+    unsigned int index = 0;
+    std::string name;
+    std::vector<unsigned int> dims;   // outermost first, e.g. {N, H, W, C}
+    nn_buffer_format_e format = NN_BUFFER_FORMAT_FP32;
+    nn_buffer_quantize_format_e quant_format = NN_BUFFER_QUANTIZE_NONE;
+    float scale = 1.0f;
+    int zero_point = 0;
+    int fixed_point_pos = 0;
+    size_t elements = 0;
+    size_t bytes = 0;                 // size in the model's native format
+
+    // dims[i]; negative i counts from the innermost dimension.
+    unsigned int dim(int i) const {
+        int n = (int)dims.size();
+        int k = i < 0 ? n + i : i;
+        return (k >= 0 && k < n) ? dims[k] : 1;
+    }
+};
+
+// TensorDescs of a context created without a ModelSession (init_network);
+// either pointer may be NULL. -1, with both lists empty, when
+// aml_util_getTensorInfo fails.
+int query_tensor_descs(void* context, std::vector<TensorDesc>* inputs, std::vector<TensorDesc>* outputs);
+
+inline size_t tensor_format_size(nn_buffer_format_e format) {
+    switch (format) {
+        case NN_BUFFER_FORMAT_FP32:
+        case NN_BUFFER_FORMAT_INT32:  return 4;
+        case NN_BUFFER_FORMAT_FP16:
+        case NN_BUFFER_FORMAT_UINT16:
+        case NN_BUFFER_FORMAT_INT16:  return 2;
+        case NN_BUFFER_FORMAT_INT64:  return 8;
+        default:                      return 1;
+    }
+}
+
+// Latency of the dummy invokes run by ModelSession::warmup().
+struct WarmupStats {
+    int runs = 0;
+    double fill_ms = 0;       // filling, and first touching, the inputs
+    double cold_ms = 0;       // first invoke
+    double warm_ms = 0;       // mean of the remaining invokes
+    double max_warm_ms = 0;
+};
+
+// Writable window onto an NPU-visible input buffer.
+struct TensorView {
+    unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+class ModelSession;
+class TensorRecorder;
+
+// Per-item outputs of ModelSession::run_batch(). item(i) is an nn_output
+// whose buffers cover only batch item i's slice of every output, so
+// postprocessing written for one image runs unchanged on each item.
+class BatchOutputs {
+public:
+    size_t size() const { return items_.size(); }
+    const nn_output* item(size_t i) const { return i < items_.size() ? &items_[i] : nullptr; }
+
+private:
+    friend class ModelSession;
+
+    std::vector<nn_output> items_;
+    // Item copies, kept when the batch took more than one invoke
+    std::vector<unsigned char> data_;
+    std::vector<nn_buffer_params_t> params_;
+};
+
+// Outputs of one invoke, held in an entry of the session's output ring.
+// The entry is not reused until the lease is released (or destroyed), so
+// consumers may read it after later invokes have been submitted. Leases
+// can be released from any thread but must not outlive the session.
+class OutputLease {
+public:
+    OutputLease() = default;
+    OutputLease(OutputLease&& other) noexcept { *this = std::move(other); }
+    OutputLease& operator=(OutputLease&& other) noexcept;
+    ~OutputLease() { release(); }
+
+    OutputLease(const OutputLease&) = delete;
+    OutputLease& operator=(const OutputLease&) = delete;
+
+    const nn_output* get() const { return out_; }
+    explicit operator bool() const { return out_ != nullptr; }
+    void release();
+
+private:
+    friend class ModelSession;
+
+    ModelSession* session_ = nullptr;
+    int entry_ = -1;
+    const nn_output* out_ = nullptr;
+};
+
+// Owns one network context together with its DMA input buffers.
+// Input buffers are allocated with aml_util_mallocBuffer and bound with
+// aml_util_swapExternalInputBuffer the first time they are requested, so
+// preprocessing can write straight into memory the NPU reads from instead
+// of handing a host copy to aml_module_input_set on every frame.
+class ModelSession {
+public:
+    static std::unique_ptr<ModelSession> create(const char* model_path, const SessionConfig& config = SessionConfig());
+    ~ModelSession();
+
+    ModelSession(const ModelSession&) = delete;
+    ModelSession& operator=(const ModelSession&) = delete;
+
+    // Returns a view of input `index` in buffer set `slot`. The buffer is
+    // allocated on the first call; later calls return the same memory.
+    // `size` 0 takes the exact size from the input's TensorDesc; pass a
+    // size only for inputs without tensor info. The NPU reads the buffer
+    // as is, so it must hold data in the input's own format (float input
+    // to a quantized model goes through set_input()). Empty view on failure. Slot 0 is bound to the
+    // context on allocation, other slots only through bind_slot().
+    TensorView input(unsigned int index, size_t size = 0, int slot = 0);
+
+    // Makes the buffers of `slot` the ones read by the next invoke.
+    int bind_slot(int slot);
+
+    // Copies `data` into input `index` through aml_module_input_set, for
+    // inputs that rely on the SDK to convert layout or data type. Use
+    // QTENSOR_RAW_DATA for data already in the model's quantized domain.
+    int set_input(unsigned int index, const void* data, size_t size, const input_info* info = nullptr,
+                  amlnn_input_type type = BINARY_RAW_DATA);
+
+    // Runs inference on the bound inputs. The returned outputs stay valid
+    // until the next run(), or until released when leased.
+    nn_output* run();
+
+    // Items per invoke: the outermost dimension of the inputs and outputs
+    // for models compiled with a batch_multiplier, 1 otherwise.
+    size_t batch_size() const { return batch_; }
+
+    // Runs `items` inputs packed contiguously in `data`, `item_bytes` each,
+    // for input 0 of a single-input model. Batched models take up to
+    // batch_size() items per invoke (a short last batch is zero padded),
+    // batch-1 models one item per invoke. Input 0 is written into its DMA
+    // buffer when input() allocated one (not at all when `data` already
+    // is that buffer), and goes through set_input() with `info` / `type`
+    // otherwise. `outputs` views the invoke's outputs when one invoke
+    // covered every item, valid like run()'s, and holds copies otherwise.
+    int run_batch(const void* data, size_t item_bytes, size_t items, BatchOutputs* outputs,
+                  const input_info* info = nullptr, amlnn_input_type type = BINARY_RAW_DATA);
+
+    // Starts an invoke without waiting for it (invoke_type 1) and returns
+    // its id; -1 when the SDK rejects it, when every output ring entry is
+    // in use, or when kMaxSubmitted invokes are already outstanding (not
+    // yet passed to wait()). The bound inputs must not be touched until
+    // wait() returns.
+    static const int kMaxSubmitted = 4;
+    int64_t submit();
+
+    // Blocks until invoke `invoke_id` finishes (invoke_type 2) and returns
+    // its outputs, valid until the next submit() or run(), or until
+    // released when leased. Outstanding invokes may be waited in any order.
+    nn_output* wait(int64_t invoke_id);
+
+    // Takes the outputs of the last finished run() / wait() out of
+    // rotation. Empty without an output ring. Invokes fail while every
+    // ring entry is leased or in flight.
+    OutputLease lease_output();
+
+    // Runs `runs` invokes on dummy inputs. Without `fill`, input buffers
+    // already allocated through input() are set to the input's zero point
+    // in every slot, which also faults their pages in, and the invokes
+    // cycle over those slots; inputs without a buffer get zero-point data
+    // through set_input(). Call it after the first input() for sessions
+    // fed through DMA buffers. `fill`, when given, writes representative
+    // data for `slot` instead. Warm-up invokes are not recorded in
+    // metrics() or reported to the core scheduler.
+    int warmup(int runs, const std::function<int(ModelSession&, int slot)>& fill = nullptr);
+    const WarmupStats& warmup_stats() const { return warmup_; }
+
+    // Request deadline for the following run() / submit() / wait() calls:
+    // each invoke's timeout is the time left (capped by timeout_ms), and
+    // invokes fail at once, without reaching the NPU, once it has passed.
+    // wait() past the deadline still collects the submitted invoke (bounded
+    // by timeout_ms) and then fails with timed_out() set.
+    void set_deadline(std::chrono::steady_clock::time_point deadline);
+    void clear_deadline() { has_deadline_ = false; }
+    // The last run() / wait() failed on its timeout or an expired deadline.
+    bool timed_out() const { return timed_out_; }
+    // Invokes that reached their timeout on the NPU, or could not be
+    // collected after a deadline. A context that timed out may be stuck and
+    // is best recreated (ModelPool does so); the output ring entries of its
+    // timed-out invokes are not reused, as the NPU may still write them.
+    uint64_t timeouts() const { return timeouts_; }
+
+    void* context() const { return context_; }
+    const SessionConfig& config() const { return config_; }
+    // Time to map the model (first session only) and create the context.
+    double load_ms() const { return load_ms_; }
+    // NPU core the context was placed on, -1 for the SDK default.
+    int core() const { return core_; }
+    // NULL unless profiling is enabled.
+    const NpuMetrics* metrics() const { return metrics_.get(); }
+    // Policy the DMA buffers of input / output `index` are allocated with.
+    DmaPolicy dma_policy(bool output, unsigned int index) const;
+    const DmaFlushStats& flush_stats() const { return flush_stats_; }
+    // Memory report as of the last query. Safe to call from any thread.
+    ModelMemory memory() const;
+    // Queries the NPU and process memory now; call it from the invoking
+    // thread, between invokes.
+    ModelMemory refresh_memory();
+
+    const std::vector<TensorDesc>& inputs() const { return input_descs_; }
+    const std::vector<TensorDesc>& outputs() const { return output_descs_; }
+    const TensorDesc* find_input(const char* name) const;
+    const TensorDesc* find_output(const char* name) const;
+
+private:
+    friend class OutputLease;
+
+    struct DmaBuffer {
+        aml_memory_config_t config;
+        aml_memory_data_t data;
+    };
+
+    enum EntryState { ENTRY_FREE, ENTRY_LATEST, ENTRY_IN_FLIGHT, ENTRY_LEASED };
+
+    struct OutputEntry {
+        std::vector<DmaBuffer> buffers;   // one per output
+        std::vector<nn_buffer_params_t> params;
+        nn_output out;
+        EntryState state = ENTRY_FREE;
+    };
+
+    ModelSession(void* context, const SessionConfig& config);
+    void load_tensor_info();
+    int upload_batch_input(const unsigned char* data, size_t bytes, const input_info* info, amlnn_input_type type);
+    void start_profile(const char* model_path);
+    void collect_profile();
+    void report_invoke(double wall_ms);
+    void record(int slot, const nn_output* out);
+    void add_dma_bytes(uint64_t* counter, uint64_t bytes);
+    int alloc_output_ring();
+    int acquire_entry();
+    nn_output* complete_entry(int entry, nn_output* out);
+    void release_entry(int entry);
+    nn_output* output_get(int invoke_type, int64_t invoke_id);
+    void check_timeout(std::chrono::steady_clock::time_point start);
+    void init_dma_buffer(DmaBuffer* buffer, bool output, unsigned int index, size_t size) const;
+    void flush_inputs();
+    void flush_outputs(OutputEntry& entry);
+
+    void* context_;
+    SessionConfig config_;
+    std::vector<TensorDesc> input_descs_;
+    std::vector<TensorDesc> output_descs_;
+    size_t batch_ = 1;
+    std::vector<unsigned char> batch_staging_;   // zero-padded short batches
+    std::vector<std::vector<DmaBuffer>> slots_;
+    int bound_slot_ = 0;
+    int64_t next_invoke_id_ = 0;
+    std::unique_ptr<NpuMetrics> metrics_;
+    std::shared_ptr<ModelBlob> blob_;   // keeps the mapping alive for the context
+    double load_ms_ = 0;
+    int core_ = -1;
+    int core_ticket_ = -1;
+    double last_inference_ms_ = -1;   // from the profiler, when enabled
+    WarmupStats warmup_;
+    std::vector<OutputEntry> ring_;
+    std::mutex ring_mutex_;
+    int bound_entry_ = -1;
+    int latest_entry_ = -1;
+    // Invokes passed to submit() and not yet to wait(); id 0 is a free record
+    struct SubmittedInvoke {
+        int64_t id = 0;
+        std::chrono::steady_clock::time_point start;
+        int slot = 0;
+        int entry = -1;
+    };
+    SubmittedInvoke submitted_[kMaxSubmitted];
+    std::unique_ptr<TensorRecorder> recorder_;
+    uint64_t recorded_frames_ = 0;
+    // Last set_input() data per input, kept only while recording
+    std::vector<std::pair<TensorDesc, std::vector<unsigned char>>> host_inputs_;
+    mutable std::mutex memory_mutex_;
+    ModelMemory memory_;
+    int invokes_since_memory_ = 0;
+    bool has_deadline_ = false;
+    std::chrono::steady_clock::time_point deadline_;
+    int invoke_timeout_ms_ = 0;         // timeout of the last output_get
+    bool deadline_expired_ = false;
+    bool timed_out_ = false;
+    uint64_t timeouts_ = 0;
+    DmaFlushStats flush_stats_;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef _AMLNN_MPMC_QUEUE_H_
+#define _AMLNN_MPMC_QUEUE_H_
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+// Bounded multi-producer / multi-consumer queue (D. Vyukov's array queue).
+// Each cell carries a sequence number that tells producers and consumers
+// whose turn it is, so push/pop never take a lock. Capacity is rounded up
+// to a power of two.
+template <typename T>
+class MpmcQueue {
+public:
+    explicit MpmcQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells_ = std::vector<Cell>(size);
+        mask_ = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool try_push(T&& value) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells_[pos & mask_];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Approximate number of queued items; exact when the queue is quiescent.
+    size_t size() const {
+        size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T value;
+
+        Cell() = default;
+        // Only used while sizing the queue before it is shared.
+        Cell(Cell&& other) noexcept : sequence(other.sequence.load()), value(std::move(other.value)) {}
+        Cell& operator=(Cell&& other) noexcept {
+            sequence.store(other.sequence.load());
+            value = std::move(other.value);
+            return *this;
+        }
+    };
+
+    std::vector<Cell> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "npu_metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "text_escape.h"
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static const char* kCounterNames[NPU_COUNTER_NUM] = {
+    "inference_us",
+    "hw_op_us",
+    "sw_op_us",
+    "dram_read_bytes",
+    "dram_write_bytes",
+    "sram_read_bytes",
+    "sram_write_bytes",
+};
+
+static const char* kCounterHelp[NPU_COUNTER_NUM] = {
+    "NPU inference time per invoke in microseconds.",
+    "Time spent in NPU hardware ops per invoke in microseconds.",
+    "Time spent in CPU fallback (software) ops per invoke in microseconds.",
+    "DRAM bytes read per invoke.",
+    "DRAM bytes written per invoke.",
+    "SRAM bytes read per invoke.",
+    "SRAM bytes written per invoke.",
+};
+
+const char* NpuMetrics::name(NpuCounter counter) {
+    return counter < NPU_COUNTER_NUM ? kCounterNames[counter] : "unknown";
+}
+
+NpuMetrics::NpuMetrics(const std::string& model, size_t window)
+    : model_(model), window_(window ? window : 1) {
+}
+
+void NpuMetrics::record(const aml_profiling_data_t& data) {
+    double values[NPU_COUNTER_NUM] = {
+        (double)data.inference_time_us,
+        (double)data.ext.us_elapsed_in_hw_op,
+        (double)data.ext.us_elapsed_in_sw_op,
+        (double)data.dram_read_bytes,
+        (double)data.dram_write_bytes,
+        (double)data.sram_read_bytes,
+        (double)data.sram_write_bytes,
+    };
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (data.ext.invoke_has_error) {
+        ++errors_;
+    }
+    for (int i = 0; i < NPU_COUNTER_NUM; ++i) {
+        Series& s = series_[i];
+        double v = values[i];
+        if (s.count == 0 || v < s.min) s.min = v;
+        if (s.count == 0 || v > s.max) s.max = v;
+        s.sum += v;
+        if (s.window.size() < window_) {
+            s.window.push_back(v);
+        } else {
+            s.window[s.count % window_] = v;
+        }
+        ++s.count;
+    }
+}
+
+uint64_t NpuMetrics::invokes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return series_[NPU_INFERENCE_US].count;
+}
+
+uint64_t NpuMetrics::errors() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return errors_;
+}
+
+MetricSummary NpuMetrics::summarize(const Series& s) const {
+    MetricSummary m;
+    m.count = s.count;
+    if (s.count == 0) {
+        return m;
+    }
+    m.min = s.min;
+    m.max = s.max;
+    m.sum = s.sum;
+    m.mean = s.sum / s.count;
+
+    std::vector<double> sorted(s.window);
+    size_t rank = (size_t)(0.99 * (sorted.size() - 1) + 0.5);
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    m.p99 = sorted[rank];
+    return m;
+}
+
+MetricSummary NpuMetrics::summary(NpuCounter counter) const {
+    if (counter >= NPU_COUNTER_NUM) {
+        return MetricSummary();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return summarize(series_[counter]);
+}
+
+std::string NpuMetrics::to_json() const {
+    MetricSummary summaries[NPU_COUNTER_NUM];
+    uint64_t errors;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < NPU_COUNTER_NUM; ++i) summaries[i] = summarize(series_[i]);
+        errors = errors_;
+    }
+
+    std::string out = "{\n  \"model\": \"" + json_escape(model_) + "\",\n";
+    char line[512];
+    snprintf(line, sizeof(line), "  \"invokes\": %llu,\n  \"errors\": %llu,\n  \"metrics\": {\n",
+             (unsigned long long)summaries[NPU_INFERENCE_US].count, (unsigned long long)errors);
+    out += line;
+    for (int i = 0; i < NPU_COUNTER_NUM; ++i) {
+        const MetricSummary& m = summaries[i];
+        snprintf(line, sizeof(line),
+                 "    \"%s\": {\"min\": %.1f, \"mean\": %.1f, \"p99\": %.1f, \"max\": %.1f}%s\n",
+                 kCounterNames[i], m.min, m.mean, m.p99, m.max, i + 1 < NPU_COUNTER_NUM ? "," : "");
+        out += line;
+    }
+    out += "  }\n}\n";
+    return out;
+}
+
+std::string NpuMetrics::to_prometheus() const {
+    MetricSummary summaries[NPU_COUNTER_NUM];
+    uint64_t errors;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int i = 0; i < NPU_COUNTER_NUM; ++i) summaries[i] = summarize(series_[i]);
+        errors = errors_;
+    }
+
+    // quantile 0 / 1 carry min / max; mean is _sum / _count. One sample
+    // per append, the model label is as long as the model path.
+    std::string out;
+    std::string model = "model=\"" + prometheus_label_escape(model_) + "\"";
+    char value[64];
+    auto sample = [&out, &model](const std::string& metric, const char* quantile, const char* text) {
+        out += metric + "{" + model;
+        if (quantile) out += std::string(",quantile=\"") + quantile + "\"";
+        out += std::string("} ") + text + "\n";
+    };
+    for (int i = 0; i < NPU_COUNTER_NUM; ++i) {
+        const MetricSummary& m = summaries[i];
+        std::string name = std::string("amlnn_") + kCounterNames[i];
+        out += "# HELP " + name + " " + kCounterHelp[i] + "\n# TYPE " + name + " summary\n";
+        snprintf(value, sizeof(value), "%.1f", m.min);
+        sample(name, "0", value);
+        snprintf(value, sizeof(value), "%.1f", m.p99);
+        sample(name, "0.99", value);
+        snprintf(value, sizeof(value), "%.1f", m.max);
+        sample(name, "1", value);
+        snprintf(value, sizeof(value), "%.1f", m.sum);
+        sample(name + "_sum", NULL, value);
+        snprintf(value, sizeof(value), "%llu", (unsigned long long)m.count);
+        sample(name + "_count", NULL, value);
+    }
+    out += "# HELP amlnn_invoke_errors_total Invokes the driver reported as failed.\n"
+           "# TYPE amlnn_invoke_errors_total counter\n";
+    snprintf(value, sizeof(value), "%llu", (unsigned long long)errors);
+    sample("amlnn_invoke_errors_total", NULL, value);
+    return out;
+}
+
+int NpuMetrics::write(const char* path) const {
+    size_t len = strlen(path);
+    bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    std::string text = json ? to_json() : to_prometheus();
+
+    FILE* fp = fopen(path, "w");
+    if (NULL == fp) {
+        LOGE("Failed to open metrics file %s", path);
+        return -1;
+    }
+    size_t written = fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+    if (written != text.size()) {
+        LOGE("Failed to write metrics file %s", path);
+        return -1;
+    }
+    return 0;
+}
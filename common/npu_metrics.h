@@ -0,0 +1,73 @@
+#ifndef _AMLNN_NPU_METRICS_H_
+#define _AMLNN_NPU_METRICS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "nn_sdk.h"
+
+// Counters taken from aml_profiling_data_t after every invoke.
+enum NpuCounter {
+    NPU_INFERENCE_US = 0,
+    NPU_HW_OP_US,
+    NPU_SW_OP_US,
+    NPU_DRAM_READ_BYTES,
+    NPU_DRAM_WRITE_BYTES,
+    NPU_SRAM_READ_BYTES,
+    NPU_SRAM_WRITE_BYTES,
+    NPU_COUNTER_NUM
+};
+
+struct MetricSummary {
+    uint64_t count = 0;
+    double min = 0;
+    double mean = 0;
+    double p99 = 0;     // over the most recent `window` invokes
+    double max = 0;
+    double sum = 0;
+};
+
+// Per-invoke NPU profiling counters for one context, aggregated into
+// min / mean / p99 / max. Thread-safe: record() runs on the invoking thread,
+// summaries and exports may be taken from any other.
+class NpuMetrics {
+public:
+    // `model` labels the exported metrics; `window` bounds the samples kept
+    // for percentiles (min, mean and max cover every invoke).
+    explicit NpuMetrics(const std::string& model, size_t window = 4096);
+
+    void record(const aml_profiling_data_t& data);
+
+    uint64_t invokes() const;
+    uint64_t errors() const;
+    MetricSummary summary(NpuCounter counter) const;
+
+    std::string to_json() const;
+    // Prometheus text exposition format, one summary family per counter.
+    std::string to_prometheus() const;
+    // Writes JSON when `path` ends in ".json", Prometheus text otherwise.
+    int write(const char* path) const;
+
+    static const char* name(NpuCounter counter);
+
+private:
+    struct Series {
+        uint64_t count = 0;
+        double min = 0;
+        double max = 0;
+        double sum = 0;
+        std::vector<double> window;   // ring buffer
+    };
+
+    MetricSummary summarize(const Series& series) const;
+
+    std::string model_;
+    size_t window_;
+    mutable std::mutex mutex_;
+    Series series_[NPU_COUNTER_NUM];
+    uint64_t errors_ = 0;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef _AMLNN_OUTPUT_VIEW_H_
+#define _AMLNN_OUTPUT_VIEW_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include "nn_sdk.h"
+
+// Read-only, typed access to one output buffer. With AML_OUTDATA_RAW the
+// SDK returns the model's quantized elements as-is; OutputView<T>
+// dequantizes only the elements a postprocessor actually reads.
+// Postprocessors take the view as a template parameter, so each element
+// type compiles to direct loads.
+template <typename T>
+struct OutputView {
+    const T* data = nullptr;
+    float scale = 1.0f;
+    int zero_point = 0;
+
+    float operator[](size_t i) const { return ((int)data[i] - zero_point) * scale; }
+    T raw(size_t i) const { return data[i]; }
+
+    // Smallest raw value that dequantizes to at least `v`, so a threshold
+    // can be tested on raw elements: raw(i) >= threshold(v) <=> (*this)[i] >= v.
+    // Holds only while reachable(v); past the range of T it saturates at
+    // max, which no element should pass.
+    T threshold(float v) const {
+        float q = std::ceil(v / scale + zero_point);
+        q = std::max(q, (float)std::numeric_limits<T>::lowest());
+        q = std::min(q, (float)std::numeric_limits<T>::max());
+        return (T)q;
+    }
+    // False when no raw value dequantizes to `v` or more.
+    bool reachable(float v) const {
+        return std::ceil(v / scale + zero_point) <= (float)std::numeric_limits<T>::max();
+    }
+};
+
+// AML_OUTDATA_FLOAT32 (or a float model fetched raw).
+template <>
+struct OutputView<float> {
+    const float* data = nullptr;
+
+    float operator[](size_t i) const { return data[i]; }
+    float raw(size_t i) const { return data[i]; }
+    float threshold(float v) const { return v; }
+    bool reachable(float) const { return true; }
+};
+
+// Calls fn(view) with the OutputView matching the element type of `out`.
+// `format` is the aml_output_format_t the outputs were fetched with.
+// Returns -1 when there is no view for the element type (e.g. fp16).
+template <typename Fn>
+int visit_output(const outBuf_t& out, aml_output_format_t format, Fn&& fn) {
+    if (format == AML_OUTDATA_FLOAT32) {
+        OutputView<float> view;
+        view.data = (const float*)out.buf;
+        fn(view);
+        return 0;
+    }
+    if (NULL == out.param) {
+        return -1;
+    }
+
+    const nn_buffer_params_t& param = *out.param;
+    float scale = 1.0f;
+    int zero_point = 0;
+    if (param.quant_format == NN_BUFFER_QUANTIZE_TF_ASYMM) {
+        scale = param.quant_data.affine.scale;
+        zero_point = (int)param.quant_data.affine.zeroPoint;
+    } else if (param.quant_format == NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT) {
+        scale = std::ldexp(1.0f, -(signed char)param.quant_data.dfp.fixed_point_pos);
+    }
+
+    switch (param.data_format) {
+        case NN_BUFFER_FORMAT_FP32: {
+            OutputView<float> view;
+            view.data = (const float*)out.buf;
+            fn(view);
+            return 0;
+        }
+        case NN_BUFFER_FORMAT_INT8: {
+            OutputView<int8_t> view;
+            view.data = (const int8_t*)out.buf; view.scale = scale; view.zero_point = zero_point;
+            fn(view);
+            return 0;
+        }
+        case NN_BUFFER_FORMAT_UINT8: {
+            OutputView<uint8_t> view;
+            view.data = (const uint8_t*)out.buf; view.scale = scale; view.zero_point = zero_point;
+            fn(view);
+            return 0;
+        }
+        case NN_BUFFER_FORMAT_INT16: {
+            OutputView<int16_t> view;
+            view.data = (const int16_t*)out.buf; view.scale = scale; view.zero_point = zero_point;
+            fn(view);
+            return 0;
+        }
+        default:
+            return -1;
+    }
+}
+
+#endif
@@ -0,0 +1,274 @@
+#include "pipeline_init.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static const char* mode_name(InitMode mode) {
+    switch (mode) {
+    case INIT_BACKGROUND: return "background";
+    case INIT_LAZY: return "lazy";
+    default: return "eager";
+    }
+}
+
+std::unique_ptr<PipelineInit> PipelineInit::create(int max_threads) {
+    const char* env = getenv("AMLNN_INIT_THREADS");
+    if (env && *env) {
+        max_threads = atoi(env);
+    }
+    return std::unique_ptr<PipelineInit>(new PipelineInit(std::max(0, max_threads)));
+}
+
+PipelineInit::PipelineInit(int max_threads)
+    : max_threads_(max_threads), start_(std::chrono::steady_clock::now()) {}
+
+PipelineInit::~PipelineInit() {
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+double PipelineInit::now_ms() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+}
+
+int PipelineInit::find(const std::string& name) const {
+    for (size_t i = 0; i < stages_.size(); ++i) {
+        if (stages_[i].timing.name == name) return (int)i;
+    }
+    return -1;
+}
+
+int PipelineInit::add(const std::string& name, std::function<int()> init, InitMode mode,
+                      const std::vector<std::string>& after) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sealed_) {
+        LOGE("PipelineInit: %s added after run() or ensure().", name.c_str());
+        return -1;
+    }
+    if (find(name) >= 0) {
+        LOGE("PipelineInit: stage %s is already added.", name.c_str());
+        return -1;
+    }
+    Stage stage;
+    for (const auto& dep : after) {
+        int index = find(dep);
+        if (index < 0) {
+            LOGE("PipelineInit: %s follows %s, which is not added before it.", name.c_str(), dep.c_str());
+            return -1;
+        }
+        // Workers only take stages that are not lazy; one waiting on a lazy
+        // stage would wait until someone happened to ensure() it
+        if (mode != INIT_LAZY && stages_[index].timing.mode == INIT_LAZY) {
+            LOGE("PipelineInit: %s is %s but follows lazy stage %s.", name.c_str(), mode_name(mode), dep.c_str());
+            return -1;
+        }
+        stage.after.push_back(index);
+    }
+    stage.init = std::move(init);
+    stage.timing.name = name;
+    stage.timing.mode = mode;
+    stages_.push_back(std::move(stage));
+    return 0;
+}
+
+// True once every stage `stage` follows has finished; *status is -1 when
+// one of them failed.
+bool PipelineInit::deps_done(const Stage& stage, int* status) const {
+    *status = 0;
+    for (size_t dep : stage.after) {
+        if (stages_[dep].state != STAGE_DONE) return false;
+        if (stages_[dep].timing.status) *status = -1;
+    }
+    return true;
+}
+
+// Runs a pending stage whose dependencies are done, with the lock released
+// around the stage function.
+void PipelineInit::execute(std::unique_lock<std::mutex>& lock, size_t index, bool inline_run) {
+    Stage& stage = stages_[index];
+    int status = 0;
+    deps_done(stage, &status);
+    stage.state = STAGE_RUNNING;
+    stage.timing.started = true;
+    stage.timing.inline_run = inline_run;
+    stage.timing.start_ms = now_ms();
+    std::function<int()> init = stage.init;
+    lock.unlock();
+
+    bool skipped = status != 0;
+    if (!skipped && init) {
+        status = init() ? -1 : 0;
+    }
+
+    lock.lock();
+    stage.timing.end_ms = now_ms();
+    stage.timing.status = status;
+    stage.timing.finished = true;
+    stage.timing.skipped = skipped;
+    stage.state = STAGE_DONE;
+    if (inline_run) {
+        stage.timing.waited_ms += stage.timing.end_ms - stage.timing.start_ms;
+    }
+    if (skipped) {
+        LOGE("PipelineInit: stage %s skipped, a stage it follows failed.", stage.timing.name.c_str());
+    } else if (status) {
+        LOGE("PipelineInit: stage %s failed.", stage.timing.name.c_str());
+    }
+    cv_.notify_all();
+}
+
+void PipelineInit::worker_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        bool pending = false;
+        int ready = -1;
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            const Stage& stage = stages_[i];
+            if (stage.timing.mode == INIT_LAZY || stage.state != STAGE_PENDING) continue;
+            pending = true;
+            int status = 0;
+            if (deps_done(stage, &status)) {
+                ready = (int)i;
+                break;
+            }
+        }
+        if (ready >= 0) {
+            execute(lock, ready, false);
+        } else if (pending) {
+            // What is left follows stages running elsewhere
+            cv_.wait(lock);
+        } else {
+            return;
+        }
+    }
+}
+
+int PipelineInit::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (started_) {
+        LOGE("PipelineInit: run() called twice.");
+        return -1;
+    }
+    started_ = true;
+    sealed_ = true;
+    int queued = 0;
+    for (const auto& stage : stages_) {
+        if (stage.timing.mode != INIT_LAZY && stage.state == STAGE_PENDING) ++queued;
+    }
+    int threads = max_threads_ > 0 ? std::min(max_threads_, queued) : queued;
+    for (int i = 0; i < threads; ++i) {
+        workers_.emplace_back(&PipelineInit::worker_loop, this);
+    }
+
+    int status = 0;
+    cv_.wait(lock, [this, &status] {
+        status = 0;
+        for (const auto& stage : stages_) {
+            if (stage.timing.mode != INIT_EAGER) continue;
+            if (stage.state != STAGE_DONE) return false;
+            if (stage.timing.status) status = -1;
+        }
+        return true;
+    });
+    ready_ms_ = now_ms();
+    return status;
+}
+
+int PipelineInit::ensure(const std::string& name) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    int index = find(name);
+    if (index < 0) {
+        LOGE("PipelineInit: unknown stage %s", name.c_str());
+        return -1;
+    }
+    // stages_ is fixed from here on, so stages can be referred to unlocked
+    sealed_ = true;
+    if (stages_[index].state == STAGE_DONE) {
+        return stages_[index].timing.status;
+    }
+    std::vector<size_t> after = stages_[index].after;
+    lock.unlock();
+    // A stage that failed leaves the ones following it failed as well, so
+    // the statuses are not needed here
+    for (size_t dep : after) {
+        ensure(stages_[dep].timing.name);
+    }
+
+    lock.lock();
+    Stage& stage = stages_[index];
+    if (stage.state == STAGE_PENDING) {
+        execute(lock, index, true);
+    } else if (stage.state == STAGE_RUNNING) {
+        double start = now_ms();
+        cv_.wait(lock, [&stage] { return stage.state == STAGE_DONE; });
+        stage.timing.waited_ms += now_ms() - start;
+    }
+    return stages_[index].timing.status;
+}
+
+std::vector<InitTiming> PipelineInit::timeline() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<InitTiming> timeline;
+    for (const auto& stage : stages_) {
+        timeline.push_back(stage.timing);
+    }
+    return timeline;
+}
+
+std::string PipelineInit::report() const {
+    std::vector<InitTiming> timeline = this->timeline();
+    double ready_ms;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_ms = ready_ms_;
+    }
+    double total_ms = 0;
+    bool all_done = true;
+    for (const auto& t : timeline) {
+        total_ms = std::max(total_ms, t.finished ? t.end_ms : t.started ? now_ms() : 0);
+        if (t.mode != INIT_LAZY && !t.finished) all_done = false;
+    }
+
+    const int width = 40;
+    std::string out;
+    char line[256];
+    for (const auto& t : timeline) {
+        if (!t.started) {
+            snprintf(line, sizeof(line), "%-16s %-10s %s\n", t.name.c_str(), mode_name(t.mode),
+                     t.mode == INIT_LAZY ? "not used" : "not started");
+            out += line;
+            continue;
+        }
+        double end_ms = t.finished ? t.end_ms : total_ms;
+        std::string bar(width, ' ');
+        if (total_ms > 0) {
+            int from = std::min(width - 1, (int)(t.start_ms / total_ms * width));
+            int to = std::max(from + 1, std::min(width, (int)(end_ms / total_ms * width + 0.5)));
+            std::fill(bar.begin() + from, bar.begin() + to, '#');
+        }
+        int n = snprintf(line, sizeof(line), "%-16s %-10s %8.1f -> %8.1f ms %8.1f ms |%s|", t.name.c_str(),
+                         mode_name(t.mode), t.start_ms, end_ms, end_ms - t.start_ms, bar.c_str());
+        std::string text(line, std::min<size_t>(n > 0 ? n : 0, sizeof(line) - 1));
+        if (t.waited_ms > 0) {
+            snprintf(line, sizeof(line), " waited %.1f ms%s", t.waited_ms, t.inline_run ? " (ran on first use)" : "");
+            text += line;
+        }
+        if (!t.finished) {
+            text += " running";
+        } else if (t.skipped) {
+            text += " SKIPPED";
+        } else if (t.status) {
+            text += " FAILED";
+        }
+        out += text + "\n";
+    }
+    snprintf(line, sizeof(line), "ready after %.1f ms, %s %.1f ms\n", ready_ms,
+             all_done ? "all stages done after" : "stages still running at", total_ms);
+    out += line;
+    return out;
+}
@@ -0,0 +1,107 @@
+#ifndef _AMLNN_PIPELINE_INIT_H_
+#define _AMLNN_PIPELINE_INIT_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum InitMode {
+    INIT_EAGER = 0,        // run() returns once it has finished
+    INIT_BACKGROUND,       // started by run(), which does not wait for it
+    INIT_LAZY,             // runs on the first ensure()
+};
+
+struct InitTiming {
+    std::string name;
+    InitMode mode = INIT_EAGER;
+    bool started = false;
+    bool finished = false;
+    int status = 0;             // of the stage function; -1 also when a stage it follows failed
+    bool skipped = false;       // not run because a stage it follows failed
+    bool inline_run = false;    // ran on the thread that called ensure()
+    double start_ms = 0;        // since create()
+    double end_ms = 0;
+    double waited_ms = 0;       // ensure() callers blocked on it, summed
+};
+
+// Startup of a multi-model pipeline: contexts, warm-up and auxiliary
+// assets (tokenizer, mel filters, text embeddings) as named stages that
+// run concurrently on worker threads once the stages they follow have
+// finished. Stages a request may never need are deferred: INIT_BACKGROUND
+// ones keep loading after run() has returned, INIT_LAZY ones load on
+// first use. Call ensure() before a request touches a stage's result.
+//   init->add("encoder", [&] { return (enc = init_network_file(a)) ? 0 : -1; });
+//   init->add("decoder", [&] { return (dec = init_network_file(b)) ? 0 : -1; });
+//   init->add("warmup", [&] { return warmup_network(enc, dec, 2, &c, &w); },
+//             INIT_EAGER, {"encoder", "decoder"});
+//   init->add("tokenizer", [&] { return load_tokenizer(path); }, INIT_BACKGROUND);
+//   if (init->run()) return -1;
+//   ...
+//   if (init->ensure("tokenizer")) return -1;
+class PipelineInit {
+public:
+    // At most `max_threads` stages at once, 0: one thread per stage.
+    // AMLNN_INIT_THREADS overrides it; AMLNN_INIT_THREADS=1 initializes
+    // one stage after the other, in the order they were added.
+    static std::unique_ptr<PipelineInit> create(int max_threads = 0);
+    // Waits for stages still running.
+    ~PipelineInit();
+
+    PipelineInit(const PipelineInit&) = delete;
+    PipelineInit& operator=(const PipelineInit&) = delete;
+
+    // `init` returns 0 on success. `after` names stages added before this
+    // one; a stage that is not lazy cannot follow a lazy one. Stages are
+    // added before the first run() or ensure().
+    int add(const std::string& name, std::function<int()> init, InitMode mode = INIT_EAGER,
+            const std::vector<std::string>& after = std::vector<std::string>());
+
+    // Starts the eager and background stages and waits for the eager
+    // ones. -1 when one of them failed.
+    int run();
+    // Runs `name`, and the stages it follows, on the calling thread if no
+    // worker has started them yet, otherwise waits for them. Returns the
+    // stage's status; cheap once it has finished.
+    int ensure(const std::string& name);
+
+    std::vector<InitTiming> timeline() const;
+    // One line per stage with a bar on a shared time axis, then the time
+    // to ready (eager stages done) and to all stages done.
+    std::string report() const;
+
+private:
+    enum StageState { STAGE_PENDING, STAGE_RUNNING, STAGE_DONE };
+
+    struct Stage {
+        std::function<int()> init;
+        std::vector<size_t> after;
+        StageState state = STAGE_PENDING;
+        InitTiming timing;
+    };
+
+    explicit PipelineInit(int max_threads);
+    double now_ms() const;
+    void worker_loop();
+    bool deps_done(const Stage& stage, int* status) const;
+    void execute(std::unique_lock<std::mutex>& lock, size_t index, bool inline_run);
+    int find(const std::string& name) const;
+
+    int max_threads_;
+    std::chrono::steady_clock::time_point start_;
+    double ready_ms_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<Stage> stages_;
+    std::vector<std::thread> workers_;
+    bool started_ = false;                  // run() called
+    bool sealed_ = false;                   // run() or ensure() called, no more add()
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "quant_input.h"
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+int InputQuantizer::init(const TensorDesc& desc, int channels, const float* mean, const float* norm) {
+    if (channels < 1) {
+        LOGE("InputQuantizer: invalid channel count %d.", channels);
+        return -1;
+    }
+    channels_ = channels;
+
+    float scale = 1.0f;
+    int zero_point = 0;
+    if (desc.quant_format == NN_BUFFER_QUANTIZE_TF_ASYMM) {
+        scale = desc.scale;
+        zero_point = desc.zero_point;
+    } else if (desc.quant_format == NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT) {
+        scale = std::ldexp(1.0f, -desc.fixed_point_pos);
+    }
+    if (scale <= 0.0f) {
+        LOGE("InputQuantizer: invalid input scale %f.", scale);
+        return -1;
+    }
+
+    bool is_8bit = desc.format == NN_BUFFER_FORMAT_INT8 || desc.format == NN_BUFFER_FORMAT_UINT8;
+    element_size_ = is_8bit ? 1 : sizeof(float);
+    is_signed_ = desc.format == NN_BUFFER_FORMAT_INT8;
+    int qmin = is_signed_ ? -128 : 0;
+    int qmax = is_signed_ ? 127 : 255;
+
+    lut8_.assign(is_8bit ? channels * 256 : 0, 0);
+    lutf_.assign(is_8bit ? 0 : channels * 256, 0.0f);
+    for (int c = 0; c < channels; ++c) {
+        float m = mean ? mean[c] : 0.0f;
+        float n = norm ? norm[c] : 1.0f;
+        for (int p = 0; p < 256; ++p) {
+            float value = (p - m) * n;
+            if (!is_8bit) {
+                lutf_[c * 256 + p] = value;
+                continue;
+            }
+            int q = (int)std::lround(value / scale) + zero_point;
+            lut8_[c * 256 + p] = (uint8_t)(int8_t)std::min(qmax, std::max(qmin, q));
+        }
+    }
+    return 0;
+}
+
+template <typename T>
+void InputQuantizer::map(const uint8_t* src, size_t pixels, T* dst, const T* lut, bool planar) const {
+    const int channels = channels_;
+    if (planar) {
+        for (int c = 0; c < channels; ++c) {
+            const T* table = lut + c * 256;
+            T* plane = dst + c * pixels;
+            for (size_t i = 0; i < pixels; ++i) {
+                plane[i] = table[src[i * channels + c]];
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < pixels; ++i) {
+        for (int c = 0; c < channels; ++c) {
+            dst[i * channels + c] = lut[c * 256 + src[i * channels + c]];
+        }
+    }
+}
+
+void InputQuantizer::apply(const uint8_t* src, size_t pixels, void* dst) const {
+    if (quantized()) {
+        map(src, pixels, (uint8_t*)dst, lut8_.data(), false);
+    } else {
+        map(src, pixels, (float*)dst, lutf_.data(), false);
+    }
+}
+
+void InputQuantizer::apply_planar(const uint8_t* src, size_t pixels, void* dst) const {
+    if (quantized()) {
+        map(src, pixels, (uint8_t*)dst, lut8_.data(), true);
+    } else {
+        map(src, pixels, (float*)dst, lutf_.data(), true);
+    }
+}
+
+amlnn_input_type InputQuantizer::describe(aml_input_format_t layout, input_info* info) const {
+    memset(info, 0, sizeof(input_info));
+    info->valid = 1;
+    info->input_format = layout;
+    if (quantized()) {
+        info->input_data_type = is_signed_ ? AML_INPUT_I8 : AML_INPUT_U8;
+        return QTENSOR_RAW_DATA;
+    }
+    info->input_data_type = AML_INPUT_FP32;
+    return BINARY_RAW_DATA;
+}
+
+int InputQuantizer::upload(ModelSession& session, unsigned int index, const void* data, size_t pixels,
+                           aml_input_format_t layout) const {
+    input_info info;
+    amlnn_input_type type = describe(layout, &info);
+    return session.set_input(index, data, bytes(pixels), &info, type);
+}
@@ -0,0 +1,48 @@
+#ifndef _AMLNN_QUANT_INPUT_H_
+#define _AMLNN_QUANT_INPUT_H_
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "model_session.h"
+
+// Maps 8-bit pixels straight into a model input's quantized domain through
+// one 256-entry table per channel, replacing the float normalize pass and
+// the per-element quantize pass:
+//     value = (pixel - mean[c]) * norm[c]
+//     q     = saturate(round(value / scale + zero_point))
+// scale / zero_point come from the input's TensorDesc. Inputs that are not
+// 8-bit quantized get the float value, which upload() lets the SDK convert.
+class InputQuantizer {
+public:
+    // `mean` and `norm` hold `channels` values each; NULL means 0 and 1.
+    int init(const TensorDesc& desc, int channels, const float* mean = NULL, const float* norm = NULL);
+
+    // Interleaved (HWC) pixels to interleaved tensor data.
+    void apply(const uint8_t* src, size_t pixels, void* dst) const;
+    // Interleaved (HWC) pixels to planar (CHW) tensor data.
+    void apply_planar(const uint8_t* src, size_t pixels, void* dst) const;
+
+    // Sends data produced by apply()/apply_planar() to input `index`:
+    // QTENSOR_RAW_DATA for quantized inputs, float BINARY_RAW_DATA otherwise.
+    int upload(ModelSession& session, unsigned int index, const void* data, size_t pixels,
+               aml_input_format_t layout) const;
+    // The input_info and input type upload() hands to set_input(), for
+    // callers that feed the data themselves (e.g. ModelSession::run_batch).
+    amlnn_input_type describe(aml_input_format_t layout, input_info* info) const;
+
+    bool quantized() const { return element_size_ == 1; }
+    size_t bytes(size_t pixels) const { return pixels * channels_ * element_size_; }
+
+private:
+    template <typename T>
+    void map(const uint8_t* src, size_t pixels, T* dst, const T* lut, bool planar) const;
+
+    int channels_ = 0;
+    size_t element_size_ = 0;
+    bool is_signed_ = false;
+    std::vector<uint8_t> lut8_;   // channels * 256, int8 stored as two's complement
+    std::vector<float> lutf_;
+};
+
+#endif
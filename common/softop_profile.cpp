@@ -0,0 +1,149 @@
+#include "softop_profile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+std::string softop_profile_path(const char* model_path) {
+    return std::string(model_path) + ".softop";
+}
+
+static SoftopOp* find_op(SoftopProfile* profile, long id) {
+    for (auto& op : profile->ops) {
+        if ((long)op.op == id) return &op;
+    }
+    SoftopOp op;
+    op.op = (aml_operator_t)id;
+    op.openmp = profile->openmp;
+    op.openmp_threads = profile->openmp_threads;
+    op.neon = profile->neon;
+    profile->ops.push_back(op);
+    return &profile->ops.back();
+}
+
+int load_softop_profile(const char* path, SoftopProfile* profile) {
+    FILE* fp = fopen(path, "r");
+    if (NULL == fp) {
+        return -1;
+    }
+
+    SoftopProfile loaded;
+    char line[256];
+    int line_no = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        ++line_no;
+        char* p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        char key[128];
+        long value;
+        if (sscanf(p, "%127[^=]=%ld", key, &value) != 2) {
+            LOGE("%s:%d: expected key=value", path, line_no);
+            ret = -1;
+            break;
+        }
+
+        bool* flag = NULL;
+        int* threads = NULL;
+        const char* field = key;
+        if (strncmp(key, "op.", 3) == 0) {
+            char* end = NULL;
+            long id = strtol(key + 3, &end, 10);
+            if (end == key + 3 || *end != '.') {
+                LOGE("%s:%d: bad operator key %s", path, line_no, key);
+                ret = -1;
+                break;
+            }
+            SoftopOp* op = find_op(&loaded, id);
+            field = end + 1;
+            if (strcmp(field, "openmp") == 0) flag = &op->openmp;
+            else if (strcmp(field, "neon") == 0) flag = &op->neon;
+            else if (strcmp(field, "openmp_threads") == 0) threads = &op->openmp_threads;
+        } else {
+            if (strcmp(field, "openmp") == 0) flag = &loaded.openmp;
+            else if (strcmp(field, "neon") == 0) flag = &loaded.neon;
+            else if (strcmp(field, "openmp_threads") == 0) threads = &loaded.openmp_threads;
+        }
+
+        if (flag) {
+            *flag = value != 0;
+        } else if (threads && value > 0 && value <= 127) {
+            *threads = (int)value;
+        } else {
+            LOGE("%s:%d: unknown or invalid setting %s", path, line_no, key);
+            ret = -1;
+            break;
+        }
+    }
+    fclose(fp);
+
+    if (ret == 0) {
+        *profile = loaded;
+    }
+    return ret;
+}
+
+int save_softop_profile(const char* path, const SoftopProfile& profile, const char* comment) {
+    FILE* fp = fopen(path, "w");
+    if (NULL == fp) {
+        LOGE("Failed to open %s", path);
+        return -1;
+    }
+    if (comment) {
+        fprintf(fp, "# %s\n", comment);
+    }
+    fprintf(fp, "openmp=%d\nopenmp_threads=%d\nneon=%d\n", profile.openmp, profile.openmp_threads, profile.neon);
+    for (const auto& op : profile.ops) {
+        fprintf(fp, "op.%ld.openmp=%d\nop.%ld.openmp_threads=%d\nop.%ld.neon=%d\n",
+                (long)op.op, op.openmp, (long)op.op, op.openmp_threads, (long)op.op, op.neon);
+    }
+    int ret = ferror(fp) ? -1 : 0;
+    fclose(fp);
+    return ret;
+}
+
+SoftopOptions::SoftopOptions(const SoftopProfile& profile) {
+    // Operator-specific entries first, then the catch-all for every other op.
+    for (const auto& op : profile.ops) {
+        aml_openmp_opt_t omp;
+        memset(&omp, 0, sizeof(aml_openmp_opt_t));
+        omp.operator_type = op.op;
+        omp.enable_openmp = op.openmp;
+        omp.involve_all_ops = false;
+        omp.openmp_num = (int8_t)op.openmp_threads;
+        openmp_.push_back(omp);
+
+        aml_neon_opt_t neon;
+        memset(&neon, 0, sizeof(aml_neon_opt_t));
+        neon.operator_type = op.op;
+        neon.enable_neon = op.neon;
+        neon.involve_all_ops = false;
+        neon_.push_back(neon);
+    }
+
+    aml_openmp_opt_t omp;
+    memset(&omp, 0, sizeof(aml_openmp_opt_t));
+    omp.operator_type = AML_Unknown;
+    omp.enable_openmp = profile.openmp;
+    omp.involve_all_ops = true;
+    omp.openmp_num = (int8_t)profile.openmp_threads;
+    openmp_.push_back(omp);
+
+    aml_neon_opt_t neon;
+    memset(&neon, 0, sizeof(aml_neon_opt_t));
+    neon.operator_type = AML_Unknown;
+    neon.enable_neon = profile.neon;
+    neon.involve_all_ops = true;
+    neon_.push_back(neon);
+}
+
+void SoftopOptions::apply(softOpInfo_t* info) {
+    info->set_openmp_opt_flag = true;
+    info->openmp_opt_num = (int)openmp_.size();
+    info->openmp_opt = openmp_.data();
+    info->set_neon_opt_flag = true;
+    info->neon_opt_num = (int)neon_.size();
+    info->neon_opt = neon_.data();
+}
@@ -0,0 +1,49 @@
+#ifndef _AMLNN_SOFTOP_PROFILE_H_
+#define _AMLNN_SOFTOP_PROFILE_H_
+
+#include <string>
+#include <vector>
+#include "nn_sdk.h"
+
+// Per-operator override of the model-wide CPU fallback settings.
+struct SoftopOp {
+    aml_operator_t op = AML_Unknown;
+    bool openmp = true;
+    int openmp_threads = 2;
+    bool neon = true;
+};
+
+// OpenMP / NEON settings for the ops a model runs on the CPU. The defaults
+// match what init_network has always used: 2 OpenMP threads and NEON for
+// all ops. softop_tuner benchmarks alternatives and saves the best one as
+// "<model>.softop", which init_network picks up automatically.
+struct SoftopProfile {
+    bool openmp = true;
+    int openmp_threads = 2;
+    bool neon = true;
+    std::vector<SoftopOp> ops;
+};
+
+// "<model_path>.softop"
+std::string softop_profile_path(const char* model_path);
+
+// Text file of key=value lines:
+//   openmp=1  openmp_threads=4  neon=1
+//   op.<aml_operator_t>.openmp=0  op.<id>.openmp_threads=1  op.<id>.neon=1
+// Returns -1 when the file is missing or malformed.
+int load_softop_profile(const char* path, SoftopProfile* profile);
+int save_softop_profile(const char* path, const SoftopProfile& profile, const char* comment = NULL);
+
+// Owns the aml_openmp_opt_t / aml_neon_opt_t arrays that softOpInfo_t
+// points to; it must outlive the aml_module_create call it is applied to.
+class SoftopOptions {
+public:
+    explicit SoftopOptions(const SoftopProfile& profile);
+    void apply(softOpInfo_t* info);
+
+private:
+    std::vector<aml_openmp_opt_t> openmp_;
+    std::vector<aml_neon_opt_t> neon_;
+};
+
+#endif
@@ -0,0 +1,205 @@
+#include "tensor_dump.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+static size_t padded(size_t size) {
+    return (size + kAmltAlign - 1) & ~(kAmltAlign - 1);
+}
+
+std::unique_ptr<TensorRecorder> TensorRecorder::open(const char* path) {
+    FILE* fp = fopen(path, "wb");
+    if (NULL == fp) {
+        LOGE("TensorRecorder: cannot create %s", path);
+        return nullptr;
+    }
+    std::unique_ptr<TensorRecorder> recorder(new TensorRecorder());
+    recorder->fp_ = fp;
+    recorder->path_ = path;
+    return recorder;
+}
+
+TensorRecorder::~TensorRecorder() {
+    if (fp_) {
+        fclose(fp_);
+    }
+}
+
+int TensorRecorder::write(AmltKind kind, uint64_t frame, const TensorDesc& desc, const void* data, size_t size,
+                          int out_format) {
+    AmltHeader header;
+    memset(&header, 0, sizeof(AmltHeader));
+    memcpy(header.magic, "AMLT", 4);
+    header.version = kAmltVersion;
+    header.header_size = sizeof(AmltHeader);
+    header.kind = kind;
+    header.frame = frame;
+    header.index = desc.index;
+    header.format = desc.format;
+    header.quant_format = desc.quant_format;
+    header.scale = desc.scale;
+    header.zero_point = desc.zero_point;
+    header.fixed_point_pos = desc.fixed_point_pos;
+    header.out_format = out_format;
+    header.dim_count = desc.dims.size() < MAX_TENSOR_NUM_DIMS ? desc.dims.size() : MAX_TENSOR_NUM_DIMS;
+    for (uint32_t d = 0; d < header.dim_count; ++d) header.dims[d] = desc.dims[d];
+    header.data_size = size;
+    snprintf(header.name, MAX_NAME_LENGTH, "%s", desc.name.c_str());
+
+    static const unsigned char zeros[kAmltAlign] = {0};
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fwrite(&header, sizeof(AmltHeader), 1, fp_) != 1 ||
+        (size && fwrite(data, size, 1, fp_) != 1) ||
+        fwrite(zeros, padded(size) - size, 1, fp_) > 1) {
+        LOGE("TensorRecorder: write fail for %s", path_.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+int TensorRecorder::write_outputs(uint64_t frame, const nn_output* out, const std::vector<TensorDesc>& descs,
+                                  aml_output_format_t format) {
+    for (unsigned int i = 0; i < out->num && i < OUTPUT_MAX_NUM; ++i) {
+        const outBuf_t& buf = out->out[i];
+        TensorDesc desc;
+        if (i < descs.size()) {
+            desc = descs[i];
+        } else {
+            desc.index = i;
+            desc.name.assign(buf.name, strnlen(buf.name, MAX_NAME_LENGTH));
+            if (buf.param) {
+                // nn_buffer_params_t lists sizes innermost first
+                for (unsigned int d = buf.param->num_of_dims; d > 0; --d) desc.dims.push_back(buf.param->sizes[d - 1]);
+                desc.format = buf.param->data_format;
+                desc.quant_format = buf.param->quant_format;
+                if (desc.quant_format == NN_BUFFER_QUANTIZE_TF_ASYMM) {
+                    desc.scale = buf.param->quant_data.affine.scale;
+                    desc.zero_point = (int)buf.param->quant_data.affine.zeroPoint;
+                } else if (desc.quant_format == NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT) {
+                    desc.fixed_point_pos = buf.param->quant_data.dfp.fixed_point_pos;
+                }
+            }
+        }
+        if (write(AMLT_OUTPUT, frame, desc, buf.buf, buf.size, format)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+std::unique_ptr<TensorReplay> TensorReplay::open(const char* path) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOGE("TensorReplay: cannot open %s", path);
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(AmltHeader)) {
+        LOGE("TensorReplay: %s is empty", path);
+        close(fd);
+        return nullptr;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOGE("TensorReplay: mmap fail for %s", path);
+        return nullptr;
+    }
+
+    std::unique_ptr<TensorReplay> replay(new TensorReplay());
+    replay->map_ = map;
+    replay->size_ = st.st_size;
+
+    unsigned char* base = (unsigned char*)map;
+    size_t offset = 0;
+    while (offset + sizeof(AmltHeader) <= replay->size_) {
+        const AmltHeader* header = (const AmltHeader*)(base + offset);
+        if (memcmp(header->magic, "AMLT", 4) != 0 || header->version != kAmltVersion ||
+            header->header_size != sizeof(AmltHeader) || header->dim_count > MAX_TENSOR_NUM_DIMS ||
+            header->data_size > replay->size_ - offset - sizeof(AmltHeader)) {
+            LOGE("TensorReplay: bad tensor header at offset %zu in %s", offset, path);
+            return nullptr;
+        }
+        if (replay->frames_.empty() || replay->frames_.back().id != header->frame) {
+            replay->frames_.emplace_back();
+            replay->frames_.back().id = header->frame;
+        }
+        ReplayTensor t;
+        t.header = header;
+        t.data = base + offset + sizeof(AmltHeader);
+        t.size = header->data_size;
+        t.desc.index = header->index;
+        t.desc.name.assign(header->name, strnlen(header->name, MAX_NAME_LENGTH));
+        t.desc.elements = header->dim_count ? 1 : 0;
+        for (uint32_t d = 0; d < header->dim_count; ++d) {
+            t.desc.dims.push_back(header->dims[d]);
+            t.desc.elements *= header->dims[d];
+        }
+        t.desc.format = (nn_buffer_format_e)header->format;
+        t.desc.quant_format = (nn_buffer_quantize_format_e)header->quant_format;
+        t.desc.scale = header->scale;
+        t.desc.zero_point = header->zero_point;
+        t.desc.fixed_point_pos = header->fixed_point_pos;
+        t.desc.bytes = t.desc.elements * tensor_format_size(t.desc.format);
+        Frame& frame = replay->frames_.back();
+        (header->kind == AMLT_INPUT ? frame.inputs : frame.outputs).push_back(t);
+        offset += sizeof(AmltHeader) + padded(header->data_size);
+    }
+
+    for (Frame& frame : replay->frames_) {
+        memset(&frame.out, 0, sizeof(nn_output));
+        frame.out.typeSize = sizeof(nn_output);
+        frame.params.resize(frame.outputs.size());
+        for (size_t i = 0; i < frame.outputs.size() && i < OUTPUT_MAX_NUM; ++i) {
+            const ReplayTensor& t = frame.outputs[i];
+            nn_buffer_params_t& param = frame.params[i];
+            memset(&param, 0, sizeof(nn_buffer_params_t));
+            param.num_of_dims = t.desc.dims.size() < 4 ? t.desc.dims.size() : 4;
+            for (unsigned int d = 0; d < param.num_of_dims; ++d) param.sizes[d] = t.desc.dims[t.desc.dims.size() - 1 - d];
+            param.data_format = t.desc.format;
+            param.quant_format = t.desc.quant_format;
+            if (t.desc.quant_format == NN_BUFFER_QUANTIZE_TF_ASYMM) {
+                param.quant_data.affine.scale = t.desc.scale;
+                param.quant_data.affine.zeroPoint = (unsigned int)t.desc.zero_point;
+            } else if (t.desc.quant_format == NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT) {
+                param.quant_data.dfp.fixed_point_pos = (unsigned char)t.desc.fixed_point_pos;
+            }
+            outBuf_t& out = frame.out.out[i];
+            out.size = t.size;
+            out.buf = t.data;
+            out.param = &param;
+            out.out_format = (aml_output_format_t)t.header->out_format;
+            out.output_valid_length = t.size;
+            snprintf(out.name, MAX_NAME_LENGTH, "%s", t.desc.name.c_str());
+            frame.out.num = i + 1;
+        }
+    }
+    return replay;
+}
+
+TensorReplay::~TensorReplay() {
+    if (map_) {
+        munmap(map_, size_);
+    }
+}
+
+aml_output_format_t TensorReplay::output_format(size_t frame) const {
+    const std::vector<ReplayTensor>& outputs = frames_[frame].outputs;
+    return outputs.empty() ? AML_OUTDATA_FLOAT32 : (aml_output_format_t)outputs[0].header->out_format;
+}
+
+std::vector<TensorDesc> TensorReplay::output_descs(size_t frame) const {
+    std::vector<TensorDesc> descs;
+    for (const ReplayTensor& t : frames_[frame].outputs) descs.push_back(t.desc);
+    return descs;
+}
+
+std::vector<TensorDesc> TensorReplay::input_descs(size_t frame) const {
+    std::vector<TensorDesc> descs;
+    for (const ReplayTensor& t : frames_[frame].inputs) descs.push_back(t.desc);
+    return descs;
+}
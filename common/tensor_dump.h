@@ -0,0 +1,123 @@
+#ifndef _AMLNN_TENSOR_DUMP_H_
+#define _AMLNN_TENSOR_DUMP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "nn_sdk.h"
+#include "model_session.h"
+
+// AMLT tensor dumps: a stream of tensors, each a 256-byte header followed
+// by its data padded to 64 bytes, so every tensor's data is 64-byte
+// aligned in an mmap of the file. Tensors of one invoke share a frame
+// number; a frame holds its inputs as handed to the SDK and its outputs
+// as returned by aml_module_output_get.
+enum AmltKind {
+    AMLT_INPUT = 0,
+    AMLT_OUTPUT = 1,
+};
+
+static const uint32_t kAmltVersion = 1;
+static const size_t kAmltAlign = 64;
+
+struct AmltHeader {
+    char magic[4];              // "AMLT"
+    uint32_t version;
+    uint32_t header_size;       // sizeof(AmltHeader)
+    uint32_t kind;              // AmltKind
+    uint64_t frame;
+    uint32_t index;             // input / output index
+    uint32_t format;            // nn_buffer_format_e of the model tensor
+    uint32_t quant_format;      // nn_buffer_quantize_format_e
+    float scale;
+    int32_t zero_point;
+    int32_t fixed_point_pos;
+    int32_t out_format;         // aml_output_format_t of the data; -1 for inputs
+    uint32_t dim_count;
+    uint32_t dims[MAX_TENSOR_NUM_DIMS];   // outermost first
+    uint64_t data_size;
+    char name[MAX_NAME_LENGTH];
+    uint8_t reserved[104];
+};
+
+static_assert(sizeof(AmltHeader) == 256, "AmltHeader must stay 256 bytes");
+
+// Appends tensors to an AMLT file. Thread-safe.
+class TensorRecorder {
+public:
+    // Truncates `path`. NULL on failure.
+    static std::unique_ptr<TensorRecorder> open(const char* path);
+    ~TensorRecorder();
+
+    TensorRecorder(const TensorRecorder&) = delete;
+    TensorRecorder& operator=(const TensorRecorder&) = delete;
+
+    int write(AmltKind kind, uint64_t frame, const TensorDesc& desc, const void* data, size_t size,
+              int out_format = -1);
+    // Every output of `out`; `descs` may be empty, the shape and
+    // quantization then come from the outputs' nn_buffer_params_t.
+    int write_outputs(uint64_t frame, const nn_output* out, const std::vector<TensorDesc>& descs,
+                      aml_output_format_t format);
+
+    const std::string& path() const { return path_; }
+
+private:
+    TensorRecorder() = default;
+
+    FILE* fp_ = nullptr;
+    std::string path_;
+    std::mutex mutex_;
+};
+
+struct ReplayTensor {
+    const AmltHeader* header = nullptr;
+    unsigned char* data = nullptr;
+    size_t size = 0;
+    TensorDesc desc;            // shape and quantization of the model tensor
+};
+
+// Read-only mmap of an AMLT file (copy-on-write, so postprocessing that
+// scribbles over its outputs does not touch the file). Frames are indexed
+// in file order.
+class TensorReplay {
+public:
+    static std::unique_ptr<TensorReplay> open(const char* path);
+    ~TensorReplay();
+
+    TensorReplay(const TensorReplay&) = delete;
+    TensorReplay& operator=(const TensorReplay&) = delete;
+
+    size_t frames() const { return frames_.size(); }
+    uint64_t frame_id(size_t frame) const { return frames_[frame].id; }
+    const std::vector<ReplayTensor>& inputs(size_t frame) const { return frames_[frame].inputs; }
+    const std::vector<ReplayTensor>& outputs(size_t frame) const { return frames_[frame].outputs; }
+
+    // The frame's outputs as an nn_output, for postprocessing written
+    // against aml_module_output_get. Valid while the replay is open.
+    const nn_output* output(size_t frame) const { return &frames_[frame].out; }
+    // Format the outputs were fetched in (AML_OUTDATA_FLOAT32 or RAW).
+    aml_output_format_t output_format(size_t frame) const;
+    std::vector<TensorDesc> output_descs(size_t frame) const;
+    std::vector<TensorDesc> input_descs(size_t frame) const;
+
+private:
+    struct Frame {
+        uint64_t id = 0;
+        std::vector<ReplayTensor> inputs;
+        std::vector<ReplayTensor> outputs;
+        std::vector<nn_buffer_params_t> params;
+        nn_output out;
+    };
+
+    TensorReplay() = default;
+
+    void* map_ = nullptr;
+    size_t size_ = 0;
+    std::vector<Frame> frames_;
+};
+
+#endif
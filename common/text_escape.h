@@ -0,0 +1,47 @@
+#ifndef _AMLNN_TEXT_ESCAPE_H_
+#define _AMLNN_TEXT_ESCAPE_H_
+
+#include <cstdio>
+#include <string>
+
+// Contents of a JSON string: quotes, backslashes and control characters
+// escaped. Model paths and stage names go through it before they are
+// written between quotes.
+inline std::string json_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+                out += code;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out;
+}
+
+// Prometheus label value: the exposition format escapes only backslash,
+// double quote and line feed.
+inline std::string prometheus_label_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        default: out += c;
+        }
+    }
+    return out;
+}
+
+#endif
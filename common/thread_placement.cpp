@@ -0,0 +1,249 @@
+#include "thread_placement.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <sys/resource.h>
+
+#define LOGE(...) do { fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+double wall_ms() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double thread_cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+double process_cpu_ms() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3 +
+           usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+}
+
+// "0-3,6" into a sorted list; empty on a parse error.
+static std::vector<int> parse_ranges(const char* text) {
+    std::vector<int> cpus;
+    const char* p = text;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0) return std::vector<int>();
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first) return std::vector<int>();
+            p = end;
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) cpus.push_back((int)cpu);
+        if (*p == ',') ++p;
+        else if (*p && *p != '\n') return std::vector<int>();
+        else break;
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::vector<CpuInfo> cpu_topology() {
+    std::vector<CpuInfo> topology;
+    char text[256] = {0};
+    FILE* fp = fopen("/sys/devices/system/cpu/online", "r");
+    if (fp) {
+        if (!fgets(text, sizeof(text), fp)) text[0] = '\0';
+        fclose(fp);
+    }
+    std::vector<int> online = parse_ranges(text);
+    if (online.empty()) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && cpu < 64; ++cpu) {
+            char path[96];
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+            FILE* probe = fopen(path, "r");
+            if (!probe) break;
+            fclose(probe);
+            online.push_back(cpu);
+        }
+    }
+    for (int cpu : online) {
+        CpuInfo info;
+        info.cpu = cpu;
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+        FILE* freq = fopen(path, "r");
+        if (freq) {
+            if (fscanf(freq, "%u", &info.max_khz) != 1) info.max_khz = 0;
+            fclose(freq);
+        }
+        topology.push_back(info);
+    }
+    return topology;
+}
+
+static std::vector<int> cluster(bool big) {
+    std::vector<CpuInfo> topology = cpu_topology();
+    unsigned int fastest = 0;
+    for (const CpuInfo& info : topology) fastest = std::max(fastest, info.max_khz);
+    std::vector<int> selected, all;
+    for (const CpuInfo& info : topology) {
+        all.push_back(info.cpu);
+        if ((info.max_khz == fastest) == big) selected.push_back(info.cpu);
+    }
+    return selected.empty() ? all : selected;
+}
+
+std::vector<int> big_cpus() {
+    return cluster(true);
+}
+
+std::vector<int> little_cpus() {
+    return cluster(false);
+}
+
+std::vector<int> parse_cpu_list(const char* text) {
+    if (NULL == text) return std::vector<int>();
+    if (strcmp(text, "big") == 0) return big_cpus();
+    if (strcmp(text, "little") == 0) return little_cpus();
+    if (strcmp(text, "all") == 0) {
+        std::vector<int> cpus;
+        for (const CpuInfo& info : cpu_topology()) cpus.push_back(info.cpu);
+        return cpus;
+    }
+    return parse_ranges(text);
+}
+
+ThreadPlacement& ThreadPlacement::instance() {
+    static ThreadPlacement placement;
+    return placement;
+}
+
+ThreadPlacement::ThreadPlacement() {
+    const char* env = getenv("AMLNN_CPUS");
+    if (NULL == env) {
+        return;
+    }
+    std::string spec(env);
+    size_t pos = 0;
+    while (pos < spec.size()) {
+        size_t end = spec.find(';', pos);
+        if (end == std::string::npos) end = spec.size();
+        std::string entry = spec.substr(pos, end - pos);
+        pos = end + 1;
+        size_t eq = entry.find('=');
+        if (eq == std::string::npos || eq == 0) {
+            if (!entry.empty()) LOGE("AMLNN_CPUS: ignoring \"%s\", expected stage=cpus.", entry.c_str());
+            continue;
+        }
+        std::vector<int> cpus = parse_cpu_list(entry.c_str() + eq + 1);
+        if (cpus.empty()) {
+            LOGE("AMLNN_CPUS: bad CPU list in \"%s\".", entry.c_str());
+            continue;
+        }
+        stages_[entry.substr(0, eq)].cpus = cpus;
+    }
+}
+
+void ThreadPlacement::declare(const std::string& stage, const std::vector<int>& cpus) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StageStats& s = stages_[stage];
+    s.stage = stage;
+    s.cpus = cpus;
+}
+
+std::vector<int> ThreadPlacement::cpus(const std::string& stage) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = stages_.find(stage);
+    return it == stages_.end() ? std::vector<int>() : it->second.cpus;
+}
+
+int ThreadPlacement::threads(const std::string& stage, int fallback) const {
+    std::vector<int> set = cpus(stage);
+    return set.empty() ? fallback : (int)set.size();
+}
+
+int ThreadPlacement::pin(const std::string& stage) {
+    std::vector<int> set = cpus(stage);
+    if (set.empty()) {
+        return 0;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : set) CPU_SET(cpu, &mask);
+    if (sched_setaffinity(0, sizeof(cpu_set_t), &mask)) {
+        LOGE("sched_setaffinity fail for stage %s.", stage.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+void ThreadPlacement::record(const std::string& stage, double thread_cpu_ms, double process_cpu_ms,
+                             double wall_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StageStats& s = stages_[stage];
+    s.calls++;
+    s.thread_cpu_ms += thread_cpu_ms;
+    s.process_cpu_ms += process_cpu_ms;
+    s.wall_ms += wall_ms;
+}
+
+std::vector<StageStats> ThreadPlacement::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<StageStats> result;
+    for (const auto& it : stages_) {
+        result.push_back(it.second);
+        result.back().stage = it.first;
+    }
+    return result;
+}
+
+std::string ThreadPlacement::report() const {
+    std::string text;
+    for (const StageStats& s : stats()) {
+        std::string set;
+        for (size_t i = 0; i < s.cpus.size(); ++i) {
+            set += (i ? "," : "") + std::to_string(s.cpus[i]);
+        }
+        char line[256];
+        double calls = s.calls ? (double)s.calls : 1;
+        snprintf(line, sizeof(line),
+                 "%-8s cpus %-12s calls %-8llu cpu %8.2f ms/call (process %8.2f)  wall %8.2f ms/call\n",
+                 s.stage.c_str(), set.empty() ? "any" : set.c_str(), (unsigned long long)s.calls,
+                 s.thread_cpu_ms / calls, s.process_cpu_ms / calls, s.wall_ms / calls);
+        text += line;
+    }
+    return text;
+}
+
+StageScope::StageScope(const char* stage) : stage_(stage && stage[0] ? stage : NULL) {
+    if (NULL == stage_) {
+        return;
+    }
+    std::vector<int> set = ThreadPlacement::instance().cpus(stage_);
+    if (!set.empty() && sched_getaffinity(0, sizeof(cpu_set_t), &previous_) == 0) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        for (int cpu : set) CPU_SET(cpu, &mask);
+        if (!CPU_EQUAL(&mask, &previous_)) {
+            restore_ = sched_setaffinity(0, sizeof(cpu_set_t), &mask) == 0;
+        }
+    }
+    cpu_start_ = thread_cpu_ms();
+    process_cpu_start_ = process_cpu_ms();
+    wall_start_ = wall_ms();
+}
+
+StageScope::~StageScope() {
+    if (NULL == stage_) {
+        return;
+    }
+    ThreadPlacement::instance().record(stage_, thread_cpu_ms() - cpu_start_, process_cpu_ms() - process_cpu_start_,
+                                       wall_ms() - wall_start_);
+    if (restore_) {
+        sched_setaffinity(0, sizeof(cpu_set_t), &previous_);
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef _AMLNN_THREAD_PLACEMENT_H_
+#define _AMLNN_THREAD_PLACEMENT_H_
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+// Online CPUs and their cpufreq maximum (0 when cpufreq is not exposed).
+struct CpuInfo {
+    int cpu = 0;
+    unsigned int max_khz = 0;
+};
+
+std::vector<CpuInfo> cpu_topology();
+// CPUs of the fastest cluster / the remaining ones. Both return every
+// online CPU on parts with a single cluster.
+std::vector<int> big_cpus();
+std::vector<int> little_cpus();
+// "0-3,6", "big", "little" or "all"; empty on a malformed list.
+std::vector<int> parse_cpu_list(const char* text);
+
+struct StageStats {
+    std::string stage;
+    std::vector<int> cpus;     // empty: any CPU
+    uint64_t calls = 0;
+    double thread_cpu_ms = 0;  // CPU time of the threads that entered the stage
+    // CPU time of the whole process while the stage ran: adds the threads
+    // the stage keeps busy (softop OpenMP, mel workers, OpenCV pool), and
+    // also whatever other stages ran on other threads meanwhile
+    double process_cpu_ms = 0;
+    double wall_ms = 0;
+};
+
+// Process-wide CPU sets for pipeline stages ("pre", "infer", "post", ...).
+// The SDK's softop OpenMP threads, OpenCV's pool and helper std::threads
+// all inherit the affinity of the thread that creates them, so running a
+// stage inside a StageScope confines the threads it starts as well.
+// Sets come from declare() or from AMLNN_CPUS, e.g.
+//   AMLNN_CPUS="pre=little;infer=big;post=4-5"
+// Stages without a set run on any CPU.
+class ThreadPlacement {
+public:
+    static ThreadPlacement& instance();
+
+    void declare(const std::string& stage, const std::vector<int>& cpus);
+    std::vector<int> cpus(const std::string& stage) const;
+    // Worker threads a stage should use: the size of its CPU set, or
+    // `fallback` when it has none.
+    int threads(const std::string& stage, int fallback) const;
+
+    // Pins the calling thread to the stage's CPUs; 0 when it has none.
+    int pin(const std::string& stage);
+
+    void record(const std::string& stage, double thread_cpu_ms, double process_cpu_ms, double wall_ms);
+    std::vector<StageStats> stats() const;
+    // One line per stage: CPUs, calls, thread / process CPU and wall time
+    // per call.
+    std::string report() const;
+
+private:
+    ThreadPlacement();
+
+    mutable std::mutex mutex_;
+    std::map<std::string, StageStats> stages_;
+};
+
+// Monotonic wall clock (steady_clock), for intervals.
+double wall_ms();
+// CPU time of the calling thread.
+double thread_cpu_ms();
+// CPU time of the process, all threads (RUSAGE_SELF).
+double process_cpu_ms();
+
+// Runs the enclosing block on the stage's CPUs and adds the calling
+// thread's CPU time, the process CPU time and the wall time to its stats.
+// The previous affinity is restored on exit. Pass NULL or "" to make it a
+// no-op.
+class StageScope {
+public:
+    explicit StageScope(const char* stage);
+    ~StageScope();
+
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+
+private:
+    const char* stage_;
+    bool restore_ = false;
+    cpu_set_t previous_;
+    double cpu_start_ = 0;
+    double process_cpu_start_ = 0;
+    double wall_start_ = 0;
+};
+
+#endif
@@ -20,6 +20,8 @@
 #include <time.h>
 
 #include "model_invoke.h"
+#include "memory_report.h"
+#include "pipeline_init.h"
 
 #define BILLION 1000000000
 
@@ -63,12 +65,30 @@ int main(int argc, char ** argv)
     std::string json_filename = (argc >= 4) ? argv[3] : "";
     void *context_model = NULL;
 
+    /* AMLNN_WARMUP=n sets the number of warm-up runs, 0 turns it off */
+    int warmup_runs = getenv("AMLNN_WARMUP") ? atoi(getenv("AMLNN_WARMUP")) : 2;
+    double warmup_cold_ms = 0, warmup_warm_ms = 0;
+
+    /* the dataset text embeddings are parsed next to context creation and
+       warm-up and keep loading after startup, the first query waits for
+       them only if they are not done yet */
+    std::unique_ptr<PipelineInit> init = PipelineInit::create();
+    init->add("model", [&] {
+        context_model = init_network_file(model_path_encoder);
+        return context_model ? 0 : -1;
+    });
+    init->add("warmup", [&] {
+        return warmup_network(context_model, warmup_runs, &warmup_cold_ms, &warmup_warm_ms);
+    }, INIT_EAGER, {"model"});
+    init->add("text_embeddings", [&] { return load_text_embeddings(base_dir, json_filename); }, INIT_BACKGROUND);
+
     model_time.init_start_time = get_time_count();
-    context_model = init_network_file(model_path_encoder);
+    ret = init->run();
     model_time.init_end_time = get_time_count();
 
-    if (context_model == NULL)
+    if (ret != 0)
     {
+        std::cout << init->report();
         printf("init_network [context_model] fail.\n");
         return -1;
     }
@@ -77,8 +97,13 @@ int main(int argc, char ** argv)
     {
         model_time.init_total_time = (model_time.init_end_time - model_time.init_start_time) / 1000000;
         std::cout << "init_model_total time : " << model_time.init_total_time << "ms" << std::endl;
+        if (warmup_runs > 0)
+        {
+            std::cout << "warmup cold time : " << warmup_cold_ms << "ms, warm time : " << warmup_warm_ms << "ms" << std::endl;
+        }
     }
 
+    bool preload_failed = false;
     while (true)
     {
         std::string json_path;
@@ -90,6 +115,12 @@ int main(int argc, char ** argv)
             printf("The path cannot be empty.\n");
             continue;
         }
+        /* without them, every image reads the dataset JSON files again */
+        if (init->ensure("text_embeddings") != 0 && !preload_failed)
+        {
+            preload_failed = true;
+            printf("Text embeddings were not preloaded, reading the dataset files for every image.\n");
+        }
         std::vector<std::string> out_str_path = process_image_dir(context_model, json_path, base_dir, json_filename);
 
         for (int i = 0; i < out_str_path.size(); i++)
@@ -98,6 +129,12 @@ int main(int argc, char ** argv)
         }
     }
 
+    if (getenv("GET_TIME"))
+    {
+        std::cout << init->report();
+        std::cout << context_memory(context_model, "clip").to_text();
+    }
+
     ret = destroy_network(context_model);
     if (ret != 0)
     {
@@ -6,7 +6,9 @@
 #include <map>
 
 void* init_network_file(const char *model_path);
+int load_text_embeddings(const std::string& base_dir = "", const std::string& json_filename = "");
 std::vector<std::string> process_image_dir(void *context_model, const std::string& json_path, const std::string& base_dir = "", const std::string& json_filename = "");
+int warmup_network(void *qcontext, int runs, double *cold_ms, double *warm_ms);
 int destroy_network(void *qcontext);
 
 #endif // MODEL_INVOKE_H
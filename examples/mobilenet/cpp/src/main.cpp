@@ -19,10 +19,12 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <filesystem>
 #include <opencv2/opencv.hpp>
 #include <opencv2/opencv.hpp>
 #include "nn_sdk.h"
 #include "model_loader.h"
+#include "model_session.h"
 
 const int MODEL_INPUT_WIDTH = 224;
 const int MODEL_INPUT_HEIGHT = 224;
@@ -56,6 +58,26 @@ std::vector<std::string> load_labels(const std::string& path) {
 
 
 
+static void print_top_k(const nn_output* outdata, const std::vector<std::string>& labels) {
+    float* output_buffer = (float*)outdata->out[0].buf;
+    int num_classes = outdata->out[0].size / sizeof(float);
+
+    std::vector<ClassScore> scores;
+    for (int i = 0; i < num_classes; ++i) {
+        scores.push_back({i, output_buffer[i]});
+    }
+
+    std::sort(scores.begin(), scores.end(), compare_scores);
+
+    std::cout << "\nTop-" << TOP_K << " Classification Results:" << std::endl;
+    for (int i = 0; i < std::min(TOP_K, num_classes); ++i) {
+        int idx = scores[i].index;
+        float score = scores[i].score;
+        std::string label = (idx < labels.size()) ? labels[idx] : "Class " + std::to_string(idx);
+        printf("  %d. %-20s (score: %.6f)\n", i + 1, label.c_str(), score);
+    }
+}
+
 int main(int argc, char** argv) {
     std::string model_path = argv[1];
     std::string image_path = argv[2];
@@ -67,87 +89,82 @@ int main(int argc, char** argv) {
     std::cout << "Labels: " << labels_path << std::endl;
 
     // 1. Initialize Network
-    void* context = init_network(model_path.c_str());
-    if (!context) {
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path.c_str());
+    if (!session) {
         std::cerr << "Failed to initialize network." << std::endl;
         return -1;
     }
 
-    // 2. Load and Preprocess Image
-    cv::Mat img = cv::imread(image_path);
-    if (img.empty()) {
-        std::cerr << "Failed to load image from " << image_path << std::endl;
-        uninit_network(context);
-        return -1;
+    // 2. Collect images: one file, or every image of a directory
+    std::vector<std::string> images;
+    if (std::filesystem::is_directory(image_path)) {
+        for (auto& it : std::filesystem::directory_iterator(image_path)) {
+            if (it.is_regular_file()) images.push_back(it.path().string());
+        }
+        std::sort(images.begin(), images.end());
+    } else {
+        images.push_back(image_path);
     }
 
-    cv::Mat img_resized;
-    cv::resize(img, img_resized, cv::Size(MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT));
-
-    cv::Mat img_rgb;
-    cv::cvtColor(img_resized, img_rgb, cv::COLOR_BGR2RGB);
-
-    nn_input inData;
-    memset(&inData, 0, sizeof(nn_input));
-    inData.input_type = BINARY_RAW_DATA;
-    inData.input = img_rgb.data;
-    inData.input_index = 0;
-    inData.size = MODEL_INPUT_WIDTH * MODEL_INPUT_HEIGHT * 3 * sizeof(unsigned char);
-
-    if (aml_module_input_set(context, &inData) != 0) {
+    // Models compiled with a batch_multiplier classify several images per
+    // invoke. Color conversion writes straight into the NPU input buffer,
+    // one item after the other.
+    const size_t batch = session->batch_size();
+    const size_t item_bytes = MODEL_INPUT_WIDTH * MODEL_INPUT_HEIGHT * 3 * sizeof(unsigned char);
+    TensorView input = session->input(0, batch * item_bytes);
+    if (!input.data) {
          std::cerr << "Failed to set input." << std::endl;
-         uninit_network(context);
-         return -1;
-    }
-
-    // 3. Run Inference
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    aml_output_config_t outconfig;
-    memset(&outconfig, 0, sizeof(aml_output_config_t));
-    outconfig.typeSize = sizeof(aml_output_config_t);
-    outconfig.format = AML_OUTDATA_FLOAT32;
-    
-    nn_output* outdata = (nn_output*)aml_module_output_get(context, outconfig);
-    if (!outdata) {
-         std::cerr << "Failed to run network (get output)." << std::endl;
-         uninit_network(context);
          return -1;
     }
-
-    auto end_time = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> inference_time = end_time - start_time;
-    std::cout << "Inference time: " << inference_time.count() << " ms" << std::endl;
-
-    // 4. Postprocess
-    if (outdata->num <= 0) {
-        std::cerr << "No output from network." << std::endl;
-        uninit_network(context);
-        return -1;
-    }
-
-    float* output_buffer = (float*)outdata->out[0].buf;
-    int num_classes = outdata->out[0].size / sizeof(float);
-
-    std::vector<ClassScore> scores;
-    for (int i = 0; i < num_classes; ++i) {
-        scores.push_back({i, output_buffer[i]});
+    // Dummy invokes on the allocated buffer, so the timed run below is warm
+    if (session->warmup(2) == 0) {
+        const WarmupStats& warm = session->warmup_stats();
+        std::cout << "Warm-up: cold " << warm.cold_ms << " ms, warm " << warm.warm_ms << " ms" << std::endl;
     }
+    std::vector<std::string> labels = load_labels(labels_path);
+    BatchOutputs outputs;
+
+    size_t next = 0;
+    while (next < images.size()) {
+        std::vector<std::string> names;
+        while (next < images.size() && names.size() < batch) {
+            const std::string& path = images[next++];
+            cv::Mat img = cv::imread(path);
+            if (img.empty()) {
+                std::cerr << "Failed to load image from " << path << std::endl;
+                continue;
+            }
+            cv::Mat img_resized;
+            cv::resize(img, img_resized, cv::Size(MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT));
+            cv::Mat img_rgb(MODEL_INPUT_HEIGHT, MODEL_INPUT_WIDTH, CV_8UC3, input.data + names.size() * item_bytes);
+            cv::cvtColor(img_resized, img_rgb, cv::COLOR_BGR2RGB);
+            names.push_back(path);
+        }
+        if (names.empty()) continue;
 
-    std::sort(scores.begin(), scores.end(), compare_scores);
+        // 3. Run Inference
+        auto start_time = std::chrono::high_resolution_clock::now();
 
-    std::vector<std::string> labels = load_labels(labels_path);
+        if (session->run_batch(input.data, item_bytes, names.size(), &outputs)) {
+             std::cerr << "Failed to run network (get output)." << std::endl;
+             return -1;
+        }
 
-    std::cout << "\nTop-" << TOP_K << " Classification Results:" << std::endl;
-    for (int i = 0; i < std::min(TOP_K, num_classes); ++i) {
-        int idx = scores[i].index;
-        float score = scores[i].score;
-        std::string label = (idx < labels.size()) ? labels[idx] : "Class " + std::to_string(idx);
-        printf("  %d. %-20s (score: %.6f)\n", i + 1, label.c_str(), score);
+        auto end_time = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> inference_time = end_time - start_time;
+        std::cout << "Inference time: " << inference_time.count() << " ms (" << names.size() << " image(s))" << std::endl;
+
+        // 4. Postprocess
+        for (size_t i = 0; i < names.size(); ++i) {
+            const nn_output* outdata = outputs.item(i);
+            if (outdata->num <= 0) {
+                std::cerr << "No output from network." << std::endl;
+                return -1;
+            }
+            std::cout << "\nImage: " << names[i];
+            print_top_k(outdata, labels);
+        }
     }
 
-    // 5. Cleanup
-    uninit_network(context);
-
     return 0;
 }
@@ -21,13 +21,58 @@
 #include <chrono>
 #include "nn_sdk.h"
 #include "model_loader.h"
+#include "model_session.h"
 #include "postprocess.h"
+#include "tensor_dump.h"
 
 const std::string DEFAULT_OUTPUT_PATH = "result.png";
 
+// Replay mode: postprocessing over probability maps recorded with
+// AMLNN_RECORD, no NPU needed. Boxes are in model input coordinates.
+static int run_replay(const char* replay_path, int repeat) {
+    std::unique_ptr<TensorReplay> replay = TensorReplay::open(replay_path);
+    if (!replay || replay->frames() == 0) {
+        fprintf(stderr, "No frames in %s\n", replay_path);
+        return -1;
+    }
+    cv::Mat canvas(MODEL_INPUT_HEIGHT, MODEL_INPUT_WIDTH, CV_8UC3);
+    double total_ms = 0;
+    size_t runs = 0;
+    for (int r = 0; r < repeat; ++r) {
+        for (size_t f = 0; f < replay->frames(); ++f) {
+            const nn_output* out = replay->output(f);
+            if (out->num == 0 || replay->output_format(f) != AML_OUTDATA_FLOAT32 ||
+                out->out[0].size < MODEL_INPUT_WIDTH * MODEL_INPUT_HEIGHT * sizeof(float)) {
+                fprintf(stderr, "Frame %llu is not a float32 %dx%d map\n", (unsigned long long)replay->frame_id(f),
+                        MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT);
+                return -1;
+            }
+            std::vector<Object> results;
+            auto start = std::chrono::steady_clock::now();
+            postprocess((float*)out->out[0].buf, canvas, BOX_SCORE_THRESH, BOX_THRESH, results, 1.0f);
+            total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            ++runs;
+
+            if (r > 0) continue;
+            printf("frame %llu: %zu boxes\n", (unsigned long long)replay->frame_id(f), results.size());
+            for (const Object& obj : results) {
+                printf("  %.4f", obj.score);
+                for (const cv::Point& p : obj.box) printf(" %d,%d", p.x, p.y);
+                printf("\n");
+            }
+        }
+    }
+    printf("Postprocess: %zu frames, %.3f ms mean\n", runs, total_ms / runs);
+    return 0;
+}
+
 int main(int argc, char** argv) {
+    if (argc >= 3 && std::string(argv[1]) == "--replay") {
+        return run_replay(argv[2], argc > 3 ? std::max(1, atoi(argv[3])) : 1);
+    }
     if (argc < 3) {
         printf("Usage: %s <model_path> <image_path> [output_path]\n", argv[0]);
+        printf("       %s --replay <file.amlt> [repeat]\n", argv[0]);
         return -1;
     }
 
@@ -39,8 +84,8 @@ int main(int argc, char** argv) {
     printf("Image: %s\n", image_path.c_str());
 
     // 1. Initialize Network
-    void* ctx = init_network(model_path.c_str());
-    if (!ctx) {
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path.c_str());
+    if (!session) {
         fprintf(stderr, "Failed to initialize network\n");
         return -1;
     }
@@ -49,22 +94,28 @@ int main(int argc, char** argv) {
     cv::Mat img = cv::imread(image_path);
     if (img.empty()) {
         fprintf(stderr, "Failed to load image: %s\n", image_path.c_str());
-        uninit_network(ctx);
         return -1;
     }
 
-    // 3. Preprocess
+    // 3. Preprocess straight into the NPU input buffer, warmed up first
+    TensorView input = session->input(0, MODEL_INPUT_WIDTH * MODEL_INPUT_HEIGHT * MODEL_INPUT_CHANNELS * sizeof(uint8_t));
+    if (!input.data) {
+        fprintf(stderr, "Failed to set input\n");
+        return -1;
+    }
+    if (session->warmup(2) == 0) {
+        printf("Warm-up: cold %.2f ms, warm %.2f ms\n", session->warmup_stats().cold_ms, session->warmup_stats().warm_ms);
+    }
     auto start_time = std::chrono::high_resolution_clock::now();
-    cv::Mat pre_image;
+    cv::Mat pre_image(MODEL_INPUT_HEIGHT, MODEL_INPUT_WIDTH, CV_8UC3, input.data);
     float scale = 1.0f;
     preprocess(img, pre_image, MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT, scale);
 
     printf("scale: %f\n", scale);
     // 4. Inference
-    nn_output* outdata = (nn_output*)run_paddleocr_network(ctx, pre_image, MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT, MODEL_INPUT_CHANNELS);
+    nn_output* outdata = session->run();
     if (!outdata) {
         fprintf(stderr, "Inference failed\n");
-        uninit_network(ctx);
         return -1;
     }
 
@@ -84,8 +135,5 @@ int main(int argc, char** argv) {
     cv::imwrite(output_path, res);
     printf("Saved result to %s\n", output_path.c_str());
 
-    // 7. Cleanup
-    uninit_network(ctx);
-
     return 0;
 }
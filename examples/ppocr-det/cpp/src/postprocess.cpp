@@ -37,7 +37,9 @@ int preprocess(const cv::Mat& image, cv::Mat& pre_image, const int width, const
     cv::Mat resized_img;
     cv::resize(image, resized_img, cv::Size(new_w, new_h));
 
-    pre_image = cv::Mat::zeros(height, width, CV_8UC3);
+    // create() keeps pre_image's storage when it already wraps a buffer of this size
+    pre_image.create(height, width, CV_8UC3);
+    pre_image.setTo(cv::Scalar::all(0));
     cv::Rect roi_rect = cv::Rect(0, 0, new_w, new_h);
 
     resized_img.copyTo(pre_image(roi_rect));
@@ -63,29 +65,6 @@ int postprocess(float* out, const cv::Mat& image, float box_score_thresh, float
     return 0;
 }
 
-void* run_paddleocr_network(void* qcontext, cv::Mat& image, const int width, const int height, const int channel) {
-    unsigned char* rawdata = image.data;
-
-    nn_input inData;
-    memset(&inData, 0, sizeof(nn_input));
-    inData.input_type = BINARY_RAW_DATA;
-    inData.input = rawdata;
-    inData.input_index = 0;
-    inData.size = width * height * channel * sizeof(uint8_t);
-
-    int ret = aml_module_input_set(qcontext, &inData);
-    if (ret) {
-        printf("aml_module_input_set fail for index %d. Ret=%d", 0, ret);
-        return NULL;
-    }
-
-    aml_output_config_t outconfig;
-    memset(&outconfig, 0, sizeof(aml_output_config_t));
-    outconfig.typeSize = sizeof(aml_output_config_t);
-    outconfig.format = AML_OUTDATA_FLOAT32;
-    return aml_module_output_get(qcontext, outconfig);
-}
-
 std::vector<Object> find_box(const cv::Mat pred_map, const cv::Mat& bit_map,
                              const float box_score_thresh, const float unclip_ratio,
                              const cv::Mat& image, float scale) {
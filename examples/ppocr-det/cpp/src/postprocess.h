@@ -36,8 +36,6 @@ typedef struct {
     std::vector<cv::Point> box;
 } Object;
 
-void* run_paddleocr_network(void* qcontext, cv::Mat& image, const int width, const int height, const int channel);
-
 int preprocess(const cv::Mat& image, cv::Mat& pre_image, const int width, const int height, float& scale );
 
 int postprocess(float* out, const cv::Mat& image, float box_score_thresh, float box_thresh, std::vector<Object>& result, float scale);
@@ -5,6 +5,8 @@
 #include <opencv2/opencv.hpp>
 #include "nn_sdk.h"
 #include "postprocess.h"
+#include "model_session.h"
+#include "quant_input.h"
 
 namespace fs = std::filesystem;
 
@@ -16,15 +18,19 @@ int main(int argc, char** argv) {
 
     auto labels = load_labels(argv[3]);
 
-    aml_config cfg{};
-    cfg.typeSize = sizeof(cfg);
-    cfg.modelType = ADLA_LOADABLE;
-    cfg.nbgType = NN_ADLA_FILE;
-    cfg.path = argv[1];
-    void* ctx = aml_module_create(&cfg);
-    if (!ctx) return -1;
+    SessionConfig config;
+    config.warmup_runs = 2;
+    std::unique_ptr<ModelSession> session = ModelSession::create(argv[1], config);
+    if (!session || session->inputs().empty()) return -1;
+    printf("Warm-up: cold %.2f ms, warm %.2f ms\n", session->warmup_stats().cold_ms, session->warmup_stats().warm_ms);
 
-    std::vector<float> input_buffer(kInputW * kInputH * 3);
+    // (pixel - MEAN) / STD and the input quantization in one table lookup
+    const float norm[3] = {1.0f / STD[0], 1.0f / STD[1], 1.0f / STD[2]};
+    InputQuantizer quantizer;
+    if (quantizer.init(session->inputs()[0], 3, MEAN, norm)) return -1;
+
+    const size_t pixels = kInputW * kInputH;
+    std::vector<uint8_t> input_buffer(quantizer.bytes(pixels));
 
     for (auto& it : fs::directory_iterator(argv[2])) {
         cv::Mat img = cv::imread(it.path().string());
@@ -33,22 +39,11 @@ int main(int argc, char** argv) {
         std::cout << "============================================================" << std::endl;
         std::cout << "Processing: " << it.path().filename() << std::endl;
 
-        preprocess(img, input_buffer.data());
-
-        nn_input in{};
-        in.typeSize = sizeof(in);
-        in.input_type = BINARY_RAW_DATA;
-        in.input = (unsigned char*)input_buffer.data();
-        in.size = input_buffer.size() * sizeof(float);
-        in.info.valid = 1;
-        in.info.input_format = AML_INPUT_MODEL_NHWC; 
-        in.info.input_data_type = AML_INPUT_FP32;
-        aml_module_input_set(ctx, &in);
+        cv::Mat resized = preprocess(img);
+        quantizer.apply(resized.data, pixels, input_buffer.data());
+        if (quantizer.upload(*session, 0, input_buffer.data(), pixels, AML_INPUT_MODEL_NHWC)) continue;
 
-        aml_output_config_t outcfg{};
-        outcfg.typeSize = sizeof(outcfg);
-        outcfg.format = AML_OUTDATA_FLOAT32;
-        nn_output* out = (nn_output*)aml_module_output_get(ctx, outcfg);
+        nn_output* out = session->run();
 
         if (out && out->num > 0) {
             float* data = (float*)out->out[0].buf;
@@ -58,6 +53,5 @@ int main(int argc, char** argv) {
         std::cout << "============================================================\n" << std::endl;
     }
 
-    aml_module_destroy(ctx);
     return 0;
 }
\ No newline at end of file
@@ -4,20 +4,11 @@
 #include <numeric>
 #include <algorithm>
 
-void preprocess(const cv::Mat& src, float* dst) {
+cv::Mat preprocess(const cv::Mat& src) {
     cv::Mat rgb, resized;
     cv::cvtColor(src, rgb, cv::COLOR_BGR2RGB);
     cv::resize(rgb, resized, cv::Size(kInputW, kInputH));
-
-    for (int i = 0; i < kInputH; ++i) {
-        for (int j = 0; j < kInputW; ++j) {
-            cv::Vec3f pixel = resized.at<cv::Vec3b>(i, j);
-            int idx = (i * kInputW + j) * 3;
-            dst[idx + 0] = (pixel[0] - MEAN[0]) / STD[0];
-            dst[idx + 1] = (pixel[1] - MEAN[1]) / STD[1];
-            dst[idx + 2] = (pixel[2] - MEAN[2]) / STD[2];
-        }
-    }
+    return resized;
 }
 
 void postprocess_topk(float* logits, int size, const std::vector<std::string>& labels, int k) {
@@ -10,7 +10,9 @@ static const float STD[3]  = {58.395f, 58.395f, 58.395f};
 static constexpr int kInputW = 224;
 static constexpr int kInputH = 224;
 
-void preprocess(const cv::Mat& src, float* dst);
+// Resizes to the model input and converts to RGB; normalization with
+// MEAN / STD is folded into the input quantization table.
+cv::Mat preprocess(const cv::Mat& src);
 
 void postprocess_topk(float* logits, int size, const std::vector<std::string>& labels, int k = 5);
 
@@ -4,96 +4,138 @@
 #include <opencv2/opencv.hpp>
 #include "nn_sdk.h"
 #include "postprocess.h"
+#include "model_session.h"
+#include "quant_input.h"
 
 namespace fs = std::filesystem;
 
-static void hwc_to_chw(const cv::Mat& src, float* dst) {
-    int h = src.rows, w = src.cols;
-    for (int k = 0; k < 3; ++k) {
-        for (int i = 0; i < h; ++i) {
-            for (int j = 0; j < w; ++j) {
-                dst[k * h * w + i * w + j] = src.at<cv::Vec3f>(i, j)[k];
-            }
+// A head holds `channels` values per prior, either interleaved {B, N, C}
+// or planar {B, C, N}; both are told apart from the output's dims.
+struct Head {
+    const float* data = nullptr;
+    bool is_planar = false;
+};
+
+static int find_heads(const ModelSession& session, const nn_output* out, size_t num_priors,
+                      Head& loc, Head& conf, Head& landm) {
+    for (const auto& desc : session.outputs()) {
+        size_t elements = desc.elements / session.batch_size();
+        if (desc.index >= out->num || elements % num_priors) continue;
+        Head head;
+        head.data = (const float*)out->out[desc.index].buf;
+        head.is_planar = desc.dim(-1) == num_priors;
+        switch (elements / num_priors) {
+            case 4:  loc = head; break;
+            case 2:  conf = head; break;
+            case 10: landm = head; break;
         }
     }
+    return (loc.data && conf.data && landm.data) ? 0 : -1;
 }
 
 int main(int argc, char** argv) {
     if (argc < 3) { std::cout << "Usage: " << argv[0] << " <model.adla> <image_dir>\n"; return 0; }
 
-    aml_config cfg{};
-    cfg.typeSize = sizeof(cfg); cfg.modelType = ADLA_LOADABLE; cfg.nbgType = NN_ADLA_FILE; cfg.path = argv[1];
-    void* ctx = aml_module_create(&cfg);
+    SessionConfig config;
+    config.warmup_runs = 2;
+    std::unique_ptr<ModelSession> session = ModelSession::create(argv[1], config);
+    if (!session || session->inputs().empty()) return -1;
+    printf("Warm-up: cold %.2f ms, warm %.2f ms\n", session->warmup_stats().cold_ms, session->warmup_stats().warm_ms);
+    // Raw 0..255 pixels, quantized with the input's scale / zero point.
+    InputQuantizer quantizer;
+    if (quantizer.init(session->inputs()[0], 3)) return -1;
     auto priors = generate_priors();
     size_t num_priors = priors.size();
-    std::vector<float> chw_buffer(kInputW * kInputH * 3);
+    const size_t pixels = kInputW * kInputH;
+    const size_t item_bytes = quantizer.bytes(pixels);
+
+    // Models compiled with a batch_multiplier take several images per
+    // invoke; batch-1 models run them one by one.
+    const size_t batch = session->batch_size();
+    printf("Batch: %zu image(s) per invoke\n", batch);
+    input_info info;
+    amlnn_input_type type = quantizer.describe(AML_INPUT_MODEL_NCHW, &info);
+    std::vector<uint8_t> chw_batch(batch * item_bytes);
+    BatchOutputs outputs;
+
+    struct Item {
+        fs::path path;
+        cv::Mat img;
+        float scale = 1.0f;
+        int px = 0, py = 0;
+    };
+    std::vector<Item> items;
 
     fs::create_directory("retinaface_result");
 
-    for (auto& it : fs::directory_iterator(argv[2])) {
-        cv::Mat img = cv::imread(it.path().string());
-        if (img.empty()) continue;
-
-        float scale = std::min((float)kInputW / img.cols, (float)kInputH / img.rows);
-        int nw = img.cols * scale, nh = img.rows * scale;
-        int px = (kInputW - nw) / 2, py = (kInputH - nh) / 2;
-        cv::Mat res, canvas = cv::Mat::zeros(kInputH, kInputW, CV_32FC3);
-        cv::resize(img, res, {nw, nh}); res.convertTo(res, CV_32FC3);
-        res.copyTo(canvas(cv::Rect(px, py, nw, nh)));
-        hwc_to_chw(canvas, chw_buffer.data());
-
-        nn_input in{}; in.typeSize = sizeof(in); in.input_type = BINARY_RAW_DATA;
-        in.input = (unsigned char*)chw_buffer.data(); in.size = chw_buffer.size() * 4;
-        in.info.valid = 1; in.info.input_format = AML_INPUT_MODEL_NCHW; in.info.input_data_type = AML_INPUT_FP32;
-        aml_module_input_set(ctx, &in);
-
-        aml_output_config_t outcfg{}; outcfg.typeSize = sizeof(outcfg); outcfg.format = AML_OUTDATA_FLOAT32;
-        nn_output* out = (nn_output*)aml_module_output_get(ctx, outcfg);
-        if (!out) continue;
-
-        float *loc = nullptr, *conf = nullptr, *landm = nullptr;
-        for (int i = 0; i < out->num; i++) {
-            if (out->out[i].size == num_priors * 4 * 4) loc = (float*)out->out[i].buf;
-            else if (out->out[i].size == num_priors * 2 * 4) conf = (float*)out->out[i].buf;
-            else if (out->out[i].size == num_priors * 10 * 4) landm = (float*)out->out[i].buf;
+    fs::directory_iterator dir(argv[2]), end;
+    while (dir != end || !items.empty()) {
+        if (dir != end && items.size() < batch) {
+            Item item;
+            item.path = dir->path();
+            ++dir;
+            item.img = cv::imread(item.path.string());
+            if (item.img.empty()) continue;
+
+            item.scale = std::min((float)kInputW / item.img.cols, (float)kInputH / item.img.rows);
+            int nw = item.img.cols * item.scale, nh = item.img.rows * item.scale;
+            item.px = (kInputW - nw) / 2; item.py = (kInputH - nh) / 2;
+            cv::Mat res, canvas = cv::Mat::zeros(kInputH, kInputW, CV_8UC3);
+            cv::resize(item.img, res, {nw, nh});
+            res.copyTo(canvas(cv::Rect(item.px, item.py, nw, nh)));
+            quantizer.apply_planar(canvas.data, pixels, chw_batch.data() + items.size() * item_bytes);
+            items.push_back(item);
+            continue;
         }
-        if (!loc || !conf || !landm) continue;
-
-        bool is_planar = (conf[0] > 2.0 || conf[1] > 2.0);
-        std::vector<std::array<float, 4>> boxes;
-        std::vector<std::array<float, 10>> lms;
-        std::vector<float> scores_vec;
-
-        for (size_t i = 0; i < num_priors; i++) {
-            float sc = is_planar ? conf[num_priors + i] : conf[i * 2 + 1];
-            if (sc > 0.5f) {
-                boxes.push_back(decode_box(loc, i, num_priors, is_planar, priors[i]));
-                lms.push_back(decode_landm(landm, i, num_priors, is_planar, priors[i]));
-                scores_vec.push_back(sc);
+
+        int ret = session->run_batch(chw_batch.data(), item_bytes, items.size(), &outputs, &info, type);
+        for (size_t n = 0; ret == 0 && n < items.size(); n++) {
+            Item& item = items[n];
+            cv::Mat& img = item.img;
+            float scale = item.scale;
+            int px = item.px, py = item.py;
+
+            Head loc, conf, landm;
+            if (find_heads(*session, outputs.item(n), num_priors, loc, conf, landm)) {
+                std::cerr << "Model outputs do not match " << num_priors << " priors." << std::endl;
+                return -1;
             }
-        }
+            std::vector<std::array<float, 4>> boxes;
+            std::vector<std::array<float, 10>> lms;
+            std::vector<float> scores_vec;
+
+            for (size_t i = 0; i < num_priors; i++) {
+                float sc = conf.is_planar ? conf.data[num_priors + i] : conf.data[i * 2 + 1];
+                if (sc > 0.5f) {
+                    boxes.push_back(decode_box(loc.data, i, num_priors, loc.is_planar, priors[i]));
+                    lms.push_back(decode_landm(landm.data, i, num_priors, landm.is_planar, priors[i]));
+                    scores_vec.push_back(sc);
+                }
+            }
+
+            auto keep = nms(boxes, scores_vec, 0.4f);
+            for (int k : keep) {
+                auto& b = boxes[k];
+                int x1 = (b[0] * kInputW - px) / scale, y1 = (b[1] * kInputH - py) / scale;
+                int x2 = (b[2] * kInputW - px) / scale, y2 = (b[3] * kInputH - py) / scale;
+
+                cv::rectangle(img, {x1, y1}, {x2, y2}, {0, 255, 0}, 2);
+
+                char score_text[16];
+                std::snprintf(score_text, sizeof(score_text), "%.2f", scores_vec[k]);
+                cv::putText(img, score_text, {x1, std::max(y1 - 5, 5)}, cv::FONT_HERSHEY_SIMPLEX, 0.5, {0, 255, 0}, 1, cv::LINE_AA);
 
-        auto keep = nms(boxes, scores_vec, 0.4f);
-        for (int k : keep) {
-            auto& b = boxes[k];
-            int x1 = (b[0] * kInputW - px) / scale, y1 = (b[1] * kInputH - py) / scale;
-            int x2 = (b[2] * kInputW - px) / scale, y2 = (b[3] * kInputH - py) / scale;
-            
-            cv::rectangle(img, {x1, y1}, {x2, y2}, {0, 255, 0}, 2);
-
-            char score_text[16];
-            std::snprintf(score_text, sizeof(score_text), "%.2f", scores_vec[k]);
-            cv::putText(img, score_text, {x1, std::max(y1 - 5, 5)}, cv::FONT_HERSHEY_SIMPLEX, 0.5, {0, 255, 0}, 1, cv::LINE_AA);
-
-            auto& lm = lms[k];
-            for (int j = 0; j < 5; j++) {
-                int lx = (lm[2 * j] * kInputW - px) / scale;
-                int ly = (lm[2 * j + 1] * kInputH - py) / scale;
-                cv::circle(img, {lx, ly}, 2, {0, 0, 255}, -1); 
+                auto& lm = lms[k];
+                for (int j = 0; j < 5; j++) {
+                    int lx = (lm[2 * j] * kInputW - px) / scale;
+                    int ly = (lm[2 * j + 1] * kInputH - py) / scale;
+                    cv::circle(img, {lx, ly}, 2, {0, 0, 255}, -1);
+                }
             }
+            cv::imwrite("retinaface_result/" + item.path.filename().string(), img);
+            std::cout << "Detected: " << item.path.filename() << " (" << keep.size() << " faces)\n";
         }
-        cv::imwrite("retinaface_result/" + it.path().filename().string(), img);
-        std::cout << "Detected: " << it.path().filename() << " (" << keep.size() << " faces)\n";
+        items.clear();
     }
-    aml_module_destroy(ctx); return 0;
+    return 0;
 }
\ No newline at end of file
@@ -18,8 +18,12 @@
 #include <time.h>
 #include <iostream>
 
+#include "whisper.h"
 #include "whisper_invoke.h"
 #include "nn_sdk.h"
+#include "pipeline_init.h"
+#include "thread_placement.h"
+#include "memory_report.h"
 
 #define BILLION 1000000000
 #define GET_INFERENCE_TIME     (1)
@@ -46,38 +50,68 @@ int main(int argc, char ** argv)
     Get_Times encoder_time, decoder_time, whisper_time;
     Input_Decoder decoder_inputs_data;
     std::vector<float> encoder_input_data;
-    std::vector<float> encoder_output_data;
+    float *encoder_output_data = NULL;
+    int encoder_output_size = 0;
 
     int64_t input_1_data[] = {50257, 50362};    /* init token, for tiny_en or base_en */
     int input_1_data_size = sizeof(input_1_data) / sizeof(input_1_data[0]);
  
     int ret = 0;
+
+    /* --replay <file.amlt> [repeat]: decoder post-process over steps recorded with AMLNN_RECORD */
+    if (argc >= 3 && std::string(argv[1]) == "--replay")
+    {
+        return replay_network_decoder(argv[2], argc > 3 ? std::max(1, atoi(argv[3])) : 1);
+    }
+
     char* model_path_encoder = argv[1];
     char* model_path_decoder = argv[2];
     void *context_enc = NULL;
     void *context_dec = NULL;
 
+    /* AMLNN_WARMUP=n sets the number of warm-up runs, 0 turns it off */
+    int warmup_runs = getenv("AMLNN_WARMUP") ? atoi(getenv("AMLNN_WARMUP")) : 2;
+    double warmup_cold_ms = 0, warmup_warm_ms = 0;
+
+    /* both contexts and the auxiliary assets load concurrently, warm-up starts
+       once both contexts exist; the tokenizer is only needed by the first
+       decoded token and keeps loading after startup (AMLNN_INIT_THREADS=1:
+       one after the other) */
+    std::unique_ptr<PipelineInit> init = PipelineInit::create();
+    init->add("encoder", [&] {
+        context_enc = init_network_file(model_path_encoder);
+        return context_enc ? 0 : -1;
+    });
+    init->add("decoder", [&] {
+        context_dec = init_network_file(model_path_decoder);
+        return context_dec ? 0 : -1;
+    });
+    init->add("mel_filters", [] { return whisper_load_mel_filters(WHISPER_MEL_FILTERS_FILE); });
+    init->add("warmup", [&] {
+        return warmup_network(context_enc, context_dec, warmup_runs, &warmup_cold_ms, &warmup_warm_ms);
+    }, INIT_EAGER, {"encoder", "decoder"});
+    init->add("tokenizer", [] { return load_tokenizer(WHISPER_TOKENIZER_PATH); }, INIT_BACKGROUND);
+
     whisper_time.init_start_time = get_time_count();
-    context_enc = init_network_file(model_path_encoder);
-    context_dec = init_network_file(model_path_decoder);
+    ret = init->run();
     whisper_time.init_end_time = get_time_count();
 
     whisper_time.init_total_time = (whisper_time.init_end_time - whisper_time.init_start_time) / 1000000;
 
-    if (context_enc == NULL)
-    {
-        printf("init_network [context_enc] fail.\n");
-        return -1;
-    }
-    if (context_dec == NULL)
+    if (ret != 0)
     {
-        printf("init_network [context_dec] fail.\n");
+        std::cout << init->report();
+        printf("init_network fail.\n");
         return -1;
     }
 
     if (getenv("GET_TIME"))
     {
         std::cout << "init_whisper_total time : " << whisper_time.init_total_time << "ms" << std::endl;
+        if (warmup_runs > 0)
+        {
+            std::cout << "warmup cold time : " << warmup_cold_ms << "ms, warm time : " << warmup_warm_ms << "ms" << std::endl;
+        }
     }
 
     while (true)
@@ -109,6 +143,13 @@ int main(int argc, char ** argv)
                 decoder_inputs_data.input_1 + decoder_inputs_data.input_1_size, 
                 0);
 
+        /* waits only if startup has not finished loading it yet */
+        if (init->ensure("tokenizer") != 0)
+        {
+            printf("load_tokenizer fail.\n");
+            break;
+        }
+
         whisper_time.preProcess_start_time = get_time_count();
 
         encoder_input_data = do_pre_process(input_str);
@@ -118,13 +159,20 @@ int main(int argc, char ** argv)
             std::cout << "wav is null, please try again" << std::endl;
             continue;
         }
+        HostBytes encoder_input_bytes("pre", encoder_input_data.size() * sizeof(float));
         whisper_time.preProcess_end_time = get_time_count();
-        encoder_output_data = run_network_encoder_process(context_enc, encoder_input_data);
+        encoder_output_data = run_network_encoder_process(context_enc, encoder_input_data, &encoder_output_size);
         encoder_time.invoke_end_time = get_time_count();
 
-        decoder_inputs_data.input_0_size = encoder_output_data.size();
-        decoder_inputs_data.input_0 = new float[decoder_inputs_data.input_0_size];
-        std::copy(encoder_output_data.begin(), encoder_output_data.end(), decoder_inputs_data.input_0);
+        if (encoder_output_data == NULL)
+        {
+            printf("encoder invoke fail.\n");
+            continue;
+        }
+
+        /* the decoder reads the encoder output in place, it stays valid until the next encoder invoke */
+        decoder_inputs_data.input_0_size = encoder_output_size;
+        decoder_inputs_data.input_0 = encoder_output_data;
 
         whisper_time.preProcess_total_time = (whisper_time.preProcess_end_time - whisper_time.preProcess_start_time) / 1000000;
         encoder_time.invoke_total_time = (encoder_time.invoke_end_time - whisper_time.preProcess_end_time) / 1000000;
@@ -172,12 +220,8 @@ int main(int argc, char ** argv)
         }
         encoder_time.total_time_group.clear();
 
-        if (decoder_inputs_data.input_0 != nullptr)
-        {
-            delete[] decoder_inputs_data.input_0;
-            decoder_inputs_data.input_0 = nullptr;
-            decoder_inputs_data.input_0_size = 0;
-        }
+        decoder_inputs_data.input_0 = nullptr;
+        decoder_inputs_data.input_0_size = 0;
 
         if (decoder_inputs_data.input_1 != nullptr)
         {
@@ -187,6 +231,14 @@ int main(int argc, char ** argv)
         }
     }
 
+    if (getenv("GET_TIME"))
+    {
+        std::cout << init->report();
+        std::cout << ThreadPlacement::instance().report();
+        std::cout << context_memory(context_enc, "encoder").to_text();
+        std::cout << context_memory(context_dec, "decoder").to_text();
+    }
+
     ret = destroy_network(context_enc);
     if (ret != 0)
     {
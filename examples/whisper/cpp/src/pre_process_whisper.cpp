@@ -16,6 +16,8 @@
  
 #include "pre_process_whisper.h"
 #include "pre_post_common.h"
+#include "thread_placement.h"
+#include "memory_report.h"
 
 extern bool is_finish;
 
@@ -37,12 +39,20 @@ std::vector<float> do_pre_process(std::string fname_inp)
         is_finish = true;
         return {};
     }
-
-    if (whisper_pcm_to_mel_with_state(&ctx, &state, pcmf32.data(), pcmf32.size(), 8) != 0) {
-        printf("%s: failed to compute log mel spectrogram\n", __func__);
+    HostBytes pcm_bytes("pre", pcmf32.size() * sizeof(float));
+
+    /* the mel worker threads inherit the "pre" CPU set (AMLNN_CPUS), one per CPU */
+    {
+        StageScope stage("pre");
+        int n_threads = ThreadPlacement::instance().threads("pre", 8);
+        if (whisper_pcm_to_mel_with_state(&ctx, &state, pcmf32.data(), pcmf32.size(), n_threads) != 0) {
+            printf("%s: failed to compute log mel spectrogram\n", __func__);
+        }
     }
 
+    HostBytes mel_bytes("pre", state.mel.data.size() * sizeof(float));
     std::vector<float> input_data;
+    input_data.reserve(80 * 3000);
     for (int j = 0; j < 80; j++) {
         for (int i = 0; i < 3000; i++) {
             input_data.push_back(state.mel.data[j * state.mel.n_len + i]);
@@ -15,6 +15,7 @@
  */
  
 #include "whisper.h"
+#include "memory_report.h"
 
 #include <atomic>
 #include <algorithm>
@@ -25,6 +26,7 @@
 #include <cstdarg>
 #include <cstring>
 #include <fstream>
+#include <mutex>
 #include <set>
 #include <thread>
 #include <vector>
@@ -279,6 +281,28 @@ static void log_mel_spectrogram_worker_thread(int ith, const std::vector<float>
     }
 }
 
+// mel filter bank of ./data_bin/data.bin, shared by every utterance
+static std::vector<float> g_mel_filters;
+
+int whisper_load_mel_filters(const char * path) {
+    static std::mutex filters_mutex;
+    std::lock_guard<std::mutex> lock(filters_mutex);
+    if (!g_mel_filters.empty()) {
+        return 0;
+    }
+
+    whisper_filters filters;
+    std::vector<float> data(filters.n_mel*filters.n_fft);
+    auto fin = std::ifstream(path, std::ios::binary);
+    if (!fin.read((char *)data.data(), data.size()*sizeof(float))) {
+        fprintf(stderr, "%s : fail to read '%s'\n", __func__, path);
+        return -1;
+    }
+    fill_sin_cos_table();
+    g_mel_filters = std::move(data);
+    return 0;
+}
+
 static bool log_mel_spectrogram(
               whisper_state & wstate,
               const float * samples,
@@ -296,16 +320,12 @@ static bool log_mel_spectrogram(
     // ref: https://github.com/openai/whisper/blob/main/whisper/audio.py#L147
     fill_sin_cos_table();
 
-    // auto & filters = filters;
-    filters.data.resize(filters.n_mel*filters.n_fft);
-    auto fin = std::ifstream("./data_bin/data.bin", std::ios::binary);
-    if (!fin)
-    {
-        fprintf(stderr, "%s : fail to open '%s'\n", __func__, "./data_bin/data.bin");
+    // the filter bank is read once, at startup or here on first use
+    if (whisper_load_mel_filters(WHISPER_MEL_FILTERS_FILE) == 0) {
+        filters.data = g_mel_filters;
+    } else {
+        filters.data.assign(filters.n_mel*filters.n_fft, 0.0f);
     }
-    fin.read((char *)filters.data.data(), filters.data.size()*sizeof(float));
-    fin.eof();
-    fin.close();
 
 
     std::vector<float> hann;
@@ -319,6 +339,7 @@ static bool log_mel_spectrogram(
     std::vector<float> samples_padded;
     samples_padded.resize(n_samples + stage_1_pad + stage_2_pad * 2);
     std::copy(samples, samples + n_samples, samples_padded.begin() + stage_2_pad);
+    HostBytes padded_bytes("pre", samples_padded.size() * sizeof(float));
 
     // pad 30 seconds of zeros at the end of audio (480,000 samples) + reflective pad 200 samples at the end of audio
     std::fill(samples_padded.begin() + n_samples + stage_2_pad, samples_padded.begin() + n_samples + stage_1_pad + 2 * stage_2_pad, 0);
@@ -339,7 +360,7 @@ static bool log_mel_spectrogram(
         std::vector<std::thread> workers(n_threads - 1);
         for (int iw = 0; iw < n_threads - 1; ++iw) {
             workers[iw] = std::thread(
-                    log_mel_spectrogram_worker_thread, iw + 1, std::cref(hann), samples_padded,
+                    log_mel_spectrogram_worker_thread, iw + 1, std::cref(hann), std::cref(samples_padded),
                     n_samples + stage_2_pad, frame_size, frame_step, n_threads,
                     std::cref(filters), std::ref(mel));
         }
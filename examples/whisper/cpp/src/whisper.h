@@ -54,6 +54,7 @@
 #define WHISPER_N_MELS 80
 #define WHISPER_N_FRAMES  3000
 #define WHISPER_N_SAMPLES 48000
+#define WHISPER_MEL_FILTERS_FILE "./data_bin/data.bin"
 
 struct whisper_vocab {
     using id    = int32_t;
@@ -183,6 +184,11 @@ extern "C" {
                                int   n_samples,
                                int   n_threads);
 
+    // Reads the mel filter bank once for all later whisper_pcm_to_mel calls, which
+    // otherwise read WHISPER_MEL_FILTERS_FILE on first use. Safe to call from any thread.
+    // Returns 0 on success
+    WHISPER_API int whisper_load_mel_filters(const char * path);
+
     // Convert RAW PCM audio to log mel spectrogram but applies a Phase Vocoder to speed up the audio x2.
     // The resulting spectrogram is stored inside the default state of the provided whisper context.
     // Returns 0 on success
@@ -20,10 +20,18 @@
 #include <string.h>
 #include <iostream>
 #include <algorithm>
+#include <memory>
+#include <mutex>
 
 #include "nn_sdk.h"
 #include "whisper.h"
 #include "whisper_invoke.h"
+#include "model_blob.h"
+#include "model_context.h"
+#include "model_session.h"
+#include "softop_profile.h"
+#include "thread_placement.h"
+#include "tensor_dump.h"
 
 struct DMAConfig {
     bool use_dma = true;
@@ -46,62 +54,86 @@ whisper_vocab vocab_out_init;
 aml_memory_config_t mem_config_encoder;
 aml_memory_data_t mem_data_encoder;
 
+/* encoder output, written by the NPU into our buffer and read in place as
+   decoder input 0 for every decoder step of the utterance */
+aml_memory_config_t mem_config_encoder_out;
+aml_memory_data_t mem_data_encoder_out;
+static bool decoder_input_0_shared = false;
+
 aml_memory_config_t mem_config[decoder_model_inputs_size];
 aml_memory_data_t mem_data[decoder_model_inputs_size];
 
 whisper_vocab read_token_info(std::string token_path);
 
+/* keeps the model mappings alive as long as the contexts created from them,
+   contexts may be created from several threads at startup */
+static std::vector<std::shared_ptr<ModelBlob>> model_blobs;
+static std::mutex model_blobs_mutex;
+
+/* AMLNN_RECORD=path: decoder tokens and logits of every step, for replay_network_decoder */
+static std::unique_ptr<TensorRecorder> decoder_recorder;
+static uint64_t decoder_recorded_frames = 0;
+/* set while warmup_network runs: its steps are not part of any utterance */
+static bool decoder_record_paused = false;
+
+/* loads the vocabulary once, the decoder post-process needs it; safe to
+   call from a startup thread while the contexts are being created */
+int load_tokenizer(const char *token_path)
+{
+    static std::mutex vocab_mutex;
+    static bool vocab_loaded = false;
+    std::lock_guard<std::mutex> lock(vocab_mutex);
+
+    if (!vocab_loaded) {
+        vocab_out_init = read_token_info(token_path);
+        if (vocab_out_init.id_to_token.empty()) {
+            printf("load_tokenizer: no tokens in %s\n", token_path);
+            return -1;
+        }
+        vocab_loaded = true;
+    }
+    return 0;
+}
+
 void* init_network_file(const char *model_path)
 {
     void *qcontext = NULL;
     aml_config config;
-    static bool is_worker_initialized = false;
-
-    if (!is_worker_initialized) {
-        vocab_out_init = read_token_info("./data_bin/tokenizer_info.bin");
-        is_worker_initialized = true;
-    }
 
     memset(&config, 0, sizeof(aml_config));
-    config.nbgType = NN_ADLA_FILE;
-    config.path = model_path;
+    /* create from a shared mmap of the model, fall back to letting the SDK read the file */
+    std::shared_ptr<ModelBlob> blob = ModelBlob::open(model_path);
+    if (blob) {
+        config.nbgType = NN_ADLA_MEMORY;
+        config.pdata = (const char *)blob->data();
+        config.length = (int)blob->size();
+    } else {
+        config.nbgType = NN_ADLA_FILE;
+        config.path = model_path;
+    }
     config.modelType = ADLA_LOADABLE;
     config.typeSize = sizeof(aml_config);
 
-    /* set omp, If you are considering high CPU usage during operation,
-       you can turn off this api, set_openmp_opt_flag = false */
-    aml_openmp_opt_t openmp_opt[] = 
-    {
-        {
-           .operator_type = AML_Unknown,
-           .enable_openmp = true,
-           .involve_all_ops = true,
-           .openmp_num = 2,
-        },
-    };
-    config.forward_ctrl.softop_info.set_openmp_opt_flag = true;
-    config.forward_ctrl.softop_info.openmp_opt_num = sizeof(openmp_opt) / sizeof(aml_openmp_opt_t);
-    config.forward_ctrl.softop_info.openmp_opt = openmp_opt;
-
-    /* set neon */
-    aml_neon_opt_t neon_opt[] = 
-    {
-        {
-           .operator_type = AML_Unknown,
-           .enable_neon = true,
-           .involve_all_ops = true,
-        },
-    };
-    config.forward_ctrl.softop_info.set_neon_opt_flag = true;
-    config.forward_ctrl.softop_info.neon_opt_num = sizeof(neon_opt) / sizeof(aml_neon_opt_t);
-    config.forward_ctrl.softop_info.neon_opt = neon_opt;
+    /* OpenMP / NEON for CPU fallback ops: "<model>.softop" written by
+       softop_tuner when present, otherwise 2 OpenMP threads and NEON for all ops */
+    SoftopProfile softop;
+    load_softop_profile(softop_profile_path(model_path).c_str(), &softop);
+    softop.openmp_threads = std::min(softop.openmp_threads, ThreadPlacement::instance().threads("infer", softop.openmp_threads));
+    SoftopOptions softop_opts(softop);
+    softop_opts.apply(&config.forward_ctrl.softop_info);
 
+    /* AMLNN_PERLAYER=runtime|bandwidth[:dir] dumps per-layer profiles for tools/layer_profiler */
+    perlayer_profile_from_env();
     qcontext = aml_module_create(&config);
     if (NULL == qcontext)
     {
         printf("aml_module_create fail.\n");
         return NULL;
     }
+    if (blob) {
+        std::lock_guard<std::mutex> lock(model_blobs_mutex);
+        model_blobs.push_back(blob);
+    }
 
     return qcontext;
 }
@@ -110,7 +142,33 @@ bool is_finish_end() {
     return is_finish;
 }
 
-std::vector<float> run_network_encoder_process(void *qcontext, std::vector<float> input_ids)
+/* allocates the encoder output buffer and swaps it in; on failure the
+   encoder keeps writing to SDK memory, which is read in place instead */
+static void alloc_encoder_output(void *qcontext)
+{
+    std::vector<TensorDesc> outputs;
+    query_tensor_descs(qcontext, NULL, &outputs);
+    size_t elements = outputs.empty() ? 0 : outputs[0].elements;
+    if (elements == 0) {
+        return;
+    }
+    mem_config_encoder_out.cache_type = AML_WITH_CACHE;
+    mem_config_encoder_out.memory_type = AML_VIRTUAL_ADDR;
+    mem_config_encoder_out.direction = AML_MEM_DIRECTION_READ_WRITE;
+    mem_config_encoder_out.index = 0;
+    mem_config_encoder_out.mem_size = elements * sizeof(float);
+    if (aml_util_mallocBuffer(qcontext, &mem_config_encoder_out, &mem_data_encoder_out)) {
+        mem_config_encoder_out.mem_size = 0;
+        return;
+    }
+    if (aml_util_swapExternalOutputBuffer(qcontext, &mem_config_encoder_out, &mem_data_encoder_out)) {
+        printf("aml_util_swapExternalOutputBuffer fail, encoder output stays in SDK memory.\n");
+        aml_util_freeBuffer(qcontext, &mem_config_encoder_out, &mem_data_encoder_out);
+        mem_config_encoder_out.mem_size = 0;
+    }
+}
+
+float* run_network_encoder_process(void *qcontext, std::vector<float> input_ids, int *output_size)
 {
     int ret = 0;
     nn_input inData;
@@ -120,6 +178,7 @@ std::vector<float> run_network_encoder_process(void *qcontext, std::vector<float
     aml_output_config_t outconfig;
 
     is_finish = false; /* init is_finish -> false */
+    StageScope stage("infer");  /* softop threads start on the "infer" CPUs */
     inData.input_index = 0;
     inData.info.input_format = AML_INPUT_DEFAULT;
     inData.size = input_ids.size() * sizeof(float);    /* INPUT_SHAPE --->>> input_ids.size() */
@@ -133,10 +192,13 @@ std::vector<float> run_network_encoder_process(void *qcontext, std::vector<float
             mem_config_encoder.mem_size = inData.size;
             aml_util_mallocBuffer(qcontext, &mem_config_encoder, &mem_data_encoder);
             aml_util_swapExternalInputBuffer(qcontext, &mem_config_encoder, &mem_data_encoder);
+            alloc_encoder_output(qcontext);
         }
 
         inData.input_type = INPUT_DMA_DATA;
         memcpy(mem_data_encoder.viraddr, input_ids.data(), mem_config_encoder.mem_size);
+        /* cached buffer: write the mel back before the NPU reads it */
+        aml_util_flushBuffer(qcontext, &mem_config_encoder, &mem_data_encoder);
         inData.input = NULL;
     } else {
         inData.input = reinterpret_cast<unsigned char*>(input_ids.data());
@@ -159,11 +221,22 @@ std::vector<float> run_network_encoder_process(void *qcontext, std::vector<float
     }
     outconfig.typeSize = sizeof(aml_output_config_t);
     outdata = (nn_output*)aml_module_output_get(qcontext, outconfig);
+    if (NULL == outdata)
+    {
+        *output_size = 0;
+        return NULL;
+    }
 
-    outputData_size = outdata->out[0].size / sizeof(float);
-    std::vector<float> buf_data(reinterpret_cast<float*>(outdata->out[0].buf), reinterpret_cast<float*>(outdata->out[0].buf) + outputData_size);
+    /* drop stale cache lines of the swapped-in output before the CPU
+       reads what the NPU wrote */
+    if (encoder.use_dma && mem_config_encoder_out.mem_size > 0) {
+        aml_util_flushBuffer(qcontext, &mem_config_encoder_out, &mem_data_encoder_out);
+    }
 
-    return buf_data;
+    /* no copy: valid until the next encoder invoke */
+    outputData_size = outdata->out[0].size / sizeof(float);
+    *output_size = outputData_size;
+    return reinterpret_cast<float*>(outdata->out[0].buf);
 }
 
 nn_output* run_network_decoder_process(void *qcontext, Input_Decoder* input_data)
@@ -173,6 +246,7 @@ nn_output* run_network_decoder_process(void *qcontext, Input_Decoder* input_data
 
     nn_output *outdata = NULL;
     aml_output_config_t outconfig;
+    StageScope stage("infer");
 
     for (int i = 0; i < decoder_model_inputs_size; i++)
     {
@@ -188,13 +262,26 @@ nn_output* run_network_decoder_process(void *qcontext, Input_Decoder* input_data
                 mem_config[i].cache_type = AML_WITH_CACHE;
                 mem_config[i].memory_type = AML_VIRTUAL_ADDR;
                 mem_config[i].direction = AML_MEM_DIRECTION_READ_WRITE;
-                aml_util_mallocBuffer(qcontext, &mem_config[i], &mem_data[i]);
+                /* the encoder output buffer doubles as input 0 */
+                if (i == 0) {
+                    decoder_input_0_shared = mem_config_encoder_out.mem_size == mem_config[i].mem_size &&
+                            input_data->input_0 == mem_data_encoder_out.viraddr;
+                }
+                if (i == 0 && decoder_input_0_shared) {
+                    mem_data[i] = mem_data_encoder_out;
+                } else {
+                    aml_util_mallocBuffer(qcontext, &mem_config[i], &mem_data[i]);
+                }
                 aml_util_swapExternalInputBuffer(qcontext, &mem_config[i], &mem_data[i]);
             }
 
             inData.input_type = INPUT_DMA_DATA;
-            memcpy(mem_data[i].viraddr, i == 0 ? static_cast<const void*>(input_data->input_0) : 
-                    static_cast<const void*>(input_data->input_1), mem_config[i].mem_size);
+            const void* src = i == 0 ? static_cast<const void*>(input_data->input_0) :
+                    static_cast<const void*>(input_data->input_1);
+            if (src != mem_data[i].viraddr) {
+                memcpy(mem_data[i].viraddr, src, mem_config[i].mem_size);
+                aml_util_flushBuffer(qcontext, &mem_config[i], &mem_data[i]);
+            }
             inData.input = NULL;
         } else {
             inData.input = i == 0 ? reinterpret_cast<unsigned char*>(const_cast<float*>(input_data->input_0)) : 
@@ -221,21 +308,47 @@ nn_output* run_network_decoder_process(void *qcontext, Input_Decoder* input_data
 
     outdata = (nn_output*)aml_module_output_get(qcontext, outconfig);
 
+    if (outdata && !decoder_record_paused && getenv("AMLNN_RECORD"))
+    {
+        if (!decoder_recorder)
+        {
+            decoder_recorder = TensorRecorder::open(getenv("AMLNN_RECORD"));
+        }
+        if (decoder_recorder)
+        {
+            TensorDesc tokens;
+            tokens.index = 1;
+            tokens.name = "input_1";
+            tokens.dims = {1, (unsigned int)input_data->input_1_size};
+            tokens.format = NN_BUFFER_FORMAT_INT64;
+            tokens.elements = input_data->input_1_size;
+            tokens.bytes = input_data->input_1_size * sizeof(int64_t);
+            uint64_t frame = decoder_recorded_frames++;
+            decoder_recorder->write(AMLT_INPUT, frame, tokens, input_data->input_1, tokens.bytes);
+            decoder_recorder->write_outputs(frame, outdata, std::vector<TensorDesc>(), outconfig.format);
+        }
+    }
+
     return outdata;
 }
 
 std::string run_network_decoder(void *qcontext_sec, Input_Decoder* input_data)
 {
-    int ret = 0;
-    int max_index = 0;
-    std::string out;
-    size_t id_shape, begin_count, last_count;
-
     nn_output* buf_data_sec;
 
     buf_data_sec = run_network_decoder_process(qcontext_sec, input_data);
 
-    float* buf_data = reinterpret_cast<float*>(buf_data_sec->out[0].buf);
+    return run_network_decoder_post_process(buf_data_sec, input_data);
+}
+
+/* greedy token pick from the logits of the last decoded position */
+std::string run_network_decoder_post_process(const nn_output* outdata, Input_Decoder* input_data)
+{
+    int max_index = 0;
+    std::string out;
+    size_t id_shape, begin_count, last_count;
+
+    float* buf_data = reinterpret_cast<float*>(outdata->out[0].buf);
 
     id_shape = decoder_input_1_size;
 
@@ -262,6 +375,120 @@ std::string run_network_decoder(void *qcontext_sec, Input_Decoder* input_data)
     return out;
 }
 
+/* runs the decoder post-process over steps recorded with AMLNN_RECORD, no NPU needed */
+int replay_network_decoder(const char *replay_path, int repeat)
+{
+    std::unique_ptr<TensorReplay> replay = TensorReplay::open(replay_path);
+    if (!replay || replay->frames() == 0)
+    {
+        printf("no decoder steps in %s\n", replay_path);
+        return -1;
+    }
+    if (load_tokenizer(WHISPER_TOKENIZER_PATH))
+    {
+        return -1;
+    }
+
+    double total_ms = 0;
+    size_t steps = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        decoder_input_1_size = 2;
+        is_finish = false;
+        for (size_t f = 0; f < replay->frames(); f++)
+        {
+            const std::vector<ReplayTensor>& inputs = replay->inputs(f);
+            const nn_output* outdata = replay->output(f);
+            if (inputs.empty() || outdata->num == 0)
+            {
+                printf("step %llu has no tokens or logits\n", (unsigned long long)replay->frame_id(f));
+                return -1;
+            }
+            /* post-process writes the picked token into input_1, so work on a copy */
+            std::vector<int64_t> tokens((const int64_t *)inputs[0].data, (const int64_t *)inputs[0].data + inputs[0].size / sizeof(int64_t));
+            Input_Decoder input_data = {NULL, 0, tokens.data(), (int)tokens.size()};
+
+            double start = wall_ms();
+            std::string out = run_network_decoder_post_process(outdata, &input_data);
+            total_ms += wall_ms() - start;
+            steps++;
+
+            if (r == 0)
+            {
+                std::cout << out << std::flush;
+                if (is_finish)
+                {
+                    std::cout << std::endl;
+                }
+            }
+            is_finish = false;
+        }
+    }
+    printf("\ndecoder post-process : %zu steps, %.3f ms mean\n", steps, total_ms / steps);
+    return 0;
+}
+
+
+/* Runs encoder + decoder `runs` times on silence, through the same DMA
+   buffers as real audio, so the first utterance does not pay buffer
+   allocation, page faults, cache misses and clock ramp-up. */
+int warmup_network(void *context_enc, void *context_dec, int runs, double *cold_ms, double *warm_ms)
+{
+    std::vector<TensorDesc> inputs;
+    query_tensor_descs(context_enc, &inputs, NULL);
+    size_t mel_size = inputs.empty() ? 0 : inputs[0].elements;
+    double warm_total = 0;
+
+    *cold_ms = *warm_ms = 0;
+    if (runs <= 0) {
+        return 0;
+    }
+    if (mel_size == 0) {
+        printf("warmup_network: encoder input size unknown.\n");
+        return -1;
+    }
+    /* keeps the dummy steps out of an AMLNN_RECORD recording, on every return */
+    struct RecordPause {
+        RecordPause() { decoder_record_paused = true; }
+        ~RecordPause() { decoder_record_paused = false; }
+    } record_pause;
+
+    std::vector<float> mel(mel_size, 0.0f);
+    std::vector<int64_t> tokens(INPUT_SHAPE, 0);
+    tokens[0] = 50257;
+    tokens[1] = 50362;
+
+    for (int i = 0; i < runs; i++)
+    {
+        double start = wall_ms();
+        int features_size = 0;
+        float *features = run_network_encoder_process(context_enc, mel, &features_size);
+        if (NULL == features) {
+            printf("warmup_network: encoder invoke fail.\n");
+            return -1;
+        }
+
+        Input_Decoder input;
+        input.input_0 = features;
+        input.input_0_size = features_size;
+        input.input_1 = tokens.data();
+        input.input_1_size = tokens.size();
+        if (NULL == run_network_decoder_process(context_dec, &input)) {
+            printf("warmup_network: decoder invoke fail.\n");
+            return -1;
+        }
+
+        double elapsed = wall_ms() - start;
+        if (i == 0) {
+            *cold_ms = elapsed;
+        } else {
+            warm_total += elapsed;
+        }
+    }
+    *warm_ms = runs > 1 ? warm_total / (runs - 1) : *cold_ms;
+    return 0;
+}
+
 int destroy_network(void *qcontext)
 {
     int ret = 0;
@@ -276,6 +503,10 @@ int destroy_network(void *qcontext)
         {
             std::cout << "aml_util_freeBuffer fail." << std::endl;
         }
+        if (mem_config_encoder_out.mem_size != 0 && aml_util_freeBuffer(qcontext, &mem_config_encoder_out, &mem_data_encoder_out))
+        {
+            std::cout << "aml_util_freeBuffer fail." << std::endl;
+        }
     }
     encoder.use_dma = false;
 
@@ -284,7 +515,7 @@ int destroy_network(void *qcontext)
        and set decoder.malloc_buffer_once is true
     */
     if (decoder.malloc_buffer_once && mem_config[0].mem_size != 0) {
-        for (int i = 0; i < decoder_model_inputs_size; i++)
+        for (int i = decoder_input_0_shared ? 1 : 0; i < decoder_model_inputs_size; i++)
         {
             ret = aml_util_freeBuffer(qcontext, &mem_config[i], &mem_data[i]);
             if (ret)
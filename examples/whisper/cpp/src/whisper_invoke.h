@@ -29,10 +29,16 @@ struct Input_Decoder {
     int input_1_size;
 };
 
+#define WHISPER_TOKENIZER_PATH "./data_bin/tokenizer_info.bin"
+
 void* init_network_file(const char *model_path);
+int load_tokenizer(const char *token_path);
 std::vector<float> do_pre_process(std::string fname_inp);
-std::vector<float> run_network_encoder_process(void *qcontext, std::vector<float> input_ids);
+float* run_network_encoder_process(void *qcontext, std::vector<float> input_ids, int *output_size);
 std::string run_network_decoder(void *qcontext_sec, Input_Decoder* input_data);
+std::string run_network_decoder_post_process(const nn_output* outdata, Input_Decoder* input_data);
+int replay_network_decoder(const char *replay_path, int repeat);
+int warmup_network(void *context_enc, void *context_dec, int runs, double *cold_ms, double *warm_ms);
 bool is_finish_end();
 int destroy_network(void *qcontext);
 
@@ -24,12 +24,10 @@
 #include <opencv2/opencv.hpp>
 #include "nn_sdk.h"
 #include "model_loader.h"
+#include "model_session.h"
+#include "quant_input.h"
 
 
-#define HEIGHT 288
-#define WIDTH 512
-#define NUM_BOX 3024
-
 struct PreprocessParam {
     float scale;
     int pad_x;
@@ -51,7 +49,34 @@ struct PostprocessParam {
 };
 
 
-static int preprocess(const cv::Mat& src, cv::Mat& dst, PreprocessParam& param) {
+// Outputs used by postprocess, located by shape: boxes are {1, 4, N}
+// (cx, cy, w, h planes) and scores {1, 1, N}.
+struct OutputLayout {
+    int box_index = -1;
+    int conf_index = -1;
+    int num_box = 0;
+};
+
+
+static int find_outputs(const std::vector<TensorDesc>& outputs, OutputLayout& layout) {
+    for (const auto& desc : outputs) {
+        if (desc.dims.size() >= 2 && desc.dim(-2) == 4) {
+            layout.box_index = desc.index;
+            layout.num_box = desc.dim(-1);
+            break;
+        }
+    }
+    for (const auto& desc : outputs) {
+        if ((int)desc.index != layout.box_index && layout.num_box > 0 && desc.elements == (size_t)layout.num_box) {
+            layout.conf_index = desc.index;
+            break;
+        }
+    }
+    return (layout.box_index < 0 || layout.conf_index < 0) ? -1 : 0;
+}
+
+
+static int preprocess(const cv::Mat& src, cv::Mat& dst, int height, int width, PreprocessParam& param) {
     int h = 0;
     int w = 0;
     float scale = 0.0f;
@@ -60,18 +85,18 @@ static int preprocess(const cv::Mat& src, cv::Mat& dst, PreprocessParam& param)
     cv::Mat img_resized;
     h = src.rows;
     w = src.cols;
-    scale = std::min(HEIGHT / static_cast<float>(h),
-                        WIDTH / static_cast<float>(w));
+    scale = std::min(height / static_cast<float>(h),
+                        width / static_cast<float>(w));
     nh = static_cast<int>(h * scale);
     nw = static_cast<int>(w * scale);
     cv::resize(src, img_resized, cv::Size(nw, nh));
 
-    int top = (HEIGHT - nh) / 2;
-    int left = (WIDTH - nw) / 2;
+    int top = (height - nh) / 2;
+    int left = (width - nw) / 2;
 
-    cv::Mat back(HEIGHT,WIDTH, CV_8UC3, cv::Scalar(114, 114, 114));
+    cv::Mat back(height, width, CV_8UC3, cv::Scalar(114, 114, 114));
     img_resized.copyTo(back(cv::Rect(left, top, nw, nh)));
-    back.convertTo(dst, CV_32F, 1.0 / 255.0);
+    dst = back;
 
     param.scale = scale;
     param.pad_x = left;
@@ -85,20 +110,20 @@ static int preprocess(const cv::Mat& src, cv::Mat& dst, PreprocessParam& param)
 
 
 
-static int postprocess(const float* nn_box_output, const float* nn_conf_output,
+static int postprocess(const float* nn_box_output, const float* nn_conf_output, int num_box,
                             const PreprocessParam& pre_param,
                             const PostprocessParam& post_param,
                             std::vector<Box>& boxes) {
     std::vector<cv::Rect> rects;
     std::vector<float> confs;
-    for (int i = 0; i < NUM_BOX; i++) {
+    for (int i = 0; i < num_box; i++) {
         float conf = 1/(1 + std::exp(-nn_conf_output[i]));
         if (conf < post_param.conf_thresh) continue;
 
-        float cx = nn_box_output[0 * NUM_BOX + i];
-        float cy = nn_box_output[1 * NUM_BOX + i];
-        float w = nn_box_output[2 * NUM_BOX + i];
-        float h = nn_box_output[3 * NUM_BOX + i];
+        float cx = nn_box_output[0 * num_box + i];
+        float cy = nn_box_output[1 * num_box + i];
+        float w = nn_box_output[2 * num_box + i];
+        float h = nn_box_output[3 * num_box + i];
 
         float x1 = cx - w / 2;
         float y1 = cy - h / 2;
@@ -139,63 +164,86 @@ int main(int argc, char** argv) {
     std::string model_path = argv[1];
     std::string image_path = argv[2];
 
-    void* context = init_network(model_path.c_str());
-    if (!context) {
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path.c_str());
+    if (!session) {
         std::cerr << "Failed to initialize network." << std::endl;
         return -1;
     }
+    OutputLayout layout;
+    if (session->inputs().empty() || find_outputs(session->outputs(), layout)) {
+        std::cerr << "Model has no box/score outputs of the expected shape." << std::endl;
+        return -1;
+    }
+    // NHWC input {1, H, W, 3}
+    int input_h = session->inputs()[0].dim(-3);
+    int input_w = session->inputs()[0].dim(-2);
+
+    // Pixels are normalized by 1/255 and mapped to the input's quantized
+    // domain; a float input gets the normalized values instead
+    static const float norm[3] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
+    InputQuantizer quantizer;
+    if (quantizer.init(session->inputs()[0], 3, NULL, norm)) {
+        std::cerr << "Unsupported model input." << std::endl;
+        return -1;
+    }
 
     cv::Mat img = cv::imread(image_path);
     if (img.empty()) {
         std::cerr << "Failed to load image from " << image_path << std::endl;
-        uninit_network(context);
         return -1;
     }
 
     cv::Mat img_rgb, processed_img;
     cv::cvtColor(img, img_rgb, cv::COLOR_BGR2RGB);
     PreprocessParam pre_param;
-    preprocess(img_rgb, processed_img, pre_param);
-
-    nn_input inData;
-    memset(&inData, 0, sizeof(nn_input));
-    inData.input_type = BINARY_RAW_DATA;
-    inData.input = processed_img.data;
-    inData.input_index = 0;
-    inData.size = WIDTH * HEIGHT * 3 * sizeof(float);
-
-    if (aml_module_input_set(context, &inData) != 0) {
+    preprocess(img_rgb, processed_img, input_h, input_w, pre_param);
+    const size_t pixels = processed_img.total();
+
+    // A quantized input is written straight into the NPU input buffer,
+    // sized from the tensor info; float data goes through
+    // aml_module_input_set, which converts it for the model.
+    std::vector<float> float_input(quantizer.quantized() ? 0 : pixels * 3);
+    if (!quantizer.quantized()) {
+        quantizer.apply(processed_img.data, pixels, float_input.data());
+    }
+    auto fill = [&](ModelSession& s, int) {
+        if (!quantizer.quantized()) {
+            return quantizer.upload(s, 0, float_input.data(), pixels, AML_INPUT_MODEL_NHWC);
+        }
+        TensorView input = s.input(0);
+        if (!input.data || quantizer.bytes(pixels) > input.size) {
+            return -1;
+        }
+        quantizer.apply(processed_img.data, pixels, input.data);
+        return 0;
+    };
+    if (fill(*session, 0) != 0) {
          std::cerr << "Failed to set input." << std::endl;
-         uninit_network(context);
          return -1;
     }
+    if (session->warmup(2, fill) == 0) {
+        const WarmupStats& warm = session->warmup_stats();
+        std::cout << "Warm-up: cold " << warm.cold_ms << " ms, warm " << warm.warm_ms << " ms" << std::endl;
+    }
 
-    aml_output_config_t outconfig;
-    memset(&outconfig, 0, sizeof(aml_output_config_t));
-    outconfig.typeSize = sizeof(aml_output_config_t);
-    outconfig.format = AML_OUTDATA_FLOAT32;
-    
-    nn_output* outdata = (nn_output*)aml_module_output_get(context, outconfig);
+    nn_output* outdata = session->run();
     if (!outdata) {
          std::cerr << "Failed to run network (get output)." << std::endl;
-         uninit_network(context);
          return -1;
     }
 
-    float* box_output = (float*)outdata->out[1].buf;
-    float* conf_output = (float*)outdata->out[2].buf;
+    float* box_output = (float*)outdata->out[layout.box_index].buf;
+    float* conf_output = (float*)outdata->out[layout.conf_index].buf;
 
     PostprocessParam post_param;
     std::vector<Box> boxes;
-    postprocess(box_output, conf_output, pre_param, post_param, boxes);
+    postprocess(box_output, conf_output, layout.num_box, pre_param, post_param, boxes);
 
     std::cout << "Objects:\n";
     for (auto& box : boxes) {
         std::cout << "[ " << box.x1 << ", " << box.y1 << ", " << box.x2 << ", " << box.y2 << " ]\n"; 
     }
     std::cout << std::endl;
-    
-    uninit_network(context);
 
     return 0;
 }
@@ -1,89 +1,173 @@
 #include <iostream>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
 #include <opencv2/opencv.hpp>
 #include <float.h>
 #include "nn_sdk.h"
 #include "postprocess.h"
+#include "model_session.h"
+#include "async_pipeline.h"
+#include "quant_input.h"
+#include "output_view.h"
 
 namespace fs = std::filesystem;
 
-static void hwc_to_chw(const cv::Mat& src, float* dst) {
-    int h = src.rows, w = src.cols;
-    for (int k = 0; k < 3; ++k) {
-        for (int i = 0; i < h; ++i) {
-            for (int j = 0; j < w; ++j) {
-                dst[k * h * w + i * w + j] = src.at<cv::Vec3f>(i, j)[k];
-            }
+static constexpr float kScoreThreshold = 0.3f;
+
+// A detection head, NHWC {1, grid_h, grid_w, 64 DFL + classes}; the stride
+// follows from how far the grid is downsampled from the input.
+struct Head {
+    int index;
+    int grid_h, grid_w;
+    int stride;
+};
+
+// Heads located by shape in the output descriptors.
+static std::vector<Head> find_heads(const std::vector<TensorDesc>& outputs, int input_h) {
+    std::vector<Head> heads;
+    for (const auto& desc : outputs) {
+        if (desc.dims.size() < 3 || desc.dim(-1) != (unsigned int)kTotalChannels || desc.dim(-3) == 0) continue;
+        Head head;
+        head.index = desc.index;
+        head.grid_h = desc.dim(-3);
+        head.grid_w = desc.dim(-2);
+        head.stride = input_h / head.grid_h;
+        heads.push_back(head);
+    }
+    return heads;
+}
+
+// Decodes one NHWC head. Class logits are compared raw against the
+// threshold (sigmoid is monotonic); only cells that pass are dequantized.
+template <typename View>
+static void decode_head(const View& data, const Head& head, float scale, int px, int py, const cv::Mat& img,
+                        std::vector<cv::Rect>& bboxes, std::vector<float>& confs, std::vector<int>& class_ids) {
+    const int grid_h = head.grid_h, grid_w = head.grid_w, stride = head.stride;
+    const float logit_thresh = std::log(kScoreThreshold / (1.0f - kScoreThreshold));
+    if (!data.reachable(logit_thresh)) return;
+    const auto raw_thresh = data.threshold(logit_thresh);
+    for (int g = 0; g < grid_h * grid_w; g++) {
+        size_t feat = (size_t)g * kTotalChannels;
+        int cls_id = 0;
+        auto max_raw = data.raw(feat + 64);
+        for (int c = 1; c < kNumClasses; c++) {
+            auto value = data.raw(feat + 64 + c);
+            if (value > max_raw) { max_raw = value; cls_id = c; }
         }
+        if (max_raw < raw_thresh) continue;
+
+        float max_score = 1.0f / (1.0f + std::exp(-data[feat + 64 + cls_id]));
+        if (max_score < kScoreThreshold) continue;
+        float dfl[4 * kDflChannels];
+        for (int k = 0; k < 4 * kDflChannels; k++) dfl[k] = data[feat + k];
+        float d_l = decode_dfl(dfl + 0), d_t = decode_dfl(dfl + 16);
+        float d_r = decode_dfl(dfl + 32), d_b = decode_dfl(dfl + 48);
+        float cx = (g % grid_w) + 0.5f, cy = (g / grid_w) + 0.5f;
+        int rx1 = std::max(0, (int)(((cx - d_l) * stride - px) / scale));
+        int ry1 = std::max(0, (int)(((cy - d_t) * stride - py) / scale));
+        int rx2 = std::min(img.cols, (int)(((cx + d_r) * stride - px) / scale));
+        int ry2 = std::min(img.rows, (int)(((cy + d_b) * stride - py) / scale));
+        bboxes.push_back(cv::Rect(rx1, ry1, rx2 - rx1, ry2 - ry1));
+        confs.push_back(max_score); class_ids.push_back(cls_id);
     }
 }
 
+// Per-slot frame state, kept alive until the frame's outputs are consumed.
+struct Frame {
+    fs::path path;
+    cv::Mat img;
+    float scale = 1.0f;
+    int px = 0, py = 0;
+};
+
 int main(int argc, char** argv) {
     if (argc < 3) { std::cout << "Usage: " << argv[0] << " <model.adla> <image_dir>\n"; return 0; }
 
-    aml_config cfg{};
-    cfg.typeSize = sizeof(cfg); cfg.modelType = ADLA_LOADABLE; cfg.nbgType = NN_ADLA_FILE; cfg.path = argv[1];
-    void* ctx = aml_module_create(&cfg);
-    if (!ctx) return -1;
+    SessionConfig config;
+    config.input_slots = 2;
+    config.output_ring = 2;
+    config.output_format = AML_OUTDATA_RAW;
+    config.cpu_stage = "infer";   // CPU sets from AMLNN_CPUS
+    std::unique_ptr<ModelSession> session = ModelSession::create(argv[1], config);
+    if (!session || session->inputs().empty()) return -1;
+    // NCHW {1, 3, H, W} or NHWC {1, H, W, 3} input
+    const TensorDesc& in = session->inputs()[0];
+    const bool nhwc = in.dim(-1) == 3;
+    const int input_h = nhwc ? in.dim(-3) : in.dim(-2);
+    const int input_w = nhwc ? in.dim(-2) : in.dim(-1);
+    const std::vector<Head> heads = find_heads(session->outputs(), input_h);
+    if (heads.empty()) {
+        std::cerr << "Model has no detection heads of " << kTotalChannels << " channels." << std::endl;
+        return -1;
+    }
 
-    std::vector<float> chw_buffer(kInputW * kInputH * 3);
-    fs::create_directory("yolo11_result");
+    // Pixels are normalized by 1/255 and quantized with the input's own
+    // scale / zero point in one table lookup, straight into the slot's
+    // NPU input buffer.
+    static const float norm[3] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
+    InputQuantizer quantizer;
+    if (quantizer.init(session->inputs()[0], 3, NULL, norm) || !quantizer.quantized()) {
+        std::cerr << "Model input is not 8-bit quantized." << std::endl;
+        return -1;
+    }
+    const size_t pixels = (size_t)input_w * input_h;
+    // Allocate both input slots and warm them up before the first frame
+    if (!session->input(0, 0, 0).data || !session->input(0, 0, 1).data || session->warmup(2)) {
+        std::cerr << "Failed to warm up network." << std::endl;
+        return -1;
+    }
+    printf("Warm-up: cold %.2f ms, warm %.2f ms\n", session->warmup_stats().cold_ms, session->warmup_stats().warm_ms);
 
+    std::vector<fs::path> images;
     for (auto& it : fs::directory_iterator(argv[2])) {
-        cv::Mat img = cv::imread(it.path().string());
-        if (img.empty()) continue;
+        if (it.is_regular_file()) images.push_back(it.path());
+    }
+    std::sort(images.begin(), images.end());
+
+    Frame frames[2];
+    fs::create_directory("yolo11_result");
+
+    PipelineCallbacks callbacks;
+    callbacks.prepare = [&](size_t index, int slot) {
+        Frame& f = frames[slot];
+        f.path = images[index];
+        f.img = cv::imread(f.path.string());
+        if (f.img.empty()) return -1;
+
+        f.scale = std::min((float)input_w / f.img.cols, (float)input_h / f.img.rows);
+        int nw = f.img.cols * f.scale, nh = f.img.rows * f.scale;
+        f.px = (input_w - nw) / 2; f.py = (input_h - nh) / 2;
+        cv::Mat res, canvas(input_h, input_w, CV_8UC3, cv::Scalar(114, 114, 114));
+        cv::resize(f.img, res, {nw, nh});
+        res.copyTo(canvas(cv::Rect(f.px, f.py, nw, nh)));
+        TensorView input = session->input(0, 0, slot);
+        if (!input.data || quantizer.bytes(pixels) > input.size) return -1;
+        if (nhwc) {
+            quantizer.apply(canvas.data, pixels, input.data);
+        } else {
+            quantizer.apply_planar(canvas.data, pixels, input.data);
+        }
+        return 0;
+    };
+    callbacks.consume = [&](size_t index, const nn_output* out) {
+        Frame& f = frames[index % 2];
+        cv::Mat& img = f.img;
+        float scale = f.scale;
+        int px = f.px, py = f.py;
 
         std::cout << "============================================================" << std::endl;
-        std::cout << "Processing image: \"" << it.path().filename().string() << "\"" << std::endl;
+        std::cout << "Processing image: \"" << f.path.filename().string() << "\"" << std::endl;
         std::cout << "============================================================" << std::endl;
 
-        float scale = std::min((float)kInputW / img.cols, (float)kInputH / img.rows);
-        int nw = img.cols * scale, nh = img.rows * scale;
-        int px = (kInputW - nw) / 2, py = (kInputH - nh) / 2;
-        cv::Mat res, canvas = cv::Mat::zeros(kInputH, kInputW, CV_32FC3);
-        canvas.setTo(cv::Scalar(114.0/255.0, 114.0/255.0, 114.0/255.0)); 
-        cv::resize(img, res, {nw, nh});
-        res.convertTo(res, CV_32FC3, 1.0 / 255.0); 
-        res.copyTo(canvas(cv::Rect(px, py, nw, nh)));
-        hwc_to_chw(canvas, chw_buffer.data());
-
-        nn_input in{}; in.typeSize = sizeof(in); in.input_type = BINARY_RAW_DATA;
-        in.input = (unsigned char*)chw_buffer.data(); in.size = chw_buffer.size() * 4;
-        in.info.valid = 1; in.info.input_format = AML_INPUT_MODEL_NCHW; in.info.input_data_type = AML_INPUT_FP32;
-        aml_module_input_set(ctx, &in);
-
-        aml_output_config_t outcfg{}; outcfg.typeSize = sizeof(outcfg); outcfg.format = AML_OUTDATA_FLOAT32;
-        nn_output* out = (nn_output*)aml_module_output_get(ctx, outcfg);
-        if (!out) continue;
-
         std::vector<cv::Rect> bboxes;
         std::vector<float> confs;
         std::vector<int> class_ids;
-        std::vector<int> strides = {32, 16, 8};
-
-        for (int i = 0; i < out->num; i++) {
-            float* data = (float*)out->out[i].buf;
-            int stride = strides[i], grid_h = kInputH / stride, grid_w = kInputW / stride;
-            for (int g = 0; g < grid_h * grid_w; g++) {
-                float* feat = data + g * kTotalChannels;
-                float max_score = -1.0f; int cls_id = -1;
-                for (int c = 0; c < kNumClasses; c++) {
-                    float score = 1.0f / (1.0f + std::exp(-feat[64 + c]));
-                    if (score > max_score) { max_score = score; cls_id = c; }
-                }
-                if (max_score > 0.3f) {
-                    float d_l = decode_dfl(feat + 0), d_t = decode_dfl(feat + 16);
-                    float d_r = decode_dfl(feat + 32), d_b = decode_dfl(feat + 48);
-                    float cx = (g % grid_w) + 0.5f, cy = (g / grid_w) + 0.5f;
-                    int rx1 = std::max(0, (int)(((cx - d_l) * stride - px) / scale));
-                    int ry1 = std::max(0, (int)(((cy - d_t) * stride - py) / scale));
-                    int rx2 = std::min(img.cols, (int)(((cx + d_r) * stride - px) / scale));
-                    int ry2 = std::min(img.rows, (int)(((cy + d_b) * stride - py) / scale));
-                    bboxes.push_back(cv::Rect(rx1, ry1, rx2 - rx1, ry2 - ry1));
-                    confs.push_back(max_score); class_ids.push_back(cls_id);
-                }
-            }
+        for (const Head& head : heads) {
+            if (head.index >= (int)out->num) continue;
+            visit_output(out->out[head.index], config.output_format, [&](const auto& data) {
+                decode_head(data, head, scale, px, py, img, bboxes, confs, class_ids);
+            });
         }
 
         std::vector<int> indices = manual_nms(bboxes, confs, 0.45f);
@@ -92,7 +176,7 @@ int main(int argc, char** argv) {
             for (size_t i = 0; i < indices.size(); i++) {
                 int idx = indices[i];
                 printf("  %zu. %s (%.2f)\n", i + 1, kClassNames[class_ids[idx]].c_str(), confs[idx]);
-                
+
                 cv::rectangle(img, bboxes[idx], {0, 255, 0}, 2);
                 char text[256]; std::sprintf(text, "%s %.2f", kClassNames[class_ids[idx]].c_str(), confs[idx]);
                 cv::putText(img, text, {bboxes[idx].x, bboxes[idx].y - 5}, cv::FONT_HERSHEY_SIMPLEX, 0.5, {0, 255, 0}, 1);
@@ -101,11 +185,16 @@ int main(int argc, char** argv) {
             std::cout << "No objects detected." << std::endl;
         }
 
-        std::string out_path = "yolo11_result/" + it.path().filename().string();
+        std::string out_path = "yolo11_result/" + f.path.filename().string();
         cv::imwrite(out_path, img);
         std::cout << "Result saved to: " << out_path << std::endl;
         std::cout << "============================================================" << std::endl << std::endl;
-    }
+    };
 
-    aml_module_destroy(ctx); return 0;
-}
\ No newline at end of file
+    PipelineStats stats;
+    if (run_pipelined(*session, images.size(), callbacks, &stats) != 0) return -1;
+    printf("Processed %zu images in %.2f ms (%.2f FPS end-to-end)\n", stats.frames, stats.total_ms, stats.fps);
+    if (stats.failed > 0) printf("%zu images failed.\n", stats.failed);
+    printf("%s", ThreadPlacement::instance().report().c_str());
+    return 0;
+}
@@ -5,8 +5,6 @@
 #include <string>
 #include <opencv2/opencv.hpp>
 
-static constexpr int kInputW = 640;
-static constexpr int kInputH = 640;
 static constexpr int kNumClasses = 80;
 static constexpr int kDflChannels = 16;
 static constexpr int kTotalChannels = 144;
@@ -20,28 +20,213 @@
 #include <chrono>
 #include <tuple>
 #include <iomanip>
+#include <algorithm>
+#include <filesystem>
 #include <opencv2/opencv.hpp>
 #include "postprocess.h"
 #include "model_loader.h"
+#include "model_session.h"
+#include "quant_input.h"
+#include "async_pipeline.h"
+#include "tensor_dump.h"
+
+namespace fs = std::filesystem;
 
 const std::string DEFAULT_OUTPUT_PATH = "./result.jpg";
-const int MODEL_INPUT_WIDTH = 640;
-const int MODEL_INPUT_HEIGHT = 640;
 const float SCORE_THRESHOLD = 0.25f;
 const float NMS_THRESHOLD = 0.45f;
+const std::string DEFAULT_OUTPUT_DIR = "yolov8_result";
+
+// Model input size (height, width) from the NHWC input tensor.
+static std::tuple<int, int> input_shape(const ModelSession& session) {
+    const TensorDesc& in = session.inputs()[0];
+    return std::make_tuple((int)in.dim(-3), (int)in.dim(-2));
+}
+
+static std::vector<Detection> detect(const std::vector<TensorDesc>& heads, int input_h, aml_output_format_t format,
+                                     const nn_output* outdata,
+                                     const std::tuple<cv::Mat, float, std::tuple<int, int>>& input_tuple) {
+    // Each head is NHWC {1, grid_h, grid_w, 64 DFL + classes}; the stride
+    // follows from how far the grid is downsampled from the input.
+    auto head = [&](int i) {
+        const TensorDesc& desc = heads[i];
+        int grid_h = desc.dim(-3), grid_w = desc.dim(-2), channels = desc.dim(-1);
+        return std::make_tuple((const outBuf_t*)&outdata->out[i], std::make_tuple(grid_h, grid_w, channels), input_h / grid_h);
+    };
+
+    return postprocess(
+        head(0),
+        head(1),
+        head(2),
+        input_tuple,
+        SCORE_THRESHOLD,
+        NMS_THRESHOLD,
+        format
+    );
+}
+
+static std::vector<Detection> detect(const ModelSession& session, const nn_output* outdata,
+                                     const std::tuple<cv::Mat, float, std::tuple<int, int>>& input_tuple) {
+    return detect(session.outputs(), std::get<0>(input_shape(session)), session.config().output_format,
+                  outdata, input_tuple);
+}
+
+// The model must expose one 8-bit quantized NHWC input and three detection
+// heads. Pixels are mapped from uint8 to the input's quantized domain with
+// the model's own scale / zero point (normalized by 1/255 first).
+static bool check_tensors(const ModelSession& session, InputQuantizer& quantizer) {
+    if (session.inputs().empty() || session.outputs().size() != 3) {
+        std::cerr << "Unexpected model tensors: " << session.inputs().size() << " inputs, "
+                  << session.outputs().size() << " outputs." << std::endl;
+        return false;
+    }
+    static const float norm[3] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
+    if (quantizer.init(session.inputs()[0], 3, NULL, norm) || !quantizer.quantized()) {
+        std::cerr << "Model input is not 8-bit quantized." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Writes the letterboxed uint8 image into the NPU input buffer.
+static int fill_input(const InputQuantizer& quantizer, const cv::Mat& img, TensorView input) {
+    if (!input.data || !img.isContinuous() || quantizer.bytes(img.total()) > input.size) {
+        return -1;
+    }
+    quantizer.apply(img.data, img.total(), input.data);
+    return 0;
+}
+
+// Directory mode: frame N+1 is preprocessed and frame N-1 postprocessed
+// while the NPU runs frame N.
+static int run_directory(const std::string& model_path, const std::string& image_dir) {
+    std::vector<fs::path> images;
+    for (auto& it : fs::directory_iterator(image_dir)) {
+        if (it.is_regular_file()) images.push_back(it.path());
+    }
+    std::sort(images.begin(), images.end());
+
+    // Stage CPU sets come from AMLNN_CPUS, e.g. "pre=little;infer=big;post=little".
+    // OpenCV's pool is sized to the "pre" set and started inside it.
+    cv::setNumThreads(ThreadPlacement::instance().threads("pre", cv::getNumThreads()));
+    SessionConfig config;
+    config.input_slots = 2;
+    config.output_ring = 2;
+    config.output_format = AML_OUTDATA_RAW;
+    config.cpu_stage = "infer";
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path.c_str(), config);
+    InputQuantizer quantizer;
+    if (!session || !check_tensors(*session, quantizer)) {
+        std::cerr << "Failed to initialize network." << std::endl;
+        return -1;
+    }
+    // Allocate both input slots and warm them up before the first frame
+    if (!session->input(0, 0, 0).data || !session->input(0, 0, 1).data || session->warmup(2)) {
+        std::cerr << "Failed to warm up network." << std::endl;
+        return -1;
+    }
+    fs::create_directory(DEFAULT_OUTPUT_DIR);
+
+    cv::Mat frames[2];
+    std::tuple<cv::Mat, float, std::tuple<int, int>> inputs[2];
+
+    PipelineCallbacks callbacks;
+    callbacks.prepare = [&](size_t frame, int slot) {
+        frames[slot] = cv::imread(images[frame].string());
+        if (frames[slot].empty()) {
+            std::cerr << "Failed to load image from " << images[frame] << std::endl;
+            return -1;
+        }
+        inputs[slot] = preprocess(frames[slot], input_shape(*session));
+        return fill_input(quantizer, std::get<0>(inputs[slot]), session->input(0, 0, slot));
+    };
+    callbacks.consume = [&](size_t frame, const nn_output* outdata) {
+        int slot = frame % 2;
+        std::vector<Detection> detections = detect(*session, outdata, inputs[slot]);
+        std::string out_path = DEFAULT_OUTPUT_DIR + "/" + images[frame].filename().string();
+        cv::imwrite(out_path, draw_detections(frames[slot], detections));
+        std::cout << images[frame].filename().string() << ": " << detections.size() << " detections" << std::endl;
+    };
+
+    PipelineStats stats;
+    if (run_pipelined(*session, images.size(), callbacks, &stats) != 0) {
+        return -1;
+    }
+    std::cout << "Processed " << stats.frames << " images in " << stats.total_ms << " ms ("
+              << std::fixed << std::setprecision(2) << stats.fps << " FPS end-to-end)" << std::endl;
+    if (stats.failed > 0) {
+        std::cout << stats.failed << " images failed." << std::endl;
+    }
+    std::cout << ThreadPlacement::instance().report();
+    return 0;
+}
+
+// Replay mode: postprocessing over outputs recorded with AMLNN_RECORD, no
+// NPU needed. Boxes stay in model input coordinates (scale 1, no padding),
+// so runs before and after a postprocess change can be diffed directly.
+static int run_replay(const std::string& replay_path, int repeat) {
+    std::unique_ptr<TensorReplay> replay = TensorReplay::open(replay_path.c_str());
+    if (!replay || replay->frames() == 0) {
+        std::cerr << "No frames in " << replay_path << std::endl;
+        return -1;
+    }
+    const std::tuple<cv::Mat, float, std::tuple<int, int>> identity(cv::Mat(), 1.0f, std::make_tuple(0, 0));
+    double total_ms = 0;
+    size_t runs = 0;
+    for (int r = 0; r < repeat; ++r) {
+        for (size_t f = 0; f < replay->frames(); ++f) {
+            std::vector<TensorDesc> heads = replay->output_descs(f);
+            if (heads.size() != 3) {
+                std::cerr << "Frame " << replay->frame_id(f) << " has " << heads.size() << " outputs." << std::endl;
+                return -1;
+            }
+            // Boxes are rescaled by the model input size, which only the
+            // recorded input tensor gives
+            const std::vector<ReplayTensor>& in = replay->inputs(f);
+            if (in.empty()) {
+                std::cerr << "Frame " << replay->frame_id(f) << " has no input tensor; cannot tell the model input size." << std::endl;
+                return -1;
+            }
+            int input_h = (int)in[0].desc.dim(-3);
+
+            auto start = std::chrono::steady_clock::now();
+            std::vector<Detection> detections = detect(heads, input_h, replay->output_format(f), replay->output(f), identity);
+            total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            ++runs;
+
+            if (r > 0) continue;
+            std::cout << "frame " << replay->frame_id(f) << ": " << detections.size() << " detections" << std::endl;
+            for (const Detection& d : detections) {
+                printf("  %d %.4f %.2f %.2f %.2f %.2f\n", d.class_id, d.score, d.x1, d.y1, d.x2, d.y2);
+            }
+        }
+    }
+    std::cout << "Postprocess: " << runs << " frames, " << std::fixed << std::setprecision(3)
+              << total_ms / runs << " ms mean" << std::endl;
+    return 0;
+}
 
 int main(int argc, char** argv) {
     std::string model_path;
     std::string image_path;
 
+    if (argc >= 3 && std::string(argv[1]) == "--replay") {
+        return run_replay(argv[2], argc > 3 ? std::max(1, atoi(argv[3])) : 1);
+    }
     if (argc != 3) {
-        printf("%s <model_path> <image_path>\n", argv[0]);
+        printf("%s <model_path> <image_path|image_dir>\n", argv[0]);
+        printf("%s --replay <file.amlt> [repeat]\n", argv[0]);
         return -1;
     }
 
     if (argc > 1) model_path = argv[1];
     if (argc > 2) image_path = argv[2];
 
+    if (fs::is_directory(image_path)) {
+        std::cout << "YOLOv8 Demo (directory mode)" << std::endl;
+        return run_directory(model_path, image_path);
+    }
+
     std::cout << "YOLOv8 Demo" << std::endl;
     std::cout << "Model: " << model_path << std::endl;
     std::cout << "Image: " << image_path << std::endl;
@@ -55,61 +240,41 @@ int main(int argc, char** argv) {
     }
 
     // 2. Initialize Network
-    void* context = init_network(model_path.c_str());
-    if (!context) {
+    // Raw outputs: only cells above the score threshold get dequantized
+    SessionConfig config;
+    config.output_format = AML_OUTDATA_RAW;
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path.c_str(), config);
+    InputQuantizer quantizer;
+    if (!session || !check_tensors(*session, quantizer)) {
         std::cerr << "Failed to initialize network." << std::endl;
         return -1;
     }
+    std::cout << "Load time: " << session->load_ms() << " ms" << std::endl;
+    if (session->input(0).data && session->warmup(2) == 0) {
+        const WarmupStats& warm = session->warmup_stats();
+        std::cout << "Warm-up: cold " << warm.cold_ms << " ms, warm " << warm.warm_ms << " ms" << std::endl;
+    }
 
     // 3. Preprocess
     auto start_time = std::chrono::high_resolution_clock::now();
 
-    auto [preprocessed, scale, pad] = preprocess(img, std::make_tuple(MODEL_INPUT_HEIGHT, MODEL_INPUT_WIDTH));
+    auto [preprocessed, scale, pad] = preprocess(img, input_shape(*session));
 
-    // Quantize to int8 (model expects quantized input)
-    cv::Mat quantized_img = quantize_input(preprocessed);
-
-    // 4. Set input and run inference
-    nn_input inData;
-    memset(&inData, 0, sizeof(nn_input));
-    inData.input_type = BINARY_RAW_DATA;
-    inData.input = quantized_img.data;
-    inData.input_index = 0;
-    inData.size = quantized_img.total() * quantized_img.elemSize();
-
-    if (aml_module_input_set(context, &inData) != 0) {
+    // Map uint8 pixels to the quantized input straight into the NPU input buffer
+    if (fill_input(quantizer, preprocessed, session->input(0)) != 0) {
         std::cerr << "Failed to set input." << std::endl;
-        uninit_network(context);
         return -1;
     }
 
-    aml_output_config_t outconfig;
-    memset(&outconfig, 0, sizeof(aml_output_config_t));
-    outconfig.typeSize = sizeof(aml_output_config_t);
-    outconfig.format = AML_OUTDATA_FLOAT32;
-
-    nn_output* outdata = (nn_output*)aml_module_output_get(context, outconfig);
+    // 4. Run inference
+    nn_output* outdata = session->run();
     if (!outdata) {
         std::cerr << "Failed to run network." << std::endl;
-        uninit_network(context);
         return -1;
     }
 
     // 5. Postprocess
-    float* outbuf0 = (float*)outdata->out[0].buf;
-    float* outbuf1 = (float*)outdata->out[1].buf;
-    float* outbuf2 = (float*)outdata->out[2].buf;
-
-    const int channels = 144;  // 64 DFL + 80 classes
-    
-    std::vector<Detection> detections = postprocess(
-        std::make_tuple(outbuf0, std::make_tuple(MODEL_INPUT_HEIGHT / 16, MODEL_INPUT_WIDTH / 16, channels), 16),
-        std::make_tuple(outbuf1, std::make_tuple(MODEL_INPUT_HEIGHT / 8, MODEL_INPUT_WIDTH / 8, channels), 8),
-        std::make_tuple(outbuf2, std::make_tuple(MODEL_INPUT_HEIGHT / 32, MODEL_INPUT_WIDTH / 32, channels), 32),
-        std::make_tuple(preprocessed, scale, pad),
-        SCORE_THRESHOLD,
-        NMS_THRESHOLD
-    );
+    std::vector<Detection> detections = detect(*session, outdata, std::make_tuple(preprocessed, scale, pad));
 
     auto end_time = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> inference_time = end_time - start_time;
@@ -122,8 +287,5 @@ int main(int argc, char** argv) {
     cv::imwrite(DEFAULT_OUTPUT_PATH, result_img);
     std::cout << "Result saved to " << DEFAULT_OUTPUT_PATH << std::endl;
 
-    // 7. Cleanup
-    uninit_network(context);
-
     return 0;
 }
@@ -15,6 +15,7 @@
  */
 
 #include "postprocess.h"
+#include "output_view.h"
 #include <iostream>
 #include <cmath>
 #include <algorithm>
@@ -131,31 +132,11 @@ std::tuple<cv::Mat, float, std::tuple<int, int>> preprocess(cv::Mat img, std::tu
     cv::copyMakeBorder(img_resized, img_padded, pad_top, pad_bottom, pad_left, pad_right, 
                       cv::BORDER_CONSTANT, cv::Scalar(114, 114, 114));
 
-    cv::Mat img_float;
-    img_padded.convertTo(img_float, CV_32F, 1.0 / 255.0);
-
-    return std::make_tuple(img_float, scale, std::make_tuple(pad_left, pad_top));
-}
-
-cv::Mat quantize_input(const cv::Mat& float_img, float scale, int8_t zero_point) {
-    if (float_img.empty() || float_img.type() != CV_32FC3) {
-        LOGE("quantize_input: Invalid input image (must be CV_32FC3)");
-        return cv::Mat();
-    }
-
-    cv::Mat quantized_img(float_img.rows, float_img.cols, CV_8SC3);
-    const float* src_ptr = (const float*)float_img.data;
-    int8_t* dst_ptr = (int8_t*)quantized_img.data;
-
-    int total_elements = float_img.total() * float_img.channels();
-    for (int i = 0; i < total_elements; ++i) {
-        dst_ptr[i] = static_cast<int8_t>(std::round(src_ptr[i] / scale + zero_point));
-    }
-
-    return quantized_img;
+    return std::make_tuple(img_padded, scale, std::make_tuple(pad_left, pad_top));
 }
 
-static std::vector<Detection> get_detections(float* output, std::tuple<int, int, int> output_shape, 
+template <typename View>
+static std::vector<Detection> get_detections(const View& output, std::tuple<int, int, int> output_shape,
                                             int stride, float conf_thresh) {
     std::vector<Detection> detections;
 
@@ -166,21 +147,31 @@ static std::vector<Detection> get_detections(float* output, std::tuple<int, int,
     const int num_classes = 80;
     const int dfl_channels = 64;  // 4 directions * 16 bins
 
+    // sigmoid is monotonic: compare raw class logits against the threshold
+    // and dequantize only the cells that pass
+    const float logit_thresh = std::log(conf_thresh / (1.0f - conf_thresh));
+    if (!output.reachable(logit_thresh)) {
+        return detections;
+    }
+    const auto raw_thresh = output.threshold(logit_thresh);
+
     for (int i = 0; i < grid_h; ++i) {
         for (int j = 0; j < grid_w; ++j) {
             // NHWC format: output[i][j][c]
             int base_idx = (i * grid_w + j) * channels;
 
-            float max_score = -1.0f;
-            int class_id = -1;
-            for (int c = 0; c < num_classes; ++c) {
-                float score = sigmoid(output[base_idx + dfl_channels + c]);
-                if (score > max_score) {
-                    max_score = score;
+            int class_id = 0;
+            auto max_raw = output.raw(base_idx + dfl_channels);
+            for (int c = 1; c < num_classes; ++c) {
+                auto value = output.raw(base_idx + dfl_channels + c);
+                if (value > max_raw) {
+                    max_raw = value;
                     class_id = c;
                 }
             }
 
+            if (max_raw < raw_thresh) continue;
+            float max_score = sigmoid(output[base_idx + dfl_channels + class_id]);
             if (max_score < conf_thresh) continue;
 
             // DFL decoding for bounding box
@@ -188,17 +179,22 @@ static std::vector<Detection> get_detections(float* output, std::tuple<int, int,
             for (int k = 0; k < 4; ++k) {
                 int dfl_start = base_idx + k * 16;
 
+                float logits[16];
+                for (int t = 0; t < 16; ++t) {
+                    logits[t] = output[dfl_start + t];
+                }
+
                 // Softmax over 16 bins
                 float exp_logits[16];
-                float max_logit = output[dfl_start];
+                float max_logit = logits[0];
                 for (int t = 1; t < 16; ++t) {
-                    if (output[dfl_start + t] > max_logit)
-                        max_logit = output[dfl_start + t];
+                    if (logits[t] > max_logit)
+                        max_logit = logits[t];
                 }
 
                 float sum_exp = 0.0f;
                 for (int t = 0; t < 16; ++t) {
-                    exp_logits[t] = std::exp(output[dfl_start + t] - max_logit);
+                    exp_logits[t] = std::exp(logits[t] - max_logit);
                     sum_exp += exp_logits[t];
                 }
 
@@ -228,11 +224,11 @@ static std::vector<Detection> get_detections(float* output, std::tuple<int, int,
     return detections;
 }
 
-std::vector<Detection> postprocess(std::tuple<float*, std::tuple<int, int, int>, int> out0,
-                                   std::tuple<float*, std::tuple<int, int, int>, int> out1,
-                                   std::tuple<float*, std::tuple<int, int, int>, int> out2,
+std::vector<Detection> postprocess(std::tuple<const outBuf_t*, std::tuple<int, int, int>, int> out0,
+                                   std::tuple<const outBuf_t*, std::tuple<int, int, int>, int> out1,
+                                   std::tuple<const outBuf_t*, std::tuple<int, int, int>, int> out2,
                                    std::tuple<cv::Mat, float, std::tuple<int, int>> input_tuple,
-                                   float conf_thresh, float iou_threshold) {
+                                   float conf_thresh, float iou_threshold, aml_output_format_t format) {
     float scale = std::get<1>(input_tuple);
     int pad_left = std::get<0>(std::get<2>(input_tuple));
     int pad_top = std::get<1>(std::get<2>(input_tuple));
@@ -240,11 +236,16 @@ std::vector<Detection> postprocess(std::tuple<float*, std::tuple<int, int, int>,
     std::vector<Detection> detections;
 
     auto process_out = [&](auto& out) {
-        float* output = std::get<0>(out);
+        const outBuf_t* output = std::get<0>(out);
         auto shape = std::get<1>(out);
         int stride = std::get<2>(out);
-        std::vector<Detection> dets = get_detections(output, shape, stride, conf_thresh);
-        detections.insert(detections.end(), dets.begin(), dets.end());
+        int ret = visit_output(*output, format, [&](const auto& view) {
+            std::vector<Detection> dets = get_detections(view, shape, stride, conf_thresh);
+            detections.insert(detections.end(), dets.begin(), dets.end());
+        });
+        if (ret) {
+            LOGE("Unsupported output element format %d", output->param ? (int)output->param->data_format : -1);
+        }
     };
 
     // Process all three scales
@@ -21,6 +21,7 @@
 #include <vector>
 #include <tuple>
 #include <string>
+#include "nn_sdk.h"
 
 // Detection result structure
 struct Detection {
@@ -32,18 +33,17 @@ struct Detection {
 // COCO class names (80 classes)
 extern const char* COCO_CLASSES[80];
 
-// Preprocess image with letterbox resizing
+// Preprocess image with letterbox resizing; returns the padded RGB image as CV_8UC3
 std::tuple<cv::Mat, float, std::tuple<int, int>> preprocess(cv::Mat img, std::tuple<int, int> new_shape);
 
-// Quantize float32 image to int8 for model input
-cv::Mat quantize_input(const cv::Mat& float_img, float scale = 0.003921568859368563f, int8_t zero_point = -128);
-
-// Postprocess YOLOv8 outputs with DFL decoding
-std::vector<Detection> postprocess(std::tuple<float*, std::tuple<int, int, int>, int> out0,
-                                   std::tuple<float*, std::tuple<int, int, int>, int> out1,
-                                   std::tuple<float*, std::tuple<int, int, int>, int> out2,
+// Postprocess YOLOv8 outputs with DFL decoding. `format` is the format the
+// outputs were fetched with; AML_OUTDATA_RAW outputs are dequantized on read.
+std::vector<Detection> postprocess(std::tuple<const outBuf_t*, std::tuple<int, int, int>, int> out0,
+                                   std::tuple<const outBuf_t*, std::tuple<int, int, int>, int> out1,
+                                   std::tuple<const outBuf_t*, std::tuple<int, int, int>, int> out2,
                                    std::tuple<cv::Mat, float, std::tuple<int, int>> input_tuple,
-                                   float conf_thresh, float iou_threshold);
+                                   float conf_thresh, float iou_threshold,
+                                   aml_output_format_t format = AML_OUTDATA_FLOAT32);
 
 // Draw detections on image
 cv::Mat draw_detections(cv::Mat image, const std::vector<Detection>& detections);
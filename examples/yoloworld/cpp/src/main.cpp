@@ -22,10 +22,9 @@
 #include <opencv2/opencv.hpp>
 #include "postprocess.h"
 #include "model_loader.h"
+#include "model_session.h"
 
 const std::string DEFAULT_OUTPUT_PATH = "./result.jpg";
-const int MODEL_INPUT_WIDTH = 640;
-const int MODEL_INPUT_HEIGHT = 480;
 const float SCORE_THRESHOLD = 0.4f;
 const float NMS_THRESHOLD = 0.45f;
 
@@ -62,40 +61,57 @@ int main(int argc, char** argv) {
     }
 
     // 2. Initialize Network
-    void* context = init_network(model_path.c_str());
-    if (!context) {
+    SessionConfig config;
+    config.warmup_runs = 2;
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path.c_str(), config);
+    if (!session) {
         std::cerr << "Failed to initialize network." << std::endl;
         return -1;
     }
+    const WarmupStats& warm = session->warmup_stats();
+    std::cout << "Warm-up: cold " << warm.cold_ms << " ms, warm " << warm.warm_ms << " ms" << std::endl;
+    const std::vector<TensorDesc>& heads = session->outputs();
+    if (session->inputs().empty() || heads.size() != 3) {
+        std::cerr << "Unexpected model tensors: " << session->inputs().size() << " inputs, "
+                  << heads.size() << " outputs." << std::endl;
+        return -1;
+    }
+    // NHWC input {1, H, W, 3}
+    int input_h = session->inputs()[0].dim(-3);
+    int input_w = session->inputs()[0].dim(-2);
 
     // 3. Preprocess
     auto start_time = std::chrono::high_resolution_clock::now();
     
     std::tuple<cv::Mat, float, std::tuple<int, int>> input_tuple = 
-        preprocess(img, std::make_tuple(MODEL_INPUT_HEIGHT, MODEL_INPUT_WIDTH));
+        preprocess(img, std::make_tuple(input_h, input_w));
     
     // 4. Run Network
-    void* output_ptr = run_network(context, {input_tuple});
-    if (!output_ptr) {
+    const cv::Mat& input_img = std::get<0>(input_tuple);
+    nn_output* outdata = NULL;
+    if (session->set_input(0, input_img.data, input_img.total() * input_img.elemSize()) == 0) {
+        outdata = session->run();
+    }
+    if (!outdata) {
         std::cerr << "Failed to run network." << std::endl;
-        uninit_network(context);
         return -1;
     }
-    nn_output* outdata = (nn_output*)output_ptr;
 
     // 5. Postprocess
-    float* outbuf0 = (float*)outdata->out[0].buf;
-    float* outbuf1 = (float*)outdata->out[1].buf;
-    float* outbuf2 = (float*)outdata->out[2].buf;
-    
     int num_classes = CLASS_NAMES.size();
-    int channels = 87; 
-    
-    // Using standard stride logic assuming standard YOLOv8/World export
+
+    // Each head is NHWC {1, grid_h, grid_w, 64 DFL + classes}; the stride
+    // follows from how far the grid is downsampled from the input.
+    auto head = [&](int i) {
+        const TensorDesc& desc = heads[i];
+        int grid_h = desc.dim(-3), grid_w = desc.dim(-2), channels = desc.dim(-1);
+        return std::make_tuple((float*)outdata->out[i].buf, std::make_tuple(grid_h, grid_w, channels), input_h / grid_h);
+    };
+
     std::vector<Detection> detections = postprocess(
-        std::make_tuple(outbuf0, std::make_tuple(MODEL_INPUT_HEIGHT / 8, MODEL_INPUT_WIDTH / 8, channels), 8),
-        std::make_tuple(outbuf1, std::make_tuple(MODEL_INPUT_HEIGHT / 16, MODEL_INPUT_WIDTH / 16, channels), 16),
-        std::make_tuple(outbuf2, std::make_tuple(MODEL_INPUT_HEIGHT / 32, MODEL_INPUT_WIDTH / 32, channels), 32),
+        head(0),
+        head(1),
+        head(2),
         input_tuple,
         SCORE_THRESHOLD,
         NMS_THRESHOLD,
@@ -113,8 +129,5 @@ int main(int argc, char** argv) {
     cv::imwrite(DEFAULT_OUTPUT_PATH, result_img);
     std::cout << "Result saved to " << DEFAULT_OUTPUT_PATH << std::endl;
 
-    // 7. Cleanup
-    uninit_network(context);
-    
     return 0;
 }
@@ -0,0 +1,740 @@
+/*
+ * Copyright (C) 2024–2025 Amlogic, Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs any model over a set of images, audio clips or raw tensors and
+// times every stage of the pipeline separately: decode, preprocess,
+// input_set, invoke, output fetch, postprocess and render. Reports
+// p50 / p90 / p99 and throughput per stage and appends them to a CSV or
+// JSON file, so end-to-end regressions can be tracked per model and SoC.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "model_session.h"
+#include "quant_input.h"
+#include "output_view.h"
+#include "tensor_dump.h"
+#ifdef AMLNN_BENCH_OPENCV
+#include <opencv2/opencv.hpp>
+#endif
+
+namespace fs = std::filesystem;
+
+enum Stage {
+    STAGE_DECODE = 0,
+    STAGE_PREPROCESS,
+    STAGE_INPUT_SET,
+    STAGE_INVOKE,
+    STAGE_OUTPUT,
+    STAGE_POSTPROCESS,
+    STAGE_RENDER,
+    STAGE_TOTAL,
+    STAGE_NUM
+};
+
+static const char* kStageNames[STAGE_NUM] = {
+    "decode", "preprocess", "input_set", "invoke", "output", "postprocess", "render", "total",
+};
+
+enum Postprocess {
+    POST_NONE = 0,
+    POST_TOPK,      // top-5 of output 0, classification style
+    POST_SCAN,      // elements above a threshold in every output, detection style
+};
+
+struct StageSummary {
+    size_t count = 0;
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+    double per_sec = 0;
+};
+
+struct Options {
+    int iterations = 100;
+    int warmup = 5;
+    aml_output_format_t output_format = AML_OUTDATA_FLOAT32;
+    bool copy_inputs = false;     // aml_module_input_set instead of DMA buffers
+    bool cache_sweep = false;     // one run per kCachePolicies entry
+    Postprocess post = POST_SCAN;
+    float threshold = 0.5f;
+    std::string soc;
+    std::string out_path;
+};
+
+// One decoded dataset item.
+struct Sample {
+    enum Kind { IMAGE, AUDIO, TENSORS } kind = TENSORS;
+    int width = 0, height = 0, channels = 0;
+    std::vector<uint8_t> pixels;                      // interleaved RGB / gray
+#ifdef AMLNN_BENCH_OPENCV
+    cv::Mat image;                                    // BGR, from cv::imread
+#endif
+    std::vector<float> audio;                         // mono samples
+    std::vector<std::vector<unsigned char>> tensors;  // native bytes per input
+};
+
+static double elapsed_ms(std::chrono::steady_clock::time_point& start) {
+    auto now = std::chrono::steady_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(now - start).count();
+    start = now;
+    return ms;
+}
+
+static std::string extension(const fs::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+static int read_file(const fs::path& path, std::vector<unsigned char>* data) {
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (NULL == fp) return -1;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data->resize(size > 0 ? size : 0);
+    size_t got = size > 0 ? fread(data->data(), 1, size, fp) : 0;
+    fclose(fp);
+    return got == data->size() ? 0 : -1;
+}
+
+// Binary PPM / PGM (P6 / P5), so images decode without OpenCV.
+static int decode_pnm(const std::vector<unsigned char>& file, Sample* s) {
+    size_t pos = 2;
+    int values[3];
+    if (file.size() < 2 || file[0] != 'P' || (file[1] != '5' && file[1] != '6')) return -1;
+    for (int i = 0; i < 3; ++i) {
+        while (pos < file.size() && (isspace(file[pos]) || file[pos] == '#')) {
+            if (file[pos] == '#') {
+                while (pos < file.size() && file[pos] != '\n') ++pos;
+            } else {
+                ++pos;
+            }
+        }
+        values[i] = 0;
+        while (pos < file.size() && isdigit(file[pos])) values[i] = values[i] * 10 + (file[pos++] - '0');
+    }
+    ++pos;   // single whitespace before the raster
+    s->width = values[0];
+    s->height = values[1];
+    s->channels = file[1] == '6' ? 3 : 1;
+    size_t bytes = (size_t)s->width * s->height * s->channels;
+    if (values[2] != 255 || s->width <= 0 || s->height <= 0 || pos + bytes > file.size()) return -1;
+    s->pixels.assign(file.begin() + pos, file.begin() + pos + bytes);
+    return 0;
+}
+
+// RIFF WAVE with 16-bit PCM or 32-bit float samples, mixed down to mono.
+static int decode_wav(const std::vector<unsigned char>& file, Sample* s) {
+    if (file.size() < 12 || memcmp(file.data(), "RIFF", 4) || memcmp(file.data() + 8, "WAVE", 4)) return -1;
+    int format = 0, channels = 0, bits = 0;
+    size_t pos = 12;
+    while (pos + 8 <= file.size()) {
+        uint32_t size;
+        memcpy(&size, file.data() + pos + 4, 4);
+        const unsigned char* chunk = file.data() + pos + 8;
+        if (pos + 8 + size > file.size()) size = file.size() - pos - 8;
+        if (!memcmp(file.data() + pos, "fmt ", 4) && size >= 16) {
+            format = chunk[0] | (chunk[1] << 8);
+            channels = chunk[2] | (chunk[3] << 8);
+            bits = chunk[14] | (chunk[15] << 8);
+        } else if (!memcmp(file.data() + pos, "data", 4) && channels > 0) {
+            size_t frames = size / (channels * bits / 8);
+            s->audio.resize(frames);
+            for (size_t f = 0; f < frames; ++f) {
+                float sum = 0;
+                for (int c = 0; c < channels; ++c) {
+                    if (format == 1 && bits == 16) {
+                        int16_t v;
+                        memcpy(&v, chunk + (f * channels + c) * 2, 2);
+                        sum += v / 32768.0f;
+                    } else if (format == 3 && bits == 32) {
+                        float v;
+                        memcpy(&v, chunk + (f * channels + c) * 4, 4);
+                        sum += v;
+                    } else {
+                        return -1;
+                    }
+                }
+                s->audio[f] = sum / channels;
+            }
+            return 0;
+        }
+        pos += 8 + size + (size & 1);
+    }
+    return -1;
+}
+
+class Bench {
+public:
+    Bench(ModelSession& session, const Options& opts) : session_(session), opts_(opts) {}
+
+    int init() {
+        if (session_.inputs().empty()) {
+            fprintf(stderr, "Model has no input tensor info.\n");
+            return -1;
+        }
+        const TensorDesc& in = session_.inputs()[0];
+        // NHWC when the innermost dimension looks like channels, NCHW otherwise
+        planar_ = !(in.dim(-1) == 1 || in.dim(-1) == 3 || in.dim(-1) == 4);
+        in_c_ = planar_ ? in.dim(-3) : in.dim(-1);
+        in_h_ = planar_ ? in.dim(-2) : in.dim(-3);
+        in_w_ = planar_ ? in.dim(-1) : in.dim(-2);
+        static const float norm[4] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
+        if (in_c_ <= 4 && quantizer_.init(in, in_c_, NULL, norm) == 0) {
+            image_ok_ = true;
+            // DMA only when the buffer takes the quantizer's output as-is
+            image_dma_ = !opts_.copy_inputs && quantizer_.bytes((size_t)in_w_ * in_h_) == in.bytes;
+        }
+        canvas_.resize((size_t)in_w_ * in_h_ * in_c_);
+        host_.resize(quantizer_.bytes((size_t)in_w_ * in_h_));
+        outputs_.resize(session_.outputs().size());
+        return 0;
+    }
+
+    int decode(const fs::path& path, Sample* s) {
+        std::string ext = extension(path);
+        *s = Sample();
+        if (ext == ".amlt") {
+            // First recorded frame's inputs, as the SDK received them
+            std::unique_ptr<TensorReplay> replay = TensorReplay::open(path.c_str());
+            if (!replay || replay->frames() == 0) return -1;
+            for (const ReplayTensor& t : replay->inputs(0)) {
+                if (s->tensors.size() <= t.desc.index) s->tensors.resize(t.desc.index + 1);
+                s->tensors[t.desc.index].assign(t.data, t.data + t.size);
+            }
+            return 0;
+        }
+        std::vector<unsigned char> file;
+        if (read_file(path, &file)) return -1;
+        if (ext == ".wav") {
+            s->kind = Sample::AUDIO;
+            return decode_wav(file, s);
+        }
+        if (ext == ".ppm" || ext == ".pgm") {
+            s->kind = Sample::IMAGE;
+            return decode_pnm(file, s);
+        }
+        if (ext == ".bin" || ext == ".raw") {
+            // One input, or all inputs back to back in index order
+            size_t pos = 0;
+            for (const auto& desc : session_.inputs()) {
+                size_t size = session_.inputs().size() == 1 ? file.size() : std::min(desc.bytes, file.size() - pos);
+                s->tensors.emplace_back(file.begin() + pos, file.begin() + pos + size);
+                pos += size;
+            }
+            return 0;
+        }
+#ifdef AMLNN_BENCH_OPENCV
+        s->kind = Sample::IMAGE;
+        s->image = cv::imdecode(file, cv::IMREAD_COLOR);
+        s->width = s->image.cols;
+        s->height = s->image.rows;
+        s->channels = s->image.channels();
+        return s->image.empty() ? -1 : 0;
+#else
+        fprintf(stderr, "%s: built without OpenCV, use .ppm / .pgm images.\n", path.c_str());
+        return -1;
+#endif
+    }
+
+    // Letterboxes images to the input size and quantizes them; audio is
+    // cut or zero padded to the input's element count.
+    int preprocess(Sample& s) {
+        if (s.kind == Sample::IMAGE) {
+            if (!image_ok_ || s.channels != (int)in_c_) {
+                fprintf(stderr, "Image has %d channels, the model input %u.\n", s.channels, in_c_);
+                return -1;
+            }
+            letterbox(s);
+            size_t pixels = (size_t)in_w_ * in_h_;
+            void* dst = host_.data();
+            if (image_dma_) {
+                TensorView input = session_.input(0);
+                if (!input.data) return -1;
+                dst = input.data;
+            }
+            if (planar_) {
+                quantizer_.apply_planar(canvas_.data(), pixels, dst);
+            } else {
+                quantizer_.apply(canvas_.data(), pixels, dst);
+            }
+            return 0;
+        }
+        if (s.kind == Sample::AUDIO) {
+            const TensorDesc& in = session_.inputs()[0];
+            audio_.assign(in.elements, 0.0f);
+            std::copy(s.audio.begin(), s.audio.begin() + std::min(s.audio.size(), audio_.size()), audio_.begin());
+            return 0;
+        }
+        if (s.tensors.size() > session_.inputs().size()) return -1;
+        if (!opts_.copy_inputs) {
+            for (size_t i = 0; i < s.tensors.size(); ++i) {
+                const TensorDesc& desc = session_.inputs()[i];
+                if (s.tensors[i].size() != desc.bytes) continue;   // handed over by input_set
+                TensorView input = session_.input(desc.index);
+                if (!input.data) return -1;
+                memcpy(input.data, s.tensors[i].data(), desc.bytes);
+            }
+        }
+        return 0;
+    }
+
+    int input_set(const Sample& s) {
+        if (s.kind == Sample::IMAGE) {
+            if (image_dma_) return 0;   // written in place by preprocess
+            return quantizer_.upload(session_, 0, host_.data(), (size_t)in_w_ * in_h_,
+                                     planar_ ? AML_INPUT_MODEL_NCHW : AML_INPUT_MODEL_NHWC);
+        }
+        input_info info;
+        memset(&info, 0, sizeof(input_info));
+        info.valid = 1;
+        if (s.kind == Sample::AUDIO) {
+            info.input_data_type = AML_INPUT_FP32;
+            return session_.set_input(0, audio_.data(), audio_.size() * sizeof(float), &info);
+        }
+        for (size_t i = 0; i < s.tensors.size(); ++i) {
+            const TensorDesc& desc = session_.inputs()[i];
+            const std::vector<unsigned char>& data = s.tensors[i];
+            if (!opts_.copy_inputs && data.size() == desc.bytes) continue;
+            int ret;
+            if (data.size() == desc.bytes && tensor_format_size(desc.format) == 1 &&
+                desc.quant_format != NN_BUFFER_QUANTIZE_NONE) {
+                info.input_data_type = desc.format == NN_BUFFER_FORMAT_INT8 ? AML_INPUT_I8 : AML_INPUT_U8;
+                ret = session_.set_input(desc.index, data.data(), data.size(), &info, QTENSOR_RAW_DATA);
+            } else if (data.size() == desc.elements * sizeof(float)) {
+                info.input_data_type = AML_INPUT_FP32;
+                ret = session_.set_input(desc.index, data.data(), data.size(), &info);
+            } else {
+                fprintf(stderr, "Input %u: %zu bytes do not match the tensor.\n", desc.index, data.size());
+                return -1;
+            }
+            if (ret) return -1;
+        }
+        return 0;
+    }
+
+    // Brings every output into host float memory, the form most
+    // postprocessing starts from; with AML_OUTDATA_RAW this is where the
+    // dequantization happens.
+    int output(const nn_output* out) {
+        for (unsigned int i = 0; i < out->num && i < outputs_.size(); ++i) {
+            const TensorDesc& desc = session_.outputs()[i];
+            std::vector<float>& dst = outputs_[i];
+            dst.resize(desc.elements);
+            int ret = visit_output(out->out[i], opts_.output_format, [&](const auto& view) {
+                for (size_t k = 0; k < dst.size(); ++k) dst[k] = view[k];
+            });
+            if (ret) return -1;
+        }
+        return 0;
+    }
+
+    void postprocess() {
+        hits_ = 0;
+        top_.clear();
+        if (opts_.post == POST_TOPK && !outputs_.empty()) {
+            const std::vector<float>& scores = outputs_[0];
+            std::vector<int> order(scores.size());
+            for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+            size_t k = std::min<size_t>(5, order.size());
+            std::partial_sort(order.begin(), order.begin() + k, order.end(),
+                              [&](int a, int b) { return scores[a] > scores[b]; });
+            top_.assign(order.begin(), order.begin() + k);
+            hits_ = k;
+        } else if (opts_.post == POST_SCAN) {
+            for (const auto& out : outputs_) {
+                for (float v : out) hits_ += v >= opts_.threshold;
+            }
+        }
+    }
+
+    // Draws the result summary onto the decoded image and encodes it in
+    // memory; non-image samples only format the summary.
+    void render(const Sample& s) {
+        char text[128];
+        snprintf(text, sizeof(text), "%zu hits", hits_);
+        if (!top_.empty()) snprintf(text, sizeof(text), "top-1 %d (%.3f)", top_[0], outputs_[0][top_[0]]);
+        summary_ = text;
+        encoded_.clear();
+        if (s.kind != Sample::IMAGE) return;
+#ifdef AMLNN_BENCH_OPENCV
+        if (!s.image.empty()) {
+            cv::Mat img = s.image.clone();
+            cv::putText(img, summary_, {10, 30}, cv::FONT_HERSHEY_SIMPLEX, 0.8, {0, 255, 0}, 2);
+            cv::imencode(".jpg", img, encoded_);
+            return;
+        }
+#endif
+        std::string header = "P" + std::to_string(s.channels == 3 ? 6 : 5) + "\n" + std::to_string(s.width) + " " +
+                             std::to_string(s.height) + "\n255\n";
+        encoded_.assign(header.begin(), header.end());
+        encoded_.insert(encoded_.end(), s.pixels.begin(), s.pixels.end());
+    }
+
+    const std::string& summary() const { return summary_; }
+
+private:
+    void letterbox(const Sample& s) {
+#ifdef AMLNN_BENCH_OPENCV
+        if (!s.image.empty()) {
+            float scale = std::min((float)in_w_ / s.width, (float)in_h_ / s.height);
+            int nw = s.width * scale, nh = s.height * scale;
+            cv::Mat canvas(in_h_, in_w_, in_c_ == 3 ? CV_8UC3 : CV_8UC1, canvas_.data());
+            canvas.setTo(cv::Scalar::all(114));
+            cv::Mat roi = canvas(cv::Rect((in_w_ - nw) / 2, (in_h_ - nh) / 2, nw, nh));
+            cv::resize(s.image, resized_, {nw, nh});
+            if (in_c_ == 3) {
+                cv::cvtColor(resized_, roi, cv::COLOR_BGR2RGB);
+            } else {
+                resized_.copyTo(roi);
+            }
+            return;
+        }
+#endif
+        // Nearest neighbour for images decoded without OpenCV
+        float scale = std::min((float)in_w_ / s.width, (float)in_h_ / s.height);
+        int nw = std::max(1, (int)(s.width * scale)), nh = std::max(1, (int)(s.height * scale));
+        int px = (in_w_ - nw) / 2, py = (in_h_ - nh) / 2;
+        std::fill(canvas_.begin(), canvas_.end(), 114);
+        for (int y = 0; y < nh; ++y) {
+            int sy = std::min(s.height - 1, (int)(y / scale));
+            const uint8_t* src = s.pixels.data() + (size_t)sy * s.width * in_c_;
+            uint8_t* dst = canvas_.data() + ((size_t)(y + py) * in_w_ + px) * in_c_;
+            for (int x = 0; x < nw; ++x) {
+                int sx = std::min(s.width - 1, (int)(x / scale));
+                memcpy(dst + (size_t)x * in_c_, src + (size_t)sx * in_c_, in_c_);
+            }
+        }
+    }
+
+    ModelSession& session_;
+    const Options& opts_;
+    InputQuantizer quantizer_;
+    bool planar_ = false;
+    bool image_ok_ = false;
+    bool image_dma_ = false;
+    unsigned int in_w_ = 0, in_h_ = 0, in_c_ = 0;
+    std::vector<uint8_t> canvas_;                 // letterboxed 8-bit pixels
+    std::vector<uint8_t> host_;                   // quantized input for input_set
+    std::vector<float> audio_;
+#ifdef AMLNN_BENCH_OPENCV
+    cv::Mat resized_;
+#endif
+    std::vector<std::vector<float>> outputs_;
+    size_t hits_ = 0;
+    std::vector<int> top_;
+    std::string summary_;
+    std::vector<unsigned char> encoded_;
+};
+
+static StageSummary summarize(std::vector<double> times) {
+    StageSummary s;
+    if (times.empty()) return s;
+    std::sort(times.begin(), times.end());
+    double sum = 0;
+    for (double t : times) sum += t;
+    auto rank = [&](double q) { return times[(size_t)(q * (times.size() - 1) + 0.5)]; };
+    s.count = times.size();
+    s.mean = sum / times.size();
+    s.p50 = rank(0.5);
+    s.p90 = rank(0.9);
+    s.p99 = rank(0.99);
+    s.max = times.back();
+    s.per_sec = s.mean > 0 ? 1000.0 / s.mean : 0;
+    return s;
+}
+
+struct BenchReport {
+    std::string model;                  // "<model>@<policy>" in a -C sweep
+    double load_ms = 0;
+    double fps = 0;
+    const StageSummary* stages = nullptr;
+};
+
+// JSON for a ".json" path (overwritten): one object, or an array of them
+// for a -C sweep. CSV otherwise, appended with a header line when the file
+// is new so runs accumulate in one table.
+static int write_report(const Options& opts, const std::string& sdk, const std::vector<BenchReport>& reports) {
+    const std::string& path = opts.out_path;
+    bool json = path.size() > 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    bool fresh = json || !fs::exists(path) || fs::file_size(path) == 0;
+    FILE* fp = fopen(path.c_str(), json ? "w" : "a");
+    if (NULL == fp) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        return -1;
+    }
+    if (json) {
+        bool array = reports.size() > 1;
+        const char* pad = array ? "  " : "";
+        if (array) fprintf(fp, "[\n");
+        for (size_t r = 0; r < reports.size(); ++r) {
+            const BenchReport& report = reports[r];
+            fprintf(fp, "%s{\n%s  \"model\": \"%s\",\n%s  \"soc\": \"%s\",\n%s  \"sdk\": \"%s\",\n"
+                        "%s  \"load_ms\": %.3f,\n%s  \"fps\": %.3f,\n%s  \"stages\": {\n",
+                    pad, pad, report.model.c_str(), pad, opts.soc.c_str(), pad, sdk.c_str(), pad, report.load_ms,
+                    pad, report.fps, pad);
+            for (int i = 0; i < STAGE_NUM; ++i) {
+                const StageSummary& s = report.stages[i];
+                fprintf(fp, "%s    \"%s\": {\"count\": %zu, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, "
+                            "\"p99_ms\": %.4f, \"max_ms\": %.4f, \"per_sec\": %.2f}%s\n",
+                        pad, kStageNames[i], s.count, s.mean, s.p50, s.p90, s.p99, s.max, s.per_sec,
+                        i + 1 < STAGE_NUM ? "," : "");
+            }
+            fprintf(fp, "%s  }\n%s}%s\n", pad, pad, r + 1 < reports.size() ? "," : "");
+        }
+        if (array) fprintf(fp, "]\n");
+    } else {
+        if (fresh) {
+            fprintf(fp, "model,soc,sdk,stage,count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,per_sec\n");
+        }
+        for (const auto& report : reports) {
+            for (int i = 0; i < STAGE_NUM; ++i) {
+                const StageSummary& s = report.stages[i];
+                fprintf(fp, "%s,%s,%s,%s,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f\n", report.model.c_str(),
+                        opts.soc.c_str(), sdk.c_str(), kStageNames[i], s.count, s.mean, s.p50, s.p90, s.p99, s.max,
+                        s.per_sec);
+            }
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+// DMA cache policies compared by -C. Write-combined ("wc") buffers skip
+// the flushes but make CPU reads slow; which wins depends on how the
+// pre- and postprocessing touch the buffers.
+struct CachePolicy {
+    const char* name;
+    aml_cache_type_t input;
+    aml_cache_type_t output;
+};
+
+static const CachePolicy kCachePolicies[] = {
+    {"cached", AML_WITH_CACHE, AML_WITH_CACHE},
+    {"wc-in", AML_WITHOUT_CACHE, AML_WITH_CACHE},
+    {"wc-out", AML_WITH_CACHE, AML_WITHOUT_CACHE},
+    {"wc", AML_WITHOUT_CACHE, AML_WITHOUT_CACHE},
+};
+
+static const char* cache_name(aml_cache_type_t type) {
+    return type == AML_WITH_CACHE ? "cached" : "write-combined";
+}
+
+struct RunResult {
+    StageSummary stages[STAGE_NUM];
+    double fps = 0;
+    double load_ms = 0;
+    double flush_ms = 0;        // DMA cache flushes per timed iteration
+    std::string summary;
+};
+
+static int run_bench(const char* model_path, const SessionConfig& config, const Options& opts,
+                     const std::vector<fs::path>& files, RunResult* result) {
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path, config);
+    if (!session) {
+        fprintf(stderr, "Failed to create session for %s\n", model_path);
+        return -1;
+    }
+    Bench bench(*session, opts);
+    if (bench.init()) return -1;
+
+    std::vector<double> times[STAGE_NUM];
+    Sample sample;
+    DmaFlushStats flushes;
+    auto run_start = std::chrono::steady_clock::now();
+    int total = opts.warmup + opts.iterations;
+    for (int it = 0; it < total; ++it) {
+        if (it == opts.warmup) {
+            run_start = std::chrono::steady_clock::now();
+            flushes = session->flush_stats();
+        }
+        const fs::path& path = files[it % files.size()];
+        double ms[STAGE_NUM];
+        auto start = std::chrono::steady_clock::now();
+        auto begin = start;
+
+        if (bench.decode(path, &sample)) {
+            fprintf(stderr, "Failed to decode %s\n", path.c_str());
+            return -1;
+        }
+        ms[STAGE_DECODE] = elapsed_ms(start);
+        if (bench.preprocess(sample)) return -1;
+        ms[STAGE_PREPROCESS] = elapsed_ms(start);
+        if (bench.input_set(sample)) return -1;
+        ms[STAGE_INPUT_SET] = elapsed_ms(start);
+        const nn_output* out = session->run();
+        if (NULL == out) return -1;
+        ms[STAGE_INVOKE] = elapsed_ms(start);
+        if (bench.output(out)) {
+            fprintf(stderr, "Unsupported output element type.\n");
+            return -1;
+        }
+        ms[STAGE_OUTPUT] = elapsed_ms(start);
+        bench.postprocess();
+        ms[STAGE_POSTPROCESS] = elapsed_ms(start);
+        bench.render(sample);
+        ms[STAGE_RENDER] = elapsed_ms(start);
+        ms[STAGE_TOTAL] = elapsed_ms(begin);
+
+        if (it < opts.warmup) continue;
+        for (int i = 0; i < STAGE_NUM; ++i) times[i].push_back(ms[i]);
+    }
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - run_start).count();
+    result->fps = opts.iterations * 1000.0 / wall_ms;
+    result->load_ms = session->load_ms();
+    const DmaFlushStats& end = session->flush_stats();
+    result->flush_ms = (end.input_ms + end.output_ms - flushes.input_ms - flushes.output_ms) / opts.iterations;
+    result->summary = bench.summary();
+    for (int i = 0; i < STAGE_NUM; ++i) result->stages[i] = summarize(times[i]);
+    return 0;
+}
+
+static void print_stages(const StageSummary* stages) {
+    printf("  %-12s %9s %9s %9s %9s %9s %10s\n", "stage", "mean ms", "p50 ms", "p90 ms", "p99 ms", "max ms", "per sec");
+    for (int i = 0; i < STAGE_NUM; ++i) {
+        const StageSummary& s = stages[i];
+        printf("  %-12s %9.3f %9.3f %9.3f %9.3f %9.3f %10.1f\n", kStageNames[i], s.mean, s.p50, s.p90, s.p99,
+               s.max, s.per_sec);
+    }
+}
+
+static void usage(const char* prog) {
+    printf("%s <model.adla> <input file|dir> [options]\n"
+           "  inputs: images (.jpg/.png with OpenCV, .ppm/.pgm), .wav audio,\n"
+           "          .bin/.raw native input tensors, .amlt recordings\n"
+           "  -n <iterations>  timed iterations over the input set (default 100)\n"
+           "  -w <iterations>  untimed warm-up iterations (default 5)\n"
+           "  -f raw|float     output format (default float)\n"
+           "  -c               copy inputs with aml_module_input_set instead of DMA buffers\n"
+           "  -C               compare DMA cache policies (cached / write-combined inputs and outputs)\n"
+           "  -p topk|scan|none  postprocess (default scan)\n"
+           "  -t <threshold>   scan threshold (default 0.5)\n"
+           "  -s <soc>         SoC label for the report (default from aml_read_chip_info)\n"
+           "  -o <path>        append a CSV report, or write JSON for a .json path\n", prog);
+}
+
+int main(int argc, char** argv) {
+    Options opts;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:f:cCp:t:s:o:h")) != -1) {
+        switch (opt) {
+            case 'n': opts.iterations = std::max(1, atoi(optarg)); break;
+            case 'w': opts.warmup = std::max(0, atoi(optarg)); break;
+            case 'f': opts.output_format = strcmp(optarg, "raw") == 0 ? AML_OUTDATA_RAW : AML_OUTDATA_FLOAT32; break;
+            case 'c': opts.copy_inputs = true; break;
+            case 'C': opts.cache_sweep = true; break;
+            case 'p':
+                opts.post = strcmp(optarg, "topk") == 0 ? POST_TOPK : (strcmp(optarg, "none") == 0 ? POST_NONE : POST_SCAN);
+                break;
+            case 't': opts.threshold = atof(optarg); break;
+            case 's': opts.soc = optarg; break;
+            case 'o': opts.out_path = optarg; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (optind + 2 > argc) {
+        usage(argv[0]);
+        return -1;
+    }
+    const char* model_path = argv[optind];
+    fs::path input_path = argv[optind + 1];
+
+    std::vector<fs::path> files;
+    if (fs::is_directory(input_path)) {
+        for (auto& it : fs::directory_iterator(input_path)) {
+            if (it.is_regular_file()) files.push_back(it.path());
+        }
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(input_path);
+    }
+    if (files.empty()) {
+        fprintf(stderr, "No inputs in %s\n", input_path.c_str());
+        return -1;
+    }
+
+    aml_platform_info_t platform;
+    memset(&platform, 0, sizeof(aml_platform_info_t));
+    std::string sdk;
+    if (aml_read_chip_info(&platform) == 0) {
+        if (platform.sdk_version) sdk = platform.sdk_version;
+        if (opts.soc.empty() && platform.hw_version) opts.soc = platform.hw_version;
+    }
+
+    const char* name = strrchr(model_path, '/');
+    std::string model(name ? name + 1 : model_path);
+    if (!opts.cache_sweep) {
+        SessionConfig config;
+        config.output_format = opts.output_format;
+        RunResult result;
+        if (run_bench(model_path, config, opts, files, &result)) return -1;
+        printf("%s on %s: %d iterations over %zu inputs, load %.2f ms, last result: %s\n", model.c_str(),
+               opts.soc.c_str(), opts.iterations, files.size(), result.load_ms, result.summary.c_str());
+        print_stages(result.stages);
+        printf("End-to-end: %.2f FPS\n", result.fps);
+        if (!opts.out_path.empty() &&
+            write_report(opts, sdk, {BenchReport{model, result.load_ms, result.fps, result.stages}})) {
+            return -1;
+        }
+        return 0;
+    }
+
+    // Outputs land in a one-entry output ring so they are read from DMA
+    // buffers of the policy under test; raw, since the SDK's float
+    // conversion would write to its own memory instead.
+    Options sweep = opts;
+    sweep.output_format = AML_OUTDATA_RAW;
+    RunResult results[sizeof(kCachePolicies) / sizeof(kCachePolicies[0])];
+    std::vector<BenchReport> reports;
+    for (size_t p = 0; p < sizeof(kCachePolicies) / sizeof(kCachePolicies[0]); ++p) {
+        const CachePolicy& policy = kCachePolicies[p];
+        SessionConfig config;
+        config.output_format = AML_OUTDATA_RAW;
+        config.output_ring = 1;
+        config.dma.push_back({false, -1, policy.input, AML_MEM_DIRECTION_READ_WRITE});
+        config.dma.push_back({true, -1, policy.output, AML_MEM_DIRECTION_READ_WRITE});
+        if (run_bench(model_path, config, sweep, files, &results[p])) return -1;
+        printf("%s on %s, DMA %s (inputs %s, outputs %s): %d iterations over %zu inputs\n", model.c_str(),
+               opts.soc.c_str(), policy.name, cache_name(policy.input), cache_name(policy.output),
+               opts.iterations, files.size());
+        print_stages(results[p].stages);
+        printf("  flush %.3f ms per iteration, end-to-end %.2f FPS\n\n", results[p].flush_ms, results[p].fps);
+        reports.push_back(BenchReport{model + "@" + policy.name, results[p].load_ms, results[p].fps, results[p].stages});
+    }
+    // One document for the whole sweep, so the policies can be compared
+    if (!opts.out_path.empty() && write_report(opts, sdk, reports)) {
+        return -1;
+    }
+    printf("  %-8s %12s %9s %9s %9s %9s %9s\n", "policy", "preprocess", "invoke", "flush", "output", "total", "FPS");
+    for (size_t p = 0; p < sizeof(kCachePolicies) / sizeof(kCachePolicies[0]); ++p) {
+        const RunResult& r = results[p];
+        printf("  %-8s %12.3f %9.3f %9.3f %9.3f %9.3f %9.2f\n", kCachePolicies[p].name, r.stages[STAGE_PREPROCESS].mean,
+               r.stages[STAGE_INVOKE].mean, r.flush_ms, r.stages[STAGE_OUTPUT].mean, r.stages[STAGE_TOTAL].mean, r.fps);
+    }
+    return 0;
+}
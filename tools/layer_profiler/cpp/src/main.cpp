@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2024–2025 Amlogic, Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Runs a model with per-layer profiling (aml_util_setProfile with
+// AML_PERLAYER_RUNTIME, then AML_PERLAYER_BANDWIDTH) and reports the
+// layers that take the most time and move the most bytes, flagging the
+// ones that ran as CPU softops. -a analyzes dumps written elsewhere, e.g.
+// by an example run with AMLNN_PERLAYER set.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "layer_profile.h"
+#include "model_context.h"
+#include "model_session.h"
+
+// Empties `dir` of the dumps a previous run left, so they are not merged
+// into this one.
+static int prepare_dump_dir(const std::string& dir) {
+    if (mkdir(dir.c_str(), 0755) && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s\n", dir.c_str());
+        return -1;
+    }
+    DIR* d = opendir(dir.c_str());
+    if (NULL == d) {
+        fprintf(stderr, "Cannot open %s\n", dir.c_str());
+        return -1;
+    }
+    while (struct dirent* entry = readdir(d)) {
+        std::string file = dir + "/" + entry->d_name;
+        struct stat st;
+        if (entry->d_name[0] != '.' && stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            unlink(file.c_str());
+        }
+    }
+    closedir(d);
+    return 0;
+}
+
+// One session with `type` profiling, `runs` invokes on the same
+// pseudo-random inputs. The session is destroyed before returning so the
+// SDK has closed its dump.
+static int profile_pass(const char* model_path, aml_profile_type_t type, const std::string& dir, int runs) {
+    if (prepare_dump_dir(dir) || set_perlayer_profile(type, dir.c_str())) {
+        return -1;
+    }
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path);
+    if (!session) {
+        return -1;
+    }
+    std::mt19937 rng(1234);
+    for (const auto& desc : session->inputs()) {
+        TensorView input = session->input(desc.index);
+        if (!input.data) return -1;
+        for (size_t i = 0; i < input.size; ++i) input.data[i] = (unsigned char)rng();
+    }
+    for (int i = 0; i < runs; ++i) {
+        if (!session->run()) {
+            fprintf(stderr, "Invoke %d failed.\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char* prog) {
+    printf("%s <model.adla> [options]\n"
+           "%s -a <dump file or dir> [options]\n"
+           "  -n <runs>        profiled invokes (default 10)\n"
+           "  -w <rows>        warm-up rows dropped per layer (default 2)\n"
+           "  -k <n>           layers in each top list (default 10)\n"
+           "  -b               also profile bandwidth, in a second session\n"
+           "  -d <dir>         dump directory (default ./perlayer_profile)\n"
+           "  -a <path>        analyze existing dumps, do not run a model\n"
+           "  -o <csv>         write per-layer statistics as CSV\n", prog, prog);
+}
+
+int main(int argc, char** argv) {
+    int runs = 10;
+    int skip = 2;
+    int top_n = 10;
+    bool bandwidth = false;
+    std::string dump_dir = "./perlayer_profile";
+    std::vector<std::string> analyze;
+    std::string csv_path;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:k:bd:a:o:h")) != -1) {
+        switch (opt) {
+            case 'n': runs = std::max(1, atoi(optarg)); break;
+            case 'w': skip = std::max(0, atoi(optarg)); break;
+            case 'k': top_n = std::max(1, atoi(optarg)); break;
+            case 'b': bandwidth = true; break;
+            case 'd': dump_dir = optarg; break;
+            case 'a': analyze.push_back(optarg); break;
+            case 'o': csv_path = optarg; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (analyze.empty() && optind >= argc) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    if (analyze.empty()) {
+        const char* model_path = argv[optind];
+        if (mkdir(dump_dir.c_str(), 0755) && errno != EEXIST) {
+            fprintf(stderr, "Cannot create %s\n", dump_dir.c_str());
+            return -1;
+        }
+        // Warm-up rows are dropped from the dumps, so run them on top
+        printf("Profiling %s: %d invokes (%d warm-up)%s\n", model_path, runs + skip, skip,
+               bandwidth ? ", runtime then bandwidth" : "");
+        analyze.push_back(dump_dir + "/runtime");
+        if (profile_pass(model_path, AML_PERLAYER_RUNTIME, analyze.back(), runs + skip)) {
+            return -1;
+        }
+        if (bandwidth) {
+            analyze.push_back(dump_dir + "/bandwidth");
+            if (profile_pass(model_path, AML_PERLAYER_BANDWIDTH, analyze.back(), runs + skip)) {
+                return -1;
+            }
+        }
+    }
+
+    LayerProfile profile;
+    for (const auto& path : analyze) {
+        if (load_layer_profile(path.c_str(), &profile, skip)) {
+            return -1;
+        }
+    }
+    // Bandwidth columns alone are no profile: the dump layout was not understood
+    bool timed = false;
+    for (const auto& layer : profile.layers) timed = timed || layer.time_samples > 0;
+    if (!timed) {
+        fprintf(stderr, "No layer time column recognized in the dumps (%llu lines not understood); "
+                        "see README.md for the columns read.\n", (unsigned long long)profile.skipped_rows);
+        return -1;
+    }
+    printf("%s", layer_profile_report(profile, top_n).c_str());
+    if (!csv_path.empty()) {
+        if (save_layer_profile_csv(csv_path.c_str(), profile)) {
+            return -1;
+        }
+        printf("Per-layer statistics saved to %s\n", csv_path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,791 @@
+/*
+ * Copyright (C) 2024–2025 Amlogic, Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host-side stand-in for libnnsdk. Implements the part of nn_sdk.h the
+// examples and common/ use, so pipelines build and run on x86 Linux.
+// The "model" is a text description of the tensors (see README.md);
+// outputs come from recorded tensor files or deterministic generators,
+// and every invoke sleeps for a configurable NPU latency.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "nn_sdk.h"
+
+#define LOGE(...) do { fprintf(stderr, "nnsdk_stub: " __VA_ARGS__); fprintf(stderr, "\n"); } while(0)
+
+namespace {
+
+enum Source { SOURCE_RANDOM = 0, SOURCE_ZEROS, SOURCE_CONSTANT, SOURCE_FILE };
+
+struct Tensor {
+    std::string name;
+    std::vector<unsigned int> dims;     // outermost first, as written in the description
+    nn_buffer_format_e format = NN_BUFFER_FORMAT_FP32;
+    nn_buffer_quantize_format_e quant = NN_BUFFER_QUANTIZE_NONE;
+    float scale = 1.0f;
+    int zero_point = 0;
+    int fixed_point_pos = 0;
+    size_t elements = 0;
+    size_t bytes = 0;
+
+    // outputs
+    Source source = SOURCE_RANDOM;
+    unsigned int seed = 0;
+    double constant = 0;
+    std::vector<unsigned char> frames;  // SOURCE_FILE: one or more recorded frames
+};
+
+// One line of the per-layer profile dump
+struct Layer {
+    std::string name;
+    std::string op;
+    bool cpu = false;                   // CPU softop
+    double time_us = 0;
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+};
+
+struct Model {
+    std::vector<Tensor> inputs;
+    std::vector<Tensor> outputs;
+    std::vector<Layer> layers;
+    int latency_us = 0;
+    int jitter_us = 0;
+    int64_t memory_bytes = 0;           // reported context memory, 0: tensor sizes
+};
+
+struct Pending {
+    int64_t id;
+    std::chrono::steady_clock::time_point done;
+};
+
+struct Context {
+    Model model;
+    std::mutex mutex;
+    std::vector<std::vector<unsigned char>> input_data;     // aml_module_input_set copies
+    std::vector<void*> dma_inputs;                          // swapped-in external buffers
+    std::vector<std::pair<void*, size_t>> dma_outputs;      // and their size, for outputs
+    // Output storage: native bytes, float conversions, params
+    std::vector<std::vector<unsigned char>> raw;
+    std::vector<std::vector<float>> converted;
+    std::vector<nn_buffer_params_t> params;
+    nn_output output;
+    uint64_t invokes = 0;
+    std::mt19937 jitter_rng;
+    std::vector<Pending> pending;
+    bool profiling = false;
+    uint64_t last_inference_us = 0;
+    uint64_t dma_bytes = 0;             // aml_util_mallocBuffer allocations
+    int timeout_ms = 0;                 // aml_config.timeout_ms
+    uint64_t started = 0;               // invokes started, for AMLNN_STUB_STALL_EVERY
+    int id = 0;                         // names its per-layer dump
+};
+
+// aml_util_setProfile: per-layer dumps of contexts created afterwards
+std::mutex g_perlayer_mutex;
+aml_profile_type_t g_perlayer_type = AML_PROFILE_NONE;
+std::string g_perlayer_path;
+int g_contexts = 0;
+
+size_t format_size(nn_buffer_format_e format) {
+    switch (format) {
+        case NN_BUFFER_FORMAT_FP32:
+        case NN_BUFFER_FORMAT_INT32:  return 4;
+        case NN_BUFFER_FORMAT_FP16:
+        case NN_BUFFER_FORMAT_UINT16:
+        case NN_BUFFER_FORMAT_INT16:  return 2;
+        case NN_BUFFER_FORMAT_INT64:  return 8;
+        default:                      return 1;
+    }
+}
+
+bool parse_format(const std::string& text, nn_buffer_format_e* format) {
+    static const std::map<std::string, nn_buffer_format_e> names = {
+        {"fp32", NN_BUFFER_FORMAT_FP32},   {"float32", NN_BUFFER_FORMAT_FP32}, {"fp16", NN_BUFFER_FORMAT_FP16},
+        {"uint8", NN_BUFFER_FORMAT_UINT8}, {"int8", NN_BUFFER_FORMAT_INT8},    {"uint16", NN_BUFFER_FORMAT_UINT16},
+        {"int16", NN_BUFFER_FORMAT_INT16}, {"int32", NN_BUFFER_FORMAT_INT32},  {"int64", NN_BUFFER_FORMAT_INT64},
+        {"bool", NN_BUFFER_FORMAT_BOOL},
+    };
+    auto it = names.find(text);
+    if (it == names.end()) return false;
+    *format = it->second;
+    return true;
+}
+
+bool read_file(const std::string& path, std::vector<unsigned char>* data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    data->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// One tensor line:
+//   input|output <name> <type> <d0,d1,...> [asymm <scale> <zp> | dfp <pos>]
+//                [random <seed> | zeros | constant <value> | file <path>]
+bool parse_tensor(std::istringstream& line, const std::string& base_dir, Tensor* t) {
+    std::string type, dims;
+    if (!(line >> t->name >> type >> dims) || !parse_format(type, &t->format)) {
+        return false;
+    }
+    std::istringstream dim_list(dims);
+    std::string dim;
+    t->elements = 1;
+    while (std::getline(dim_list, dim, ',')) {
+        unsigned int value = (unsigned int)strtoul(dim.c_str(), NULL, 10);
+        if (value == 0) return false;
+        t->dims.push_back(value);
+        t->elements *= value;
+    }
+    if (t->dims.empty() || t->dims.size() > MAX_TENSOR_NUM_DIMS) return false;
+    t->bytes = t->elements * format_size(t->format);
+
+    std::string key;
+    while (line >> key) {
+        if (key == "asymm") {
+            t->quant = NN_BUFFER_QUANTIZE_TF_ASYMM;
+            if (!(line >> t->scale >> t->zero_point)) return false;
+        } else if (key == "dfp") {
+            t->quant = NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT;
+            if (!(line >> t->fixed_point_pos)) return false;
+        } else if (key == "random") {
+            t->source = SOURCE_RANDOM;
+            if (!(line >> t->seed)) return false;
+        } else if (key == "zeros") {
+            t->source = SOURCE_ZEROS;
+        } else if (key == "constant") {
+            t->source = SOURCE_CONSTANT;
+            if (!(line >> t->constant)) return false;
+        } else if (key == "file") {
+            std::string path;
+            if (!(line >> path)) return false;
+            if (path[0] != '/' && !base_dir.empty()) path = base_dir + "/" + path;
+            if (!read_file(path, &t->frames)) {
+                LOGE("cannot read %s for output %s.", path.c_str(), t->name.c_str());
+                return false;
+            }
+            if (t->frames.empty() || t->frames.size() % t->bytes) {
+                LOGE("%s holds %zu bytes, not a multiple of output %s (%zu bytes).", path.c_str(),
+                     t->frames.size(), t->name.c_str(), t->bytes);
+                return false;
+            }
+            t->source = SOURCE_FILE;
+        } else if (key[0] == '#') {
+            break;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// layer <name> <op> npu|cpu <time_us> [<read_bytes> <write_bytes>]
+bool parse_layer(std::istringstream& line, Layer* layer) {
+    std::string target;
+    if (!(line >> layer->name >> layer->op >> target >> layer->time_us) || (target != "npu" && target != "cpu")) {
+        return false;
+    }
+    layer->cpu = target == "cpu";
+    std::string read;
+    if (line >> read && read[0] != '#') {
+        layer->read_bytes = strtoull(read.c_str(), NULL, 10);
+        if (!(line >> layer->write_bytes)) return false;
+    }
+    return true;
+}
+
+bool parse_model(const std::string& text, const std::string& base_dir, Model* model) {
+    std::istringstream lines(text);
+    std::string line;
+    int number = 0;
+    while (std::getline(lines, line)) {
+        ++number;
+        std::istringstream fields(line);
+        std::string kind;
+        if (!(fields >> kind) || kind[0] == '#') continue;
+        bool ok = true;
+        if (kind == "input" || kind == "output") {
+            Tensor t;
+            ok = parse_tensor(fields, base_dir, &t);
+            if (ok && kind == "output" && t.seed == 0) t.seed = (unsigned int)model->outputs.size() + 1;
+            if (ok) (kind == "input" ? model->inputs : model->outputs).push_back(t);
+        } else if (kind == "latency_us") {
+            ok = (bool)(fields >> model->latency_us);
+        } else if (kind == "jitter_us") {
+            ok = (bool)(fields >> model->jitter_us);
+        } else if (kind == "memory_bytes") {
+            ok = (bool)(fields >> model->memory_bytes);
+        } else if (kind == "layer") {
+            Layer layer;
+            ok = parse_layer(fields, &layer);
+            if (ok) model->layers.push_back(layer);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            LOGE("model description line %d not understood: %s", number, line.c_str());
+            return false;
+        }
+    }
+    if (model->inputs.empty() || model->outputs.empty()) {
+        LOGE("model description needs at least one input and one output.");
+        return false;
+    }
+    if (model->memory_bytes == 0) {
+        for (const auto& t : model->inputs) model->memory_bytes += t.bytes;
+        for (const auto& t : model->outputs) model->memory_bytes += t.bytes;
+    }
+    if (model->latency_us == 0) {
+        double us = 0;
+        for (const auto& l : model->layers) us += l.time_us;
+        model->latency_us = (int)us;
+    }
+    // The environment overrides the description, so one file serves several latency profiles
+    const char* latency = getenv("AMLNN_STUB_LATENCY_US");
+    if (latency) model->latency_us = atoi(latency);
+    const char* jitter = getenv("AMLNN_STUB_JITTER_US");
+    if (jitter) model->jitter_us = atoi(jitter);
+    return true;
+}
+
+static const char kMagic[] = "# amlnn stub model";
+
+// A real .adla cannot be described on the host; AMLNN_STUB_MODEL names a
+// description to use in its place.
+bool load_model(const aml_config* config, Model* model) {
+    std::string text, base_dir;
+    const char* override_path = getenv("AMLNN_STUB_MODEL");
+    std::string path = config->nbgType == NN_ADLA_FILE && config->path ? config->path : "";
+    if (config->nbgType == NN_ADLA_MEMORY && config->pdata && config->length > 0) {
+        text.assign(config->pdata, config->length);
+    } else if (!path.empty()) {
+        std::vector<unsigned char> data;
+        if (!read_file(path, &data)) {
+            LOGE("cannot read model %s.", path.c_str());
+            return false;
+        }
+        text.assign(data.begin(), data.end());
+    }
+    if (text.compare(0, sizeof(kMagic) - 1, kMagic) != 0) {
+        if (NULL == override_path) {
+            LOGE("model is not a stub description (\"%s\" header); set AMLNN_STUB_MODEL.", kMagic);
+            return false;
+        }
+        path = override_path;
+        std::vector<unsigned char> data;
+        if (!read_file(path, &data)) {
+            LOGE("cannot read %s.", path.c_str());
+            return false;
+        }
+        text.assign(data.begin(), data.end());
+    }
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos) base_dir = path.substr(0, slash);
+    return parse_model(text, base_dir, model);
+}
+
+float half_to_float(uint16_t h) {
+    uint32_t sign = (h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) { mant <<= 1; --exp; }
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+    } else if (exp == 31) {
+        bits = sign | 0x7f800000u | (mant << 13);
+    } else {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+uint16_t float_to_half(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    int exp = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = bits & 0x7fffff;
+    if (exp <= 0) return (uint16_t)sign;
+    if (exp >= 31) return (uint16_t)(sign | 0x7c00);
+    return (uint16_t)(sign | (exp << 10) | (mant >> 13));
+}
+
+double native_value(const Tensor& t, const unsigned char* data, size_t i) {
+    switch (t.format) {
+        case NN_BUFFER_FORMAT_FP32:   return ((const float*)data)[i];
+        case NN_BUFFER_FORMAT_FP16:   return half_to_float(((const uint16_t*)data)[i]);
+        case NN_BUFFER_FORMAT_UINT8:  return data[i];
+        case NN_BUFFER_FORMAT_INT8:   return ((const int8_t*)data)[i];
+        case NN_BUFFER_FORMAT_UINT16: return ((const uint16_t*)data)[i];
+        case NN_BUFFER_FORMAT_INT16:  return ((const int16_t*)data)[i];
+        case NN_BUFFER_FORMAT_INT32:  return ((const int32_t*)data)[i];
+        case NN_BUFFER_FORMAT_INT64:  return (double)((const int64_t*)data)[i];
+        default:                      return data[i];
+    }
+}
+
+void store_native(const Tensor& t, unsigned char* data, size_t i, double v) {
+    switch (t.format) {
+        case NN_BUFFER_FORMAT_FP32:   ((float*)data)[i] = (float)v; break;
+        case NN_BUFFER_FORMAT_FP16:   ((uint16_t*)data)[i] = float_to_half((float)v); break;
+        case NN_BUFFER_FORMAT_UINT8:  data[i] = (unsigned char)std::min(255.0, std::max(0.0, v)); break;
+        case NN_BUFFER_FORMAT_INT8:   ((int8_t*)data)[i] = (int8_t)std::min(127.0, std::max(-128.0, v)); break;
+        case NN_BUFFER_FORMAT_UINT16: ((uint16_t*)data)[i] = (uint16_t)std::min(65535.0, std::max(0.0, v)); break;
+        case NN_BUFFER_FORMAT_INT16:  ((int16_t*)data)[i] = (int16_t)std::min(32767.0, std::max(-32768.0, v)); break;
+        case NN_BUFFER_FORMAT_INT32:  ((int32_t*)data)[i] = (int32_t)v; break;
+        case NN_BUFFER_FORMAT_INT64:  ((int64_t*)data)[i] = (int64_t)v; break;
+        default:                      data[i] = v != 0; break;
+    }
+}
+
+double dequantize(const Tensor& t, double q) {
+    if (t.quant == NN_BUFFER_QUANTIZE_TF_ASYMM) return (q - t.zero_point) * t.scale;
+    if (t.quant == NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT) return std::ldexp(q, -t.fixed_point_pos);
+    return q;
+}
+
+// Native-format output for invoke number `invoke`. Generated outputs are
+// the same on every invoke; recorded files cycle through their frames.
+void fill_output(const Tensor& t, uint64_t invoke, std::vector<unsigned char>* out) {
+    out->resize(t.bytes);
+    unsigned char* data = out->data();
+    switch (t.source) {
+        case SOURCE_FILE: {
+            size_t count = t.frames.size() / t.bytes;
+            memcpy(data, t.frames.data() + (invoke % count) * t.bytes, t.bytes);
+            break;
+        }
+        case SOURCE_ZEROS:
+            for (size_t i = 0; i < t.elements; ++i) {
+                store_native(t, data, i, t.quant == NN_BUFFER_QUANTIZE_TF_ASYMM ? t.zero_point : 0);
+            }
+            break;
+        case SOURCE_CONSTANT:
+            // `constant` is the real value; quantized outputs store its quantized form
+            for (size_t i = 0; i < t.elements; ++i) {
+                double q = t.constant;
+                if (t.quant == NN_BUFFER_QUANTIZE_TF_ASYMM) q = std::round(t.constant / t.scale) + t.zero_point;
+                if (t.quant == NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT) q = std::round(std::ldexp(t.constant, t.fixed_point_pos));
+                store_native(t, data, i, q);
+            }
+            break;
+        case SOURCE_RANDOM: {
+            std::mt19937 rng(t.seed);
+            bool is_float = t.format == NN_BUFFER_FORMAT_FP32 || t.format == NN_BUFFER_FORMAT_FP16;
+            std::uniform_real_distribution<double> real(-4.0, 4.0);
+            std::uniform_int_distribution<int> byte(t.format == NN_BUFFER_FORMAT_INT8 ? -128 : 0,
+                                                    t.format == NN_BUFFER_FORMAT_INT8 ? 127 : 255);
+            for (size_t i = 0; i < t.elements; ++i) {
+                store_native(t, data, i, is_float ? real(rng) : byte(rng));
+            }
+            break;
+        }
+    }
+}
+
+void fill_info(const std::vector<Tensor>& tensors, tensor_info** out) {
+    tensor_info* tinfo = (tensor_info*)calloc(1, sizeof(tensor_info));
+    tinfo->valid = 1;
+    tinfo->num = tensors.size();
+    tinfo->info = (info_t*)calloc(tensors.size(), sizeof(info_t));
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        const Tensor& t = tensors[i];
+        info_t& info = tinfo->info[i];
+        // info_t lists sizes innermost first
+        info.dim_count = t.dims.size();
+        for (size_t d = 0; d < t.dims.size(); ++d) info.sizes_of_dim[d] = t.dims[t.dims.size() - 1 - d];
+        info.data_format = t.format;
+        info.quantization_format = t.quant;
+        info.fixed_point_pos = t.fixed_point_pos;
+        info.TF_scale = t.scale;
+        info.TF_zeropoint = t.zero_point;
+        snprintf(info.name, MAX_NAME_LENGTH, "%s", t.name.c_str());
+    }
+    *out = tinfo;
+}
+
+std::chrono::microseconds invoke_latency(Context* ctx) {
+    int us = ctx->model.latency_us;
+    if (ctx->model.jitter_us > 0) {
+        us += std::uniform_int_distribution<int>(0, ctx->model.jitter_us)(ctx->jitter_rng);
+    }
+    // Every n-th invoke of a context hangs, to exercise timeouts
+    static const char* stall_every = getenv("AMLNN_STUB_STALL_EVERY");
+    if (stall_every && atoi(stall_every) > 0 && ++ctx->started % atoi(stall_every) == 0) {
+        const char* stall_us = getenv("AMLNN_STUB_STALL_US");
+        us = stall_us ? atoi(stall_us) : 1000000;
+    }
+    return std::chrono::microseconds(us);
+}
+
+// Appends one invoke to the context's per-layer dump, a CSV block per
+// invoke. Layer times are scaled to the simulated inference time.
+void write_perlayer(Context* ctx, aml_profile_type_t type, const std::string& save_path) {
+    const Model& model = ctx->model;
+    if (model.layers.empty()) return;
+    bool runtime = type == AML_PERLAYER_RUNTIME;
+    struct stat st;
+    std::string path = save_path;
+    if (stat(save_path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        path += "/context" + std::to_string(ctx->id) + (runtime ? "_runtime.csv" : "_bandwidth.csv");
+    }
+    std::ofstream out(path, std::ios::app);
+    if (!out) {
+        LOGE("cannot write per-layer profile %s.", path.c_str());
+        return;
+    }
+    double listed_us = 0;
+    for (const auto& l : model.layers) listed_us += l.time_us;
+    double scale = listed_us > 0 ? ctx->last_inference_us / listed_us : 1.0;
+
+    out << "# invoke " << ctx->invokes << "\n";
+    out << (runtime ? "layer_id,layer_name,op_type,target,time_us\n" : "layer_id,layer_name,op_type,target,read_bytes,write_bytes\n");
+    char line[512];
+    for (size_t i = 0; i < model.layers.size(); ++i) {
+        const Layer& l = model.layers[i];
+        if (runtime) {
+            snprintf(line, sizeof(line), "%zu,%s,%s,%s,%.1f\n", i, l.name.c_str(), l.op.c_str(), l.cpu ? "CPU" : "NPU",
+                     l.time_us * scale);
+        } else {
+            snprintf(line, sizeof(line), "%zu,%s,%s,%s,%llu,%llu\n", i, l.name.c_str(), l.op.c_str(),
+                     l.cpu ? "CPU" : "NPU", (unsigned long long)l.read_bytes, (unsigned long long)l.write_bytes);
+        }
+        out << line;
+    }
+}
+
+nn_output* produce_outputs(Context* ctx, aml_output_format_t format) {
+    const Model& model = ctx->model;
+    size_t n = model.outputs.size();
+    ctx->raw.resize(n);
+    ctx->converted.resize(n);
+    ctx->params.resize(n);
+    memset(&ctx->output, 0, sizeof(nn_output));
+    ctx->output.typeSize = sizeof(nn_output);
+    ctx->output.num = n;
+    for (size_t i = 0; i < n && i < OUTPUT_MAX_NUM; ++i) {
+        const Tensor& t = model.outputs[i];
+        fill_output(t, ctx->invokes, &ctx->raw[i]);
+
+        nn_buffer_params_t& param = ctx->params[i];
+        memset(&param, 0, sizeof(nn_buffer_params_t));
+        param.num_of_dims = std::min<size_t>(t.dims.size(), 4);
+        for (unsigned int d = 0; d < param.num_of_dims; ++d) param.sizes[d] = t.dims[t.dims.size() - 1 - d];
+        param.data_format = t.format;
+        param.quant_format = t.quant;
+        if (t.quant == NN_BUFFER_QUANTIZE_TF_ASYMM) {
+            param.quant_data.affine.scale = t.scale;
+            param.quant_data.affine.zeroPoint = (unsigned int)t.zero_point;
+        } else if (t.quant == NN_BUFFER_QUANTIZE_DYNAMIC_FIXED_POINT) {
+            param.quant_data.dfp.fixed_point_pos = (unsigned char)t.fixed_point_pos;
+        }
+
+        outBuf_t& out = ctx->output.out[i];
+        snprintf(out.name, MAX_NAME_LENGTH, "%s", t.name.c_str());
+        out.param = &param;
+        out.out_format = format;
+        if (format == AML_OUTDATA_FLOAT32) {
+            std::vector<float>& values = ctx->converted[i];
+            values.resize(t.elements);
+            for (size_t k = 0; k < t.elements; ++k) {
+                values[k] = (float)dequantize(t, native_value(t, ctx->raw[i].data(), k));
+            }
+            out.buf = (unsigned char*)values.data();
+            out.size = values.size() * sizeof(float);
+        } else if (i < ctx->dma_outputs.size() && ctx->dma_outputs[i].first &&
+                   ctx->dma_outputs[i].second >= ctx->raw[i].size()) {
+            // The NPU writes straight into the swapped-in buffer
+            memcpy(ctx->dma_outputs[i].first, ctx->raw[i].data(), ctx->raw[i].size());
+            out.buf = (unsigned char*)ctx->dma_outputs[i].first;
+            out.size = ctx->raw[i].size();
+        } else {
+            out.buf = ctx->raw[i].data();
+            out.size = ctx->raw[i].size();
+        }
+        out.output_valid_length = out.size;
+    }
+    ctx->invokes++;
+    return &ctx->output;
+}
+
+}  // namespace
+
+extern "C" {
+
+void* aml_module_create(aml_config* config) {
+    if (NULL == config) {
+        return NULL;
+    }
+    const aml_compiler_args_t& args = config->compiler_args;
+    if (args.set_compiler_args_flag && args.compiler_only) {
+        // "Compiling" a portable model copies its stub description to on_path
+        std::vector<unsigned char> data;
+        const char* source = args.input.model_path ? args.input.model_path : config->path;
+        if (NULL == source || NULL == config->on_path || !read_file(source, &data) ||
+            data.size() < sizeof(kMagic) - 1 || memcmp(data.data(), kMagic, sizeof(kMagic) - 1) != 0) {
+            LOGE("compiler_only needs a stub description and on_path.");
+            return NULL;
+        }
+        std::ofstream out(config->on_path, std::ios::binary);
+        out.write((const char*)data.data(), data.size());
+        return NULL;
+    }
+    Context* ctx = new Context();
+    if (!load_model(config, &ctx->model)) {
+        delete ctx;
+        return NULL;
+    }
+    ctx->input_data.resize(ctx->model.inputs.size());
+    ctx->dma_inputs.resize(ctx->model.inputs.size(), NULL);
+    ctx->dma_outputs.resize(ctx->model.outputs.size(), std::make_pair((void*)NULL, (size_t)0));
+    ctx->jitter_rng.seed(1);
+    ctx->timeout_ms = config->timeout_ms;
+    std::lock_guard<std::mutex> lock(g_perlayer_mutex);
+    ctx->id = g_contexts++;
+    return ctx;
+}
+
+int aml_module_input_set(void* context, nn_input* pInput) {
+    Context* ctx = (Context*)context;
+    if (NULL == ctx || NULL == pInput || pInput->input_index < 0 ||
+        pInput->input_index >= (int)ctx->model.inputs.size()) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    if (pInput->input_type == INPUT_DMA_DATA) {
+        return 0;   // data is already in the swapped-in buffer
+    }
+    if (NULL == pInput->input || pInput->size <= 0) {
+        return -1;
+    }
+    ctx->input_data[pInput->input_index].assign(pInput->input, pInput->input + pInput->size);
+    return 0;
+}
+
+void* aml_module_output_get(void* context, aml_output_config_t outconfig) {
+    Context* ctx = (Context*)context;
+    if (NULL == ctx) {
+        return NULL;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point done;
+    int timeout_ms = outconfig.invoke.timeout > 0 ? outconfig.invoke.timeout : ctx->timeout_ms;
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        if (outconfig.invoke.invoke_type == 1) {
+            // invoke_no_wait: the "NPU" finishes after the latency
+            ctx->pending.push_back({outconfig.invoke.invoke_id, start + invoke_latency(ctx)});
+            return &ctx->output;
+        }
+        if (outconfig.invoke.invoke_type == 2) {
+            auto it = std::find_if(ctx->pending.begin(), ctx->pending.end(),
+                                   [&](const Pending& p) { return p.id == outconfig.invoke.invoke_id; });
+            if (it == ctx->pending.end()) {
+                LOGE("wait for unknown invoke %lld.", (long long)outconfig.invoke.invoke_id);
+                return NULL;
+            }
+            done = it->done;
+            ctx->pending.erase(it);
+        } else {
+            done = start + invoke_latency(ctx);
+        }
+    }
+    if (timeout_ms > 0 && done > start + std::chrono::milliseconds(timeout_ms)) {
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(timeout_ms));
+        LOGE("invoke timed out after %d ms.", timeout_ms);
+        return NULL;
+    }
+    std::this_thread::sleep_until(done);
+
+    aml_profile_type_t perlayer_type;
+    std::string perlayer_path;
+    {
+        std::lock_guard<std::mutex> lock(g_perlayer_mutex);
+        perlayer_type = g_perlayer_type;
+        perlayer_path = g_perlayer_path;
+    }
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->last_inference_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    if (perlayer_type == AML_PERLAYER_RUNTIME || perlayer_type == AML_PERLAYER_BANDWIDTH) {
+        write_perlayer(ctx, perlayer_type, perlayer_path);
+    }
+    return produce_outputs(ctx, outconfig.format == AML_OUTDATA_FLOAT32 ? AML_OUTDATA_FLOAT32 : outconfig.format);
+}
+
+void* aml_module_output_get_simple(void* context) {
+    aml_output_config_t outconfig;
+    memset(&outconfig, 0, sizeof(aml_output_config_t));
+    outconfig.typeSize = sizeof(aml_output_config_t);
+    outconfig.format = AML_OUTDATA_FLOAT32;
+    return aml_module_output_get(context, outconfig);
+}
+
+int aml_module_destroy(void* context) {
+    delete (Context*)context;
+    return 0;
+}
+
+int aml_util_enableProfile(void* context, aml_profile_config_t* profile_data) {
+    if (NULL == context || NULL == profile_data) return -1;
+    ((Context*)context)->profiling = true;
+    return 0;
+}
+
+int aml_util_getProfileInfo(void* context, aml_profile_config_t* profile_data) {
+    Context* ctx = (Context*)context;
+    if (NULL == ctx || NULL == profile_data || !ctx->profiling) return -1;
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    memset(&profile_data->profiling_data, 0, sizeof(aml_profiling_data_t));
+    profile_data->profiling_data.inference_time_us = ctx->last_inference_us;
+    profile_data->profiling_data.ext.us_elapsed_in_hw_op = (int32_t)ctx->last_inference_us;
+    // Memory as a driver without a fixed pool reports it
+    aml_profiling_ext_data_t& ext = profile_data->profiling_data.ext;
+    ext.mem_alloced_base = (uint64_t)ctx->model.memory_bytes;
+    ext.mem_alloced_umd = ctx->dma_bytes;
+    ext.mem_pool_size = -1;
+    ext.mem_pool_used = ext.mem_alloced_base + ext.mem_alloced_umd;
+    memset(&profile_data->context_info, 0, sizeof(aml_context_info_t));
+    profile_data->context_info.ctx_info.memory_size = ctx->model.memory_bytes;
+    profile_data->context_info.ctx_info.num_layers = 1;
+    return 0;
+}
+
+int aml_util_disableProfile(void* context, aml_profile_config_t* profile_data) {
+    (void)profile_data;
+    if (NULL == context) return -1;
+    ((Context*)context)->profiling = false;
+    return 0;
+}
+
+int aml_util_setProfile(aml_profile_type_t type, const char* savepath) {
+    if ((type == AML_PERLAYER_RUNTIME || type == AML_PERLAYER_BANDWIDTH) && (NULL == savepath || '\0' == savepath[0])) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(g_perlayer_mutex);
+    g_perlayer_type = type;
+    g_perlayer_path = savepath ? savepath : "";
+    return 0;
+}
+
+int aml_read_chip_info(aml_platform_info_t* platform_info) {
+    if (NULL == platform_info) return -1;
+    static char sdk_version[] = AML_NN_SDK_VERSION "-stub";
+    static char hw_version[] = "host";
+    memset(platform_info, 0, sizeof(aml_platform_info_t));
+    platform_info->sdk_version = sdk_version;
+    platform_info->ddk_version = sdk_version;
+    platform_info->hw_version = hw_version;
+    platform_info->hw_type = AML_HARDWARE_ADLA;
+    const char* cores = getenv("AMLNN_STUB_CORES");
+    platform_info->npu_hw_info.core_num = cores ? (unsigned int)atoi(cores) : 1;
+    platform_info->npu_hw_info.num = 1;
+    return 0;
+}
+
+int aml_util_mallocBuffer(void* context, aml_memory_config_t* mem_config, aml_memory_data_t* mem_data) {
+    if (NULL == context || NULL == mem_config || NULL == mem_data || mem_config->mem_size <= 0) return -1;
+    void* memory = NULL;
+    size_t size = ((size_t)mem_config->mem_size + 4095) & ~(size_t)4095;
+    if (posix_memalign(&memory, 4096, size)) return -1;
+    mem_data->memory = memory;
+    mem_data->viraddr = memory;
+    mem_data->phyaddr = (uint64_t)(uintptr_t)memory;
+    Context* ctx = (Context*)context;
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->dma_bytes += size;
+    return 0;
+}
+
+int aml_util_freeBuffer(void* context, aml_memory_config_t* mem_config, aml_memory_data_t* mem_data) {
+    Context* ctx = (Context*)context;
+    if (NULL == ctx || NULL == mem_config || NULL == mem_data) return -1;
+    {
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        for (auto& dma : ctx->dma_inputs) {
+            if (dma == mem_data->viraddr) dma = NULL;
+        }
+        for (auto& dma : ctx->dma_outputs) {
+            if (dma.first == mem_data->viraddr) dma = std::make_pair((void*)NULL, (size_t)0);
+        }
+        size_t size = ((size_t)mem_config->mem_size + 4095) & ~(size_t)4095;
+        ctx->dma_bytes -= std::min<uint64_t>(ctx->dma_bytes, size);
+    }
+    free(mem_data->memory);
+    mem_data->memory = NULL;
+    mem_data->viraddr = NULL;
+    return 0;
+}
+
+int aml_util_flushBuffer(void* context, aml_memory_config_t* mem_config, aml_memory_data_t* mem_data) {
+    return (NULL == context || NULL == mem_config || NULL == mem_data) ? -1 : 0;
+}
+
+int aml_util_swapExternalInputBuffer(void* context, aml_memory_config_t* mem_config, aml_memory_data_t* mem_data) {
+    Context* ctx = (Context*)context;
+    if (NULL == ctx || NULL == mem_config || NULL == mem_data || mem_config->index >= ctx->dma_inputs.size()) return -1;
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->dma_inputs[mem_config->index] = mem_data->viraddr;
+    return 0;
+}
+
+int aml_util_swapExternalOutputBuffer(void* context, aml_memory_config_t* mem_config, aml_memory_data_t* mem_data) {
+    Context* ctx = (Context*)context;
+    if (NULL == ctx || NULL == mem_config || NULL == mem_data || mem_config->index >= ctx->dma_outputs.size() ||
+        mem_config->mem_size <= 0) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(ctx->mutex);
+    ctx->dma_outputs[mem_config->index] = std::make_pair(mem_data->viraddr, (size_t)mem_config->mem_size);
+    return 0;
+}
+
+int aml_util_getTensorInfo(void* context, const char* model_data, tensor_info** in_tInfo, tensor_info** out_tInfo) {
+    (void)model_data;
+    Context* ctx = (Context*)context;
+    if (NULL == ctx || NULL == in_tInfo || NULL == out_tInfo) return -1;
+    fill_info(ctx->model.inputs, in_tInfo);
+    fill_info(ctx->model.outputs, out_tInfo);
+    return 0;
+}
+
+int aml_util_freeTensorInfo(tensor_info* tinfo) {
+    if (NULL == tinfo) return -1;
+    free(tinfo->info);
+    free(tinfo);
+    return 0;
+}
+
+}  // extern "C"
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2024–2025 Amlogic, Inc. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks OpenMP / NEON settings for a model's CPU fallback ops and
+// saves the best latency / CPU-time tradeoff as "<model>.softop", which
+// init_network and ModelSession load automatically.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "model_session.h"
+#include "softop_profile.h"
+
+struct Result {
+    SoftopProfile profile;
+    std::string label;
+    double mean_ms = 0;
+    double p90_ms = 0;
+    double cpu_ms = 0;     // process CPU time per invoke, all threads
+    double cost = 0;
+    bool ok = false;
+};
+
+static double cpu_time_ms() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3 +
+           usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+}
+
+static std::string describe(const SoftopProfile& p) {
+    char text[128];
+    if (p.openmp) {
+        snprintf(text, sizeof(text), "openmp=%d neon=%d", p.openmp_threads, p.neon);
+    } else {
+        snprintf(text, sizeof(text), "openmp=off neon=%d", p.neon);
+    }
+    std::string label(text);
+    for (const auto& op : p.ops) {
+        snprintf(text, sizeof(text), " op%d[omp=%d neon=%d]", (int)op.op, op.openmp ? op.openmp_threads : 0, op.neon);
+        label += text;
+    }
+    return label;
+}
+
+static Result measure(const char* model_path, const SoftopProfile& profile, int runs, int warmup, double cpu_weight) {
+    Result r;
+    r.profile = profile;
+    r.label = describe(profile);
+
+    SessionConfig config;
+    config.softop = std::make_shared<SoftopProfile>(profile);
+    std::unique_ptr<ModelSession> session = ModelSession::create(model_path, config);
+    if (!session) {
+        return r;
+    }
+
+    // Deterministic pseudo-random inputs so every candidate runs the same data
+    std::mt19937 rng(1234);
+    for (const auto& desc : session->inputs()) {
+        TensorView input = session->input(desc.index);
+        if (!input.data) return r;
+        for (size_t i = 0; i < input.size; ++i) input.data[i] = (unsigned char)rng();
+    }
+
+    for (int i = 0; i < warmup; ++i) {
+        if (!session->run()) return r;
+    }
+
+    std::vector<double> times;
+    double cpu_start = cpu_time_ms();
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        if (!session->run()) return r;
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    double cpu_ms = cpu_time_ms() - cpu_start;
+
+    double sum = 0;
+    for (double t : times) sum += t;
+    std::sort(times.begin(), times.end());
+    r.mean_ms = sum / runs;
+    r.p90_ms = times[(size_t)(0.9 * (runs - 1))];
+    r.cpu_ms = cpu_ms / runs;
+    r.cost = r.mean_ms + cpu_weight * r.cpu_ms;
+    r.ok = true;
+    return r;
+}
+
+static void print_result(const Result& r) {
+    if (r.ok) {
+        printf("  %-48s mean %8.2f ms  p90 %8.2f ms  cpu %8.2f ms  cost %8.2f\n",
+               r.label.c_str(), r.mean_ms, r.p90_ms, r.cpu_ms, r.cost);
+    } else {
+        printf("  %-48s failed\n", r.label.c_str());
+    }
+}
+
+static void usage(const char* prog) {
+    printf("%s <model.adla> [options]\n"
+           "  -n <runs>        timed invokes per setting (default 20)\n"
+           "  -w <weight>      cost = mean latency + weight * CPU time per invoke (default 0.25)\n"
+           "  -t <threads>     largest OpenMP thread count to try (default: online CPUs)\n"
+           "  -o <ids>         comma separated aml_operator_t ids to tune individually\n"
+           "  -p <path>        profile to write (default <model>.softop)\n"
+           "  -d               dry run, do not write the profile\n", prog);
+}
+
+int main(int argc, char** argv) {
+    int runs = 20;
+    int warmup = 3;
+    double cpu_weight = 0.25;
+    int max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    std::vector<int> op_ids;
+    std::string out_path;
+    bool dry_run = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:t:o:p:dh")) != -1) {
+        switch (opt) {
+            case 'n': runs = std::max(1, atoi(optarg)); break;
+            case 'w': cpu_weight = atof(optarg); break;
+            case 't': max_threads = atoi(optarg); break;
+            case 'o': {
+                std::string ids(optarg);
+                size_t pos = 0;
+                while (pos < ids.size()) {
+                    size_t comma = ids.find(',', pos);
+                    if (comma == std::string::npos) comma = ids.size();
+                    op_ids.push_back(atoi(ids.substr(pos, comma - pos).c_str()));
+                    pos = comma + 1;
+                }
+                break;
+            }
+            case 'p': out_path = optarg; break;
+            case 'd': dry_run = true; break;
+            default: usage(argv[0]); return opt == 'h' ? 0 : -1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return -1;
+    }
+    const char* model_path = argv[optind];
+    if (out_path.empty()) out_path = softop_profile_path(model_path);
+    max_threads = std::max(1, std::min(max_threads, 127));
+
+    // Stage 1: model-wide grid of thread counts x NEON
+    std::vector<int> thread_counts;
+    for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    std::vector<SoftopProfile> grid;
+    for (int neon = 1; neon >= 0; --neon) {
+        SoftopProfile p;
+        p.neon = neon;
+        p.openmp = false;
+        grid.push_back(p);
+        for (int t : thread_counts) {
+            p.openmp = true;
+            p.openmp_threads = t;
+            grid.push_back(p);
+        }
+    }
+
+    printf("Tuning %s: %zu settings, %d runs each, cpu weight %.2f\n", model_path, grid.size(), runs, cpu_weight);
+    Result best;
+    for (const auto& p : grid) {
+        Result r = measure(model_path, p, runs, warmup, cpu_weight);
+        print_result(r);
+        if (r.ok && (!best.ok || r.cost < best.cost)) best = r;
+    }
+    if (!best.ok) {
+        fprintf(stderr, "No setting ran successfully.\n");
+        return -1;
+    }
+
+    // Stage 2: per-operator overrides on top of the best model-wide setting
+    if (!op_ids.empty()) {
+        printf("Per-operator tuning from: %s\n", best.label.c_str());
+    }
+    for (int id : op_ids) {
+        std::vector<SoftopOp> variants;
+        SoftopOp op;
+        op.op = (aml_operator_t)id;
+        op.openmp_threads = best.profile.openmp_threads;
+        op.neon = best.profile.neon;
+        op.openmp = !best.profile.openmp;
+        variants.push_back(op);
+        op.openmp = best.profile.openmp;
+        op.neon = !best.profile.neon;
+        variants.push_back(op);
+        if (best.profile.openmp && best.profile.openmp_threads > 1) {
+            op.neon = best.profile.neon;
+            op.openmp_threads = 1;
+            variants.push_back(op);
+        }
+        for (const auto& v : variants) {
+            SoftopProfile p = best.profile;
+            p.ops.push_back(v);
+            Result r = measure(model_path, p, runs, warmup, cpu_weight);
+            print_result(r);
+            if (r.ok && r.cost < best.cost) best = r;
+        }
+    }
+
+    printf("Best: %s (mean %.2f ms, cpu %.2f ms per invoke)\n", best.label.c_str(), best.mean_ms, best.cpu_ms);
+    if (dry_run) {
+        return 0;
+    }
+    char comment[256];
+    snprintf(comment, sizeof(comment), "softop_tuner: mean %.2f ms, cpu %.2f ms per invoke, cpu weight %.2f",
+             best.mean_ms, best.cpu_ms, cpu_weight);
+    if (save_softop_profile(out_path.c_str(), best.profile, comment)) {
+        return -1;
+    }
+    printf("Profile saved to %s\n", out_path.c_str());
+    return 0;
+}